@@ -0,0 +1,353 @@
+/* Name: CAN acceptance filter builder
+ * Description: Builds the acceptance filter look-up table sections from a declarative list of identifiers
+ */
+
+/* Includes */
+
+#include "CanFilter.h"
+
+/* Defines */
+
+#define CAN_FILTER_MAX_STD_RANGES		(CAN_FILTER_MAX_SFF + CAN_FILTER_MAX_SFF_GROUPS)
+#define CAN_FILTER_MAX_EXT_RANGES		(CAN_FILTER_MAX_EFF + CAN_FILTER_MAX_EFF_GROUPS)
+
+// Identifier bits CAN_SetupAFLUT() compares when it checks the order of a section, the controller is not compared
+#define CAN_FILTER_FULLCAN_ORDER_MASK	0x000003FF
+#define CAN_FILTER_STD_ORDER_MASK		0x000007FF
+#define CAN_FILTER_EXT_ORDER_MASK		0x0FFFFFFF
+
+/* Structs */
+
+typedef struct {
+
+	uint8_t controller;
+	uint32_t lowerId;
+	uint32_t upperId;
+
+} CAN_FILTER_RANGE_T;
+
+/* Prototypes */
+
+static Bool CanFilter_AddRange(CAN_FILTER_RANGE_T *ranges, uint8_t *count, uint8_t maxCount,
+		uint8_t controller, uint32_t lowerId, uint32_t upperId);
+static void CanFilter_Sort(CAN_FILTER_RANGE_T *ranges, uint8_t count);
+static uint8_t CanFilter_Merge(CAN_FILTER_RANGE_T *ranges, uint8_t count);
+static Bool CanFilter_CheckOrder(const CAN_FILTER_TABLES_T *tables);
+
+/* Variables */
+
+// Entry counters of the acceptance filter driver (lpc17xx_can.c), they only count up
+extern uint16_t CANAF_FullCAN_cnt;
+extern uint16_t CANAF_std_cnt;
+extern uint16_t CANAF_gstd_cnt;
+extern uint16_t CANAF_ext_cnt;
+extern uint16_t CANAF_gext_cnt;
+
+/* Implementation */
+
+/*
+ * @brief		Build acceptance filter sections from a list of identifiers, identifiers are sorted per
+ * 				controller and adjacent or overlapping identifiers are merged into group entries. FullCAN
+ * 				identifiers get one message object each, in the order of tables->fullCan
+ * @param[in]	entries Declarative list of identifiers to accept
+ * @param[in]	count Number of entries
+ * @param[out]	tables Section definition and entry storage, pass to CanFilter_Apply()
+ * @return		CAN_OK if successful, CAN_OBJECTS_FULL_ERROR if a section overflows, CAN_AF_ENTRY_ERROR if the
+ * 				identifiers of both controllers interleave within a section (see CanFilter_CheckOrder())
+ */
+CAN_ERROR CanFilter_Build(const CAN_FILTER_ENTRY_T *entries, uint8_t count, CAN_FILTER_TABLES_T *tables)
+{
+	CAN_FILTER_RANGE_T stdRanges[CAN_FILTER_MAX_STD_RANGES];
+	CAN_FILTER_RANGE_T extRanges[CAN_FILTER_MAX_EXT_RANGES];
+	CAN_FILTER_RANGE_T fullCanIds[CAN_FILTER_MAX_FULLCAN];
+	uint8_t stdCount = 0, extCount = 0, fullCanIdCount = 0;
+	uint8_t fullCanCount = 0, sffCount = 0, sffGroupCount = 0, effCount = 0, effGroupCount = 0;
+	uint8_t i, prefix;
+
+	// Collect identifier ranges per frame format
+	for (i = 0; i < count; i++)
+	{
+		switch (entries[i].type)
+		{
+			case CAN_FILTER_STD:
+				if (!CanFilter_AddRange(stdRanges, &stdCount, CAN_FILTER_MAX_STD_RANGES,
+						entries[i].controller, entries[i].lowerId, entries[i].upperId))
+					return CAN_OBJECTS_FULL_ERROR;
+				break;
+
+			case CAN_FILTER_EXT:
+				if (!CanFilter_AddRange(extRanges, &extCount, CAN_FILTER_MAX_EXT_RANGES,
+						entries[i].controller, entries[i].lowerId, entries[i].upperId))
+					return CAN_OBJECTS_FULL_ERROR;
+				break;
+
+			case CAN_FILTER_PGN:
+				// One range of source addresses (bits 0..7) for every prefix (bits 24..28)
+				for (prefix = 0; prefix < CAN_FILTER_PGN_PREFIXES; prefix++)
+				{
+					uint32_t lowerId = ((uint32_t)prefix << 24) | ((entries[i].lowerId & 0xFFFF) << 8);
+					if (!CanFilter_AddRange(extRanges, &extCount, CAN_FILTER_MAX_EXT_RANGES,
+							entries[i].controller, lowerId, lowerId | 0xFF))
+						return CAN_OBJECTS_FULL_ERROR;
+				}
+				break;
+
+			case CAN_FILTER_FULLCAN:
+				if (!CanFilter_AddRange(fullCanIds, &fullCanIdCount, CAN_FILTER_MAX_FULLCAN,
+						entries[i].controller, entries[i].lowerId, entries[i].lowerId))
+					return CAN_OBJECTS_FULL_ERROR;
+				break;
+
+			default:
+				return CAN_AF_ENTRY_ERROR;
+		}
+	}
+
+	CanFilter_Sort(fullCanIds, fullCanIdCount);
+	CanFilter_Sort(stdRanges, stdCount);
+	CanFilter_Sort(extRanges, extCount);
+	stdCount = CanFilter_Merge(stdRanges, stdCount);
+	extCount = CanFilter_Merge(extRanges, extCount);
+
+	// Every unique FullCAN identifier gets its own message object
+	for (i = 0; i < fullCanIdCount; i++)
+	{
+		if (fullCanCount != 0 &&
+				tables->fullCan[fullCanCount - 1].controller == fullCanIds[i].controller &&
+				tables->fullCan[fullCanCount - 1].id_11 == fullCanIds[i].lowerId)
+			continue; // duplicate
+
+		tables->fullCan[fullCanCount].controller = fullCanIds[i].controller;
+		tables->fullCan[fullCanCount].disable = MSG_ENABLE;
+		tables->fullCan[fullCanCount].id_11 = fullCanIds[i].lowerId;
+		fullCanCount++;
+	}
+
+	// FullCAN entries are stored in pairs as well, pad an odd count with a disabled entry
+	if (fullCanCount & 1)
+	{
+		if (fullCanCount == CAN_FILTER_MAX_FULLCAN)
+			return CAN_OBJECTS_FULL_ERROR;
+
+		tables->fullCan[fullCanCount] = tables->fullCan[fullCanCount - 1];
+		tables->fullCan[fullCanCount].disable = MSG_DISABLE;
+		fullCanCount++;
+	}
+
+	// Single identifiers become explicit entries, everything else a group entry
+	for (i = 0; i < stdCount; i++)
+	{
+		if (stdRanges[i].lowerId == stdRanges[i].upperId)
+		{
+			if (sffCount == CAN_FILTER_MAX_SFF)
+				return CAN_OBJECTS_FULL_ERROR;
+
+			tables->sff[sffCount].controller = stdRanges[i].controller;
+			tables->sff[sffCount].disable = MSG_ENABLE;
+			tables->sff[sffCount].id_11 = stdRanges[i].lowerId;
+			sffCount++;
+		}
+		else
+		{
+			if (sffGroupCount == CAN_FILTER_MAX_SFF_GROUPS)
+				return CAN_OBJECTS_FULL_ERROR;
+
+			tables->sffGroup[sffGroupCount].controller1 = stdRanges[i].controller;
+			tables->sffGroup[sffGroupCount].disable1 = MSG_ENABLE;
+			tables->sffGroup[sffGroupCount].lowerID = stdRanges[i].lowerId;
+			tables->sffGroup[sffGroupCount].controller2 = stdRanges[i].controller;
+			tables->sffGroup[sffGroupCount].disable2 = MSG_ENABLE;
+			tables->sffGroup[sffGroupCount].upperID = stdRanges[i].upperId;
+			sffGroupCount++;
+		}
+	}
+
+	// Explicit standard entries are stored in pairs, pad an odd count with a disabled entry
+	if (sffCount & 1)
+	{
+		if (sffCount == CAN_FILTER_MAX_SFF)
+			return CAN_OBJECTS_FULL_ERROR;
+
+		tables->sff[sffCount] = tables->sff[sffCount - 1];
+		tables->sff[sffCount].disable = MSG_DISABLE;
+		sffCount++;
+	}
+
+	for (i = 0; i < extCount; i++)
+	{
+		if (extRanges[i].lowerId == extRanges[i].upperId)
+		{
+			if (effCount == CAN_FILTER_MAX_EFF)
+				return CAN_OBJECTS_FULL_ERROR;
+
+			tables->eff[effCount].controller = extRanges[i].controller;
+			tables->eff[effCount].ID_29 = extRanges[i].lowerId;
+			effCount++;
+		}
+		else
+		{
+			if (effGroupCount == CAN_FILTER_MAX_EFF_GROUPS)
+				return CAN_OBJECTS_FULL_ERROR;
+
+			tables->effGroup[effGroupCount].controller1 = extRanges[i].controller;
+			tables->effGroup[effGroupCount].controller2 = extRanges[i].controller;
+			tables->effGroup[effGroupCount].lowerEID = extRanges[i].lowerId;
+			tables->effGroup[effGroupCount].upperEID = extRanges[i].upperId;
+			effGroupCount++;
+		}
+	}
+
+	// Fill in section definition, empty sections must be NULL
+	tables->section.FullCAN_Sec = fullCanCount ? tables->fullCan : NULL;
+	tables->section.FC_NumEntry = fullCanCount;
+	tables->section.SFF_Sec = sffCount ? tables->sff : NULL;
+	tables->section.SFF_NumEntry = sffCount;
+	tables->section.SFF_GPR_Sec = sffGroupCount ? tables->sffGroup : NULL;
+	tables->section.SFF_GPR_NumEntry = sffGroupCount;
+	tables->section.EFF_Sec = effCount ? tables->eff : NULL;
+	tables->section.EFF_NumEntry = effCount;
+	tables->section.EFF_GPR_Sec = effGroupCount ? tables->effGroup : NULL;
+	tables->section.EFF_GPR_NumEntry = effGroupCount;
+
+	if (!CanFilter_CheckOrder(tables))
+		return CAN_AF_ENTRY_ERROR;
+
+	return CAN_OK;
+}
+
+/*
+ * @brief		Load sections built by CanFilter_Build() into the acceptance filter and clear the FullCAN message objects
+ * @param[in]	tables Sections built by CanFilter_Build()
+ * @return		CAN_OK if successful, the error of CAN_SetupAFLUT() otherwise (the acceptance filter is left off)
+ */
+CAN_ERROR CanFilter_Apply(const CAN_FILTER_TABLES_T *tables)
+{
+	AF_SectionDef section = tables->section; // CAN_SetupAFLUT() advances the section pointers
+	CAN_ERROR result;
+	uint32_t *object;
+	uint16_t i;
+
+	// Start a new look-up table, the driver appends to the entries counted so far
+	CANAF_FullCAN_cnt = 0;
+	CANAF_std_cnt = 0;
+	CANAF_gstd_cnt = 0;
+	CANAF_ext_cnt = 0;
+	CANAF_gext_cnt = 0;
+
+	result = CAN_SetupAFLUT(LPC_CANAF, &section);
+	if (result != CAN_OK)
+		return result;
+
+	// Clear FullCAN message objects (3 words each) located after the look-up table
+	object = (uint32_t *)((uint8_t *)LPC_CANAF_RAM + LPC_CANAF->ENDofTable);
+	for (i = 0; i < tables->section.FC_NumEntry * 3; i++)
+		object[i] = 0;
+
+	return CAN_OK;
+}
+
+/*
+ * @brief		Check the sections the way CAN_SetupAFLUT() does: every identifier (or lower bound) may not be below the
+ * 				previous identifier (or upper bound) of its section, whichever controller they belong to. Sections are
+ * 				sorted by controller for the acceptance filter, so the identifiers of CAN1 must stay below those of CAN2
+ * @return		TRUE if CAN_SetupAFLUT() accepts the sections, FALSE otherwise
+ */
+Bool CanFilter_CheckOrder(const CAN_FILTER_TABLES_T *tables)
+{
+	uint8_t i;
+
+	for (i = 1; i < tables->section.FC_NumEntry; i++)
+		if ((tables->fullCan[i - 1].id_11 & CAN_FILTER_FULLCAN_ORDER_MASK) > tables->fullCan[i].id_11)
+			return FALSE;
+
+	for (i = 1; i < tables->section.SFF_NumEntry; i++)
+		if ((tables->sff[i - 1].id_11 & CAN_FILTER_STD_ORDER_MASK) > tables->sff[i].id_11)
+			return FALSE;
+
+	for (i = 1; i < tables->section.SFF_GPR_NumEntry; i++)
+		if ((tables->sffGroup[i - 1].upperID & CAN_FILTER_STD_ORDER_MASK) > tables->sffGroup[i].lowerID)
+			return FALSE;
+
+	for (i = 1; i < tables->section.EFF_NumEntry; i++)
+		if ((tables->eff[i - 1].ID_29 & CAN_FILTER_EXT_ORDER_MASK) > tables->eff[i].ID_29)
+			return FALSE;
+
+	for (i = 1; i < tables->section.EFF_GPR_NumEntry; i++)
+		if ((tables->effGroup[i - 1].upperEID & CAN_FILTER_EXT_ORDER_MASK) > tables->effGroup[i].lowerEID)
+			return FALSE;
+
+	return TRUE;
+}
+
+/*
+ * @brief		Append an identifier range to a list of ranges
+ * @return		TRUE if successful, FALSE if the list is full
+ */
+Bool CanFilter_AddRange(CAN_FILTER_RANGE_T *ranges, uint8_t *count, uint8_t maxCount,
+		uint8_t controller, uint32_t lowerId, uint32_t upperId)
+{
+	if (*count == maxCount)
+		return FALSE;
+
+	ranges[*count].controller = controller;
+	ranges[*count].lowerId = lowerId;
+	ranges[*count].upperId = upperId;
+	(*count)++;
+
+	return TRUE;
+}
+
+/*
+ * @brief		Sort ranges by controller and lower identifier, the order the acceptance filter requires
+ * @return		None
+ */
+void CanFilter_Sort(CAN_FILTER_RANGE_T *ranges, uint8_t count)
+{
+	uint8_t i, j;
+
+	// Insertion sort, lists are short and built once
+	for (i = 1; i < count; i++)
+	{
+		CAN_FILTER_RANGE_T range = ranges[i];
+
+		for (j = i; j > 0; j--)
+		{
+			if (ranges[j - 1].controller < range.controller ||
+					(ranges[j - 1].controller == range.controller && ranges[j - 1].lowerId <= range.lowerId))
+				break;
+
+			ranges[j] = ranges[j - 1];
+		}
+
+		ranges[j] = range;
+	}
+}
+
+/*
+ * @brief		Merge adjacent or overlapping ranges of the same controller in a sorted list
+ * @return		Number of ranges after merging
+ */
+uint8_t CanFilter_Merge(CAN_FILTER_RANGE_T *ranges, uint8_t count)
+{
+	uint8_t i, merged;
+
+	if (count == 0)
+		return 0;
+
+	merged = 0;
+	for (i = 1; i < count; i++)
+	{
+		if (ranges[i].controller == ranges[merged].controller &&
+				ranges[i].lowerId <= ranges[merged].upperId + 1)
+		{
+			if (ranges[i].upperId > ranges[merged].upperId)
+				ranges[merged].upperId = ranges[i].upperId;
+		}
+		else
+		{
+			ranges[++merged] = ranges[i];
+		}
+	}
+
+	return merged + 1;
+}
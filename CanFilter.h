@@ -0,0 +1,70 @@
+/* Name: CAN acceptance filter builder
+ * Description: Builds the acceptance filter look-up table sections from a declarative list of identifiers
+ */
+
+#ifndef CAN_FILTER_H
+#define CAN_FILTER_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <lpc17xx_can.h>
+
+/* Defines */
+
+// Maximum number of entries per acceptance filter section
+#define CAN_FILTER_MAX_FULLCAN					16
+#define CAN_FILTER_MAX_SFF						16
+#define CAN_FILTER_MAX_SFF_GROUPS				8
+#define CAN_FILTER_MAX_EFF						8
+#define CAN_FILTER_MAX_EFF_GROUPS				40
+
+// Number of ID prefixes (priority and data page bits 24..28) a PGN entry expands to
+#define CAN_FILTER_PGN_PREFIXES					32
+
+// Declarative filter entries
+#define CAN_FILTER_STD_ID(ctrl, id)				{ CAN_FILTER_STD, (ctrl), (id), (id) }
+#define CAN_FILTER_STD_RANGE(ctrl, lower, upper)	{ CAN_FILTER_STD, (ctrl), (lower), (upper) }
+#define CAN_FILTER_EXT_ID(ctrl, id)				{ CAN_FILTER_EXT, (ctrl), (id), (id) }
+#define CAN_FILTER_EXT_RANGE(ctrl, lower, upper)	{ CAN_FILTER_EXT, (ctrl), (lower), (upper) }
+#define CAN_FILTER_PGN_ID(ctrl, pgn)			{ CAN_FILTER_PGN, (ctrl), (pgn), (pgn) }
+#define CAN_FILTER_FULLCAN_ID(ctrl, id)			{ CAN_FILTER_FULLCAN, (ctrl), (id), (id) }
+
+/* Enums */
+
+typedef enum {
+	CAN_FILTER_STD			= 0,	// Standard 11-bit identifier (range)
+	CAN_FILTER_EXT			= 1,	// Extended 29-bit identifier (range)
+	CAN_FILTER_PGN			= 2,	// Bits 8..23 of an extended identifier, any prefix and source address
+	CAN_FILTER_FULLCAN		= 3		// Standard 11-bit identifier stored in a FullCAN message object
+} CAN_FILTER_TYPE;
+
+/* Structs */
+
+typedef struct {
+
+	uint8_t type;			// CAN_FILTER_TYPE
+	uint8_t controller;		// CAN1_CTRL or CAN2_CTRL
+	uint32_t lowerId;
+	uint32_t upperId;
+
+} CAN_FILTER_ENTRY_T;
+
+typedef struct {
+
+	AF_SectionDef section;	// to be passed to CAN_SetupAFLUT()
+
+	FullCAN_Entry fullCan[CAN_FILTER_MAX_FULLCAN];	// in message object order
+	SFF_Entry sff[CAN_FILTER_MAX_SFF];
+	SFF_GPR_Entry sffGroup[CAN_FILTER_MAX_SFF_GROUPS];
+	EFF_Entry eff[CAN_FILTER_MAX_EFF];
+	EFF_GPR_Entry effGroup[CAN_FILTER_MAX_EFF_GROUPS];
+
+} CAN_FILTER_TABLES_T;
+
+/* Prototypes */
+
+CAN_ERROR CanFilter_Build(const CAN_FILTER_ENTRY_T *entries, uint8_t count, CAN_FILTER_TABLES_T *tables);
+CAN_ERROR CanFilter_Apply(const CAN_FILTER_TABLES_T *tables);
+
+#endif
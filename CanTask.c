@@ -5,40 +5,98 @@
 
 /* Defines */
 
+// Size of CAN RX ring buffer, must be a power of two
 #define CAN_RING_BUFFER_SIZE				(32)
+#define CAN_RING_BUFFER_MASK				(CAN_RING_BUFFER_SIZE - 1)
+
+#if (CAN_RING_BUFFER_SIZE & CAN_RING_BUFFER_MASK) != 0
+#error "CAN_RING_BUFFER_SIZE must be a power of two"
+#endif
+
+// FullCAN message objects are polled at least this often (CoOS ticks). They hold the latest frame of their
+// identifier without an interrupt, a frame overwritten within the interval is not decoded.
+#define CAN_FULLCAN_POLL_INTERVAL			(CFG_SYSTICK_FREQ / 10)
 
 /* Struct */
 
+// Received CAN frame with its reception time
+typedef struct {
+
+	CAN_MSG_Type msg;
+	uint32_t cycles; // DWT cycle count at reception
+	uint32_t timestamp; // MICROSECOND_TIMER at reception
+
+} CAN_RX_FRAME_T;
+
+// Single-producer (CAN ISR), single-consumer (CAN task) ring buffer. Head and tail
+// are free-running counters, each one written by one side only, so neither side
+// has to mask the other. The ring is empty when head == tail and full when
+// head - tail == CAN_RING_BUFFER_SIZE.
 typedef struct {
 
-	CAN_MSG_Type rxBuffer[CAN_RING_BUFFER_SIZE];
-	BOOL rxBufferIsFull;
-	uint32_t rxBufferHead;
-	uint32_t rxBufferTail;
+	CAN_RX_FRAME_T rxBuffer[CAN_RING_BUFFER_SIZE];
+	volatile uint32_t rxBufferHead; // written by ISR only
+	volatile uint32_t rxBufferTail; // written by CAN task only
 
 } CAN_RING_BUFFER_T;
 
 /* Prototypes */
 
 void CanTask_CanInit();
-BOOL CanTask_CanReceive(CAN_MSG_Type *msg);
+BOOL CanTask_CanReceive(CAN_RX_FRAME_T *frame, uint8_t *controller);
+uint32_t CanTask_CanIrq(uint8_t controller);
+void CanTask_SampleFullCan();
+void CanTask_CaptureSync();
+void CanTask_Capture(CAN_MSG_Type *msg, uint8_t controller, uint32_t timestamp);
+void CanTask_CaptureFlush();
 
 /* Variables */
 
-static CAN_RING_BUFFER_T _ringBuffer; // CAN RX ring buffer
+static LPC_CAN_TypeDef * const _controllers[CAN_CONTROLLER_COUNT] = { LPC_CAN1, LPC_CAN2 };
+static CAN_RING_BUFFER_T _ringBuffers[CAN_CONTROLLER_COUNT]; // CAN RX ring buffer per controller
+static OS_FlagID _rxFlagId = E_CREATE_FAIL; // set by ISR when messages are available
+static CAN_LATENCY_STATS_T _latencyStats; // ISR-to-decode latency
+static CAN_ISR_STATS_T _isrStats; // ISR load
+static CAN_BUS_STATS_T _busStats[CAN_CONTROLLER_COUNT]; // bus health, load and drop accounting per controller
+static CAN_FILTER_TABLES_T _filterTables; // acceptance filter sections
+static uint8_t _fullCanCount; // number of FullCAN message objects
+static CAN_CAPTURE_RECORD_T _captureBuffer[CAN_CAPTURE_BATCH_SIZE]; // capture records not yet passed to storage
+static uint8_t _captureCount; // number of records in capture buffer
+static uint32_t _captureDropped; // capture records dropped because the storage task fell behind
 
 /* Implementation */
 
 void CanTask_Run(void *pdata)
 {
-	CAN_MSG_Type msg;
+	CAN_RX_FRAME_T frame;
+	uint8_t controller;
+	uint8_t i;
 
 	Debug_Send(DM_INFO, "CAN task started.");
 
-	// Set ring buffer to default state
-	_ringBuffer.rxBufferIsFull = FALSE;
-	_ringBuffer.rxBufferHead = 0;
-	_ringBuffer.rxBufferTail = 0;
+	// Set ring buffers to default state
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+	{
+		_ringBuffers[i].rxBufferHead = 0;
+		_ringBuffers[i].rxBufferTail = 0;
+	}
+
+	// Create RX flag (auto-reset, initial state 0)
+	_rxFlagId = CoCreateFlag(1, 0);
+	if (_rxFlagId == E_CREATE_FAIL)
+	{
+		Debug_Send(DM_FATAL_ERROR, "CAN RX flag creation failed.");
+		CoExitTask();
+		while (1);
+	}
+
+	// Start cycle counter for latency measurement and microsecond timer for capture timestamps
+	EnableCycleCounter();
+	EnableMicrosecondTimer();
+
+	// Relate capture timestamps to wall-clock time
+	if (CAN_CAPTURE_ENABLED)
+		CanTask_CaptureSync();
 
 	// Initialize sensor data manager
 	SensorDataManager_Init();
@@ -48,35 +106,126 @@ void CanTask_Run(void *pdata)
 
 	for (;;)
 	{
-		// Get CAN message from ring buffer
-		if (!CanTask_CanReceive(&msg))
+		// Sleep until the ISR signals new messages in the ring buffers, or until FullCAN message objects are due
+		CoWaitForSingleFlag(_rxFlagId, _fullCanCount != 0 ? CAN_FULLCAN_POLL_INTERVAL : 0);
+
+		// Drain all messages from both ring buffers in one batch, in order of reception
+		while (CanTask_CanReceive(&frame, &controller))
 		{
-			// No message received, look again after 1 CoOS tick
-			CoTickDelay(1);
-			continue;
+			// Process message
+			SensorDataManager_PutCanData(&frame.msg, controller, frame.timestamp);
+
+			// Update ISR-to-decode latency
+			uint32_t latency = DWT_CYCCNT - frame.cycles;
+			_latencyStats.last = latency;
+			if (latency > _latencyStats.max)
+				_latencyStats.max = latency;
+			_latencyStats.total += latency;
+			_latencyStats.count++;
+
+			// Capture message
+			if (CAN_CAPTURE_ENABLED)
+				CanTask_Capture(&frame.msg, controller, frame.timestamp);
+
+			/*char buffer[256];
+			sprintf(buffer, "Message received (id: %X, length: %X, format: %X, type: %X, data: %X %X %X %X %X %X %X %X)!\r\n",
+					frame.msg.id, frame.msg.len, frame.msg.format, frame.msg.type,
+					frame.msg.dataA[0], frame.msg.dataA[1], frame.msg.dataA[2], frame.msg.dataA[3],
+					frame.msg.dataB[0], frame.msg.dataB[1], frame.msg.dataB[2], frame.msg.dataB[3]);
+
+			Debug_Send(DM_INFO, buffer);*/
 		}
 
-		// Process message
-		SensorDataManager_PutCanData(&msg);
+		// Decode FullCAN frames as well
+		CanTask_SampleFullCan();
 
-		/*char buffer[256];
-		sprintf(buffer, "Message received (id: %X, length: %X, format: %X, type: %X, data: %X %X %X %X %X %X %X %X)!\r\n",
-				msg.id, msg.len, msg.format, msg.type,
-				msg.dataA[0], msg.dataA[1], msg.dataA[2], msg.dataA[3],
-				msg.dataB[0], msg.dataB[1], msg.dataB[2], msg.dataB[3]);
+		// Pass captured messages of this batch to the storage task
+		if (CAN_CAPTURE_ENABLED)
+			CanTask_CaptureFlush();
 
-		Debug_Send(DM_INFO, buffer);*/
+		// Keep a snapshot of the tables while the telemetry link is down
+		SensorHistory_Sample();
+	}
+}
+
+void CanTask_GetLatencyStats(CAN_LATENCY_STATS_T *stats)
+{
+	// Statistics are written by the CAN task only, prevent a torn copy
+	CoSchedLock();
+	*stats = _latencyStats;
+	CoSchedUnlock();
+}
+
+void CanTask_GetIsrStats(CAN_ISR_STATS_T *stats)
+{
+	// Statistics are written by the ISR only, prevent a torn copy
+	NVIC_DisableIRQ(CAN_IRQn);
+	*stats = _isrStats;
+	NVIC_EnableIRQ(CAN_IRQn);
+}
+
+uint32_t CanTask_GetCaptureDropped()
+{
+	// Written by the CAN task only, a word is read atomically
+	return _captureDropped;
+}
+
+void CanTask_GetBusStats(uint8_t controller, CAN_BUS_STATS_T *stats)
+{
+	// Statistics are written by the ISR only, prevent a torn copy
+	NVIC_DisableIRQ(CAN_IRQn);
+	*stats = _busStats[controller];
+	NVIC_EnableIRQ(CAN_IRQn);
+}
+
+/*
+ * @brief		Poll the FullCAN message objects and decode the frames received since the previous poll. Frames are
+ * 				timestamped at the poll, up to CAN_FULLCAN_POLL_INTERVAL after their reception.
+ * @return		None
+ */
+void CanTask_SampleFullCan()
+{
+	CAN_MSG_Type msg;
+	uint8_t i;
+
+	for (i = 0; i < _fullCanCount; i++)
+	{
+		// Reading the object clears its semaphore, it isn't read while hardware updates it
+		if (FCAN_ReadObjByIndex(LPC_CANAF, i, &msg) != CAN_OK)
+			continue;
+
+		uint32_t timestamp = MICROSECOND_TIMER;
+		uint8_t controller = _filterTables.fullCan[i].controller;
+
+		// Bus load accounting, statistics are otherwise written by the ISR
+		NVIC_DisableIRQ(CAN_IRQn);
+		_busStats[controller].frames++;
+		_busStats[controller].bits += CAN_FRAME_BITS(STD_ID_FORMAT, msg.type == REMOTE_FRAME ? 0 : msg.len);
+		NVIC_EnableIRQ(CAN_IRQn);
+
+		SensorDataManager_PutCanData(&msg, controller, timestamp);
 	}
 }
 
 void CanTask_CanInit()
 {
-	// Pin configuration CAN2
+	uint32_t i;
+
+	// Pin configuration CAN1
 	PINSEL_CFG_Type pinConfig;
-	pinConfig.Funcnum = PINSEL_FUNC_2;
+	pinConfig.Funcnum = PINSEL_FUNC_1;
 	pinConfig.OpenDrain = PINSEL_PINMODE_NORMAL;
 	pinConfig.Pinmode = PINSEL_PINMODE_PULLUP;
 	pinConfig.Portnum = PINSEL_PORT_0;
+	// P0.00 CAN Receiver
+	pinConfig.Pinnum = PINSEL_PIN_0;
+	PINSEL_ConfigPin(&pinConfig);
+	// P0.01 CAN Transmitter
+	pinConfig.Pinnum = PINSEL_PIN_1;
+	PINSEL_ConfigPin(&pinConfig);
+
+	// Pin configuration CAN2
+	pinConfig.Funcnum = PINSEL_FUNC_2;
 	// P0.04 CAN Receiver
 	pinConfig.Pinnum = PINSEL_PIN_4;
 	PINSEL_ConfigPin(&pinConfig);
@@ -84,66 +233,239 @@ void CanTask_CanInit()
 	pinConfig.Pinnum = PINSEL_PIN_5;
 	PINSEL_ConfigPin(&pinConfig);
 
-	// Initialize CAN
-	CAN_Init(LPC_CAN2, 250000);
-	CAN_ModeConfig(LPC_CAN2, CAN_OPERATING_MODE, ENABLE);
+	// Initialize CAN (resets the acceptance filter)
+	CAN_Init(LPC_CAN1, CAN1_BITRATE);
+	CAN_Init(LPC_CAN2, CAN2_BITRATE);
+
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+	{
+		CAN_ModeConfig(_controllers[i], CAN_OPERATING_MODE, ENABLE);
+
+		// Enable receive, data overrun, error warning (bus-off) and error passive interrupts
+		CAN_IRQCmd(_controllers[i], CANINT_RIE, ENABLE);
+		CAN_IRQCmd(_controllers[i], CANINT_DOIE, ENABLE);
+		CAN_IRQCmd(_controllers[i], CANINT_EIE, ENABLE);
+		CAN_IRQCmd(_controllers[i], CANINT_EPIE, ENABLE);
+	}
 
-	// Enable receive interrupt
-	CAN_IRQCmd(LPC_CAN2, CANINT_RIE, ENABLE);
+	// Only accept identifiers the sensor data manager decodes
+	uint8_t filterCount;
+	const CAN_FILTER_ENTRY_T *filter = SensorDataManager_GetCanFilter(&filterCount);
+	CAN_ERROR result = CanFilter_Build(filter, filterCount, &_filterTables);
+	if (result == CAN_OK)
+		result = CanFilter_Apply(&_filterTables);
 
-	// Bypass acceptance filter
-	CAN_SetAFMode(LPC_CANAF, CAN_AccBP);
+	if (result == CAN_OK)
+	{
+		// FullCAN message objects are polled by the CAN task, they don't interrupt (FCANIE stays 0)
+		_fullCanCount = _filterTables.section.FC_NumEntry;
+	}
+	else
+	{
+		// Filter list is invalid (a firmware bug), keep receiving everything rather than nothing
+		char buffer[80];
+		sprintf(buffer, "CAN acceptance filter rejected (error %d), bypassing filter.", (int)result);
+		Debug_Send(DM_FATAL_ERROR, buffer);
 
-	// Enable CAN interrupts
+		CAN_SetAFMode(LPC_CANAF, CAN_AccBP);
+		_fullCanCount = 0;
+	}
+
+	// Enable CAN interrupts (shared by both controllers)
 	NVIC_EnableIRQ(CAN_IRQn);
 }
 
-BOOL CanTask_CanReceive(CAN_MSG_Type *msg)
+BOOL CanTask_CanReceive(CAN_RX_FRAME_T *frame, uint8_t *controller)
 {
-	// Disable CAN RX interrupt service routine (prevent race conditions)
-	CAN_IRQCmd((LPC_UART_TypeDef *)LPC_CAN2, CANINT_RIE, DISABLE);
+	CAN_RING_BUFFER_T *rb = NULL;
+	uint32_t tail = 0;
+	uint8_t i;
 
-	// Check if ring buffer is not empty
-	if ((_ringBuffer.rxBufferTail == _ringBuffer.rxBufferHead) && !_ringBuffer.rxBufferIsFull)
+	// Merge ring buffers, take the oldest message at their tails
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
 	{
-		// Re-enable CAN RX interrupt service routine
-		CAN_IRQCmd((LPC_UART_TypeDef *)LPC_CAN2, CANINT_RIE, ENABLE);
+		uint32_t t = _ringBuffers[i].rxBufferTail;
 
-		return FALSE; // buffer is empty
-	}
-	else
-	{
-		// Get message from CAN ring buffer
-		*msg = _ringBuffer.rxBuffer[_ringBuffer.rxBufferTail];
-		_ringBuffer.rxBufferTail = (_ringBuffer.rxBufferTail + 1) % CAN_RING_BUFFER_SIZE;
-		_ringBuffer.rxBufferIsFull = FALSE;
+		// Check if ring buffer is not empty
+		if (t == _ringBuffers[i].rxBufferHead)
+			continue;
 
-		// Re-enable CAN RX interrupt service routine
-		CAN_IRQCmd((LPC_UART_TypeDef *)LPC_CAN2, CANINT_RIE, ENABLE);
+		// Make sure the message is read after the head index that published it
+		DATA_MEMORY_BARRIER();
 
-		return TRUE; // successful
+		// Cycle counter wraps around, compare the difference
+		if (rb == NULL || (int32_t)(_ringBuffers[i].rxBuffer[t & CAN_RING_BUFFER_MASK].cycles -
+				rb->rxBuffer[tail & CAN_RING_BUFFER_MASK].cycles) < 0)
+		{
+			rb = &_ringBuffers[i];
+			tail = t;
+			*controller = i;
+		}
 	}
+
+	if (rb == NULL)
+		return FALSE; // all buffers are empty
+
+	// Get message from CAN ring buffer
+	*frame = rb->rxBuffer[tail & CAN_RING_BUFFER_MASK];
+
+	// Make sure the message is copied before its slot is handed back to the ISR
+	DATA_MEMORY_BARRIER();
+
+	rb->rxBufferTail = tail + 1;
+
+	return TRUE; // successful
+}
+
+void CanTask_CaptureSync()
+{
+	RTC_TIME_Type rtcTime;
+	RTC_GetFullTime(LPC_RTC, &rtcTime);
+	uint32_t unixTime = (uint32_t)ConvertRtcToUnixTime(&rtcTime);
+
+	CAN_CAPTURE_RECORD_T *record = &_captureBuffer[_captureCount++];
+	memset(record, 0, sizeof(CAN_CAPTURE_RECORD_T));
+	record->timestamp = MICROSECOND_TIMER;
+	record->flags = CAN_CAPTURE_FLAG_SYNC;
+	memcpy(record->data, &unixTime, sizeof(unixTime));
+
+	CanTask_CaptureFlush();
+}
+
+void CanTask_Capture(CAN_MSG_Type *msg, uint8_t controller, uint32_t timestamp)
+{
+	CAN_CAPTURE_RECORD_T *record = &_captureBuffer[_captureCount++];
+	record->timestamp = timestamp;
+	record->id = msg->id;
+	record->flags = (msg->len & CAN_CAPTURE_FLAG_LEN_MASK) |
+			(msg->format == EXT_ID_FORMAT ? CAN_CAPTURE_FLAG_EXT : 0) |
+			(msg->type == REMOTE_FRAME ? CAN_CAPTURE_FLAG_REMOTE : 0) |
+			(controller == CAN1_CTRL ? CAN_CAPTURE_FLAG_CAN1 : 0);
+	memcpy(record->data, msg->dataA, 4);
+	memcpy(record->data + 4, msg->dataB, 4);
+
+	// Batch is full, pass it on
+	if (_captureCount == CAN_CAPTURE_BATCH_SIZE)
+		CanTask_CaptureFlush();
+}
+
+void CanTask_CaptureFlush()
+{
+	if (_captureCount == 0)
+		return;
+
+	// Storage task's ring buffer is full or it isn't running, drop the records rather than wait for the card
+	if (!StorageTask_WriteCanFile((uint8_t *)_captureBuffer, _captureCount * sizeof(CAN_CAPTURE_RECORD_T)))
+		_captureDropped += _captureCount;
+	_captureCount = 0;
 }
 
 void CAN_IRQHandler()
 {
-	Debug_Send(DM_INFO, "IRQ IS GEROEPEREERT, dat is goed");
+	uint32_t startCycles = DWT_CYCCNT;
+	uint32_t frames = 0;
+	uint8_t i;
+
+	CoEnterISR();
+
+	// Both controllers share one interrupt, service each of them
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+		frames += CanTask_CanIrq(i);
+
+	// Wake up CAN task
+	if (frames != 0)
+		isr_SetFlag(_rxFlagId);
+
+	// Update ISR statistics
+	uint32_t cycles = DWT_CYCCNT - startCycles;
+	_isrStats.entries++;
+	_isrStats.frames += frames;
+	_isrStats.lastCycles = cycles;
+	if (cycles > _isrStats.maxCycles)
+		_isrStats.maxCycles = cycles;
+	_isrStats.totalCycles += cycles;
+
+	CoExitISR();
+}
+
+/*
+ * @brief		Service the interrupts of one CAN controller and move its messages into its ring buffer
+ * @param[in]	controller CAN1_CTRL or CAN2_CTRL
+ * @return		Number of messages read from the controller
+ */
+uint32_t CanTask_CanIrq(uint8_t controller)
+{
+	LPC_CAN_TypeDef *can = _controllers[controller];
+	CAN_RING_BUFFER_T *rb = &_ringBuffers[controller];
+	CAN_BUS_STATS_T *busStats = &_busStats[controller];
 	CAN_MSG_Type msg;
+	uint32_t frames = 0;
 
-	uint32_t icrCAN2 = CAN_IntGetStatus(LPC_CAN2);
-	if (icrCAN2 & (1 << 0)) // CAN message received
+	// Reading the interrupt register acknowledges all interrupts but RI, which is
+	// cleared by releasing the receive buffer
+	uint32_t icr = CAN_IntGetStatus(can);
+
+	if (icr & (CAN_ICR_EI | CAN_ICR_EPI | CAN_ICR_DOI))
 	{
-		// Get CAN message
-		CAN_ReceiveMsg(LPC_CAN2, &msg);
-
-		// Ring buffer is full (i.e. data wasn't retrieved fast enough from ring buffer)
-		if (_ringBuffer.rxBufferIsFull)
-			return;
-
-		// Put CAN message into ring buffer
-		_ringBuffer.rxBuffer[_ringBuffer.rxBufferHead] = msg;
-		_ringBuffer.rxBufferHead = (_ringBuffer.rxBufferHead + 1) % CAN_RING_BUFFER_SIZE;
-		if (_ringBuffer.rxBufferHead == _ringBuffer.rxBufferTail)
-			_ringBuffer.rxBufferIsFull = TRUE;
+		uint32_t gsr = CAN_GetCTRLStatus(can, CANCTRL_GLOBAL_STS);
+
+		// Error passive interrupt fires on entering and leaving, only count entering
+		if ((icr & CAN_ICR_EPI) && (((gsr >> 16) & 0xFF) > 127 || ((gsr >> 24) & 0xFF) > 127))
+			busStats->errorPassive++;
+
+		// Controller enters reset mode on bus-off, count and return to operating mode
+		if ((icr & CAN_ICR_EI) && (gsr & CAN_GSR_BS))
+		{
+			busStats->busOff++;
+			CAN_ModeConfig(can, CAN_OPERATING_MODE, ENABLE);
+		}
+
+		// Receive buffer overran, clear overrun status
+		if (icr & CAN_ICR_DOI)
+		{
+			busStats->dataOverruns++;
+			CAN_SetCommand(can, CAN_CMR_CDO);
+		}
 	}
+
+	// Drain every received message, the receive buffer refills while we are busy
+	while (CAN_ReceiveMsg(can, &msg) == SUCCESS)
+	{
+		// CAN_ReceiveMsg() only releases the receive buffer for data frames
+		if (msg.type == REMOTE_FRAME)
+			CAN_SetCommand(can, CAN_CMR_RRB);
+
+		// Bus load accounting
+		busStats->frames++;
+		busStats->bits += CAN_FRAME_BITS(msg.format, msg.type == REMOTE_FRAME ? 0 : msg.len);
+
+		uint32_t head = rb->rxBufferHead;
+
+		// Check if ring buffer is not full
+		if (head - rb->rxBufferTail != CAN_RING_BUFFER_SIZE)
+		{
+			// Put CAN message into ring buffer
+			rb->rxBuffer[head & CAN_RING_BUFFER_MASK].msg = msg;
+			rb->rxBuffer[head & CAN_RING_BUFFER_MASK].cycles = DWT_CYCCNT;
+			rb->rxBuffer[head & CAN_RING_BUFFER_MASK].timestamp = MICROSECOND_TIMER;
+
+			// Make sure the message is written before the CAN task can see the new head
+			DATA_MEMORY_BARRIER();
+
+			rb->rxBufferHead = head + 1;
+
+			// Track peak ring buffer occupancy
+			if (head + 1 - rb->rxBufferTail > busStats->peakRingOccupancy)
+				busStats->peakRingOccupancy = head + 1 - rb->rxBufferTail;
+		}
+		else
+		{
+			// Ring buffer is full (i.e. data wasn't retrieved fast enough from ring buffer)
+			busStats->ringOverflows++;
+		}
+
+		frames++;
+	}
+
+	return frames;
 }
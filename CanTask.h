@@ -4,6 +4,8 @@
 
 /* Includes */
 
+#include <string.h>
+
 #include <lpc_types.h>
 #include <lpc17xx_can.h>
 #include <lpc17xx_clkpwr.h>
@@ -13,7 +15,10 @@
 #include <CoOs.h>
 
 #include "Debug.h"
+#include "Misc.h"
 #include "SensorDataManager.h"
+#include "SensorHistory.h"
+#include "StorageTask.h"
 
 /* Defines */
 
@@ -21,6 +26,76 @@
 #define CAN_TASK_PRIORITY						0
 #define CAN_TASK_STACK_SIZE						2048
 
+// CAN controllers, indexed by CAN1_CTRL and CAN2_CTRL
+#define CAN_CONTROLLER_COUNT					2
+
+// Bit rate of CAN1 (drivetrain) and CAN2 (sensors)
+#define CAN1_BITRATE							250000
+#define CAN2_BITRATE							250000
+
+// Nominal number of bits on the bus of a frame, including interframe space but excluding stuff bits
+#define CAN_FRAME_BITS(format, len)				(((format) == EXT_ID_FORMAT ? 67 : 47) + 8 * (len))
+
+// Capture received frames to CAN_FILE_NAME (1 = enabled)
+#define CAN_CAPTURE_ENABLED						1
+
+// Number of capture records collected before they are passed to the storage task
+#define CAN_CAPTURE_BATCH_SIZE					16
+
+// Capture record flags
+#define CAN_CAPTURE_FLAG_LEN_MASK				0x0F	// data length code
+#define CAN_CAPTURE_FLAG_EXT					0x10	// extended identifier
+#define CAN_CAPTURE_FLAG_REMOTE					0x20	// remote frame
+#define CAN_CAPTURE_FLAG_CAN1					0x40	// received by CAN1 (clear: CAN2)
+#define CAN_CAPTURE_FLAG_SYNC					0x80	// time sync marker, data[0..3] hold the unix time
+
+/* Structs */
+
+// ISR-to-decode latency of received CAN frames (DWT cycles)
+typedef struct {
+
+	uint32_t count;
+	uint32_t last;
+	uint32_t max;
+	uint64_t total;
+
+} CAN_LATENCY_STATS_T;
+
+// CAN interrupt service routine load (DWT cycles)
+typedef struct {
+
+	uint32_t entries;
+	uint32_t frames;
+	uint32_t lastCycles;
+	uint32_t maxCycles;
+	uint64_t totalCycles;
+
+} CAN_ISR_STATS_T;
+
+// CAN bus health, load and drop accounting (per controller)
+typedef struct {
+
+	uint32_t frames;			// frames received, including FullCAN frames
+	uint32_t bits;				// nominal bits of those frames, see CAN_FRAME_BITS()
+	uint32_t ringOverflows;		// frames dropped because the RX ring buffer was full
+	uint32_t dataOverruns;		// frames lost in the controller's receive buffer
+	uint32_t errorPassive;		// transitions into error passive state
+	uint32_t busOff;			// bus-off events
+	uint32_t peakRingOccupancy;	// highest number of frames waiting in the RX ring buffer
+
+} CAN_BUS_STATS_T;
+
+// Capture record as written to CAN_FILE_NAME (17 bytes, little-endian). A sync marker is
+// written when capturing starts to relate the microsecond timestamps to wall-clock time
+typedef struct {
+
+	uint32_t timestamp __attribute__ ((__packed__));	// reception time (MICROSECOND_TIMER)
+	uint32_t id __attribute__ ((__packed__));
+	uint8_t flags __attribute__ ((__packed__));			// CAN_CAPTURE_FLAG_*
+	uint8_t data[8] __attribute__ ((__packed__));		// dataA followed by dataB
+
+} CAN_CAPTURE_RECORD_T;
+
 /* Variables */
 
 // CAN task stack and unique identifier administration
@@ -32,4 +107,9 @@ OS_TID canTaskId;
 // CAN task prototype
 void CanTask_Run(void *pdata);
 
+void CanTask_GetLatencyStats(CAN_LATENCY_STATS_T *stats);
+void CanTask_GetIsrStats(CAN_ISR_STATS_T *stats);
+void CanTask_GetBusStats(uint8_t controller, CAN_BUS_STATS_T *stats);
+uint32_t CanTask_GetCaptureDropped();
+
 #endif
@@ -0,0 +1,161 @@
+/* Name: Packet compression
+ * Description: LZSS compression of telemetry packet tables, the window is the data compressed so far
+ */
+
+/* Includes */
+
+#include "Compression.h"
+
+/* Variables */
+
+static COMPRESSION_STATS_T _stats;
+
+/* Implementation */
+
+/*
+ * @brief		Compress data, every call is independent so packets can be decompressed on their own
+ * @param[in]	src Data to compress
+ * @param[in]	srcLength Size of data
+ * @param[out]	dest Compressed data
+ * @param[in]	destSize Size of dest, pass srcLength - 1 to only accept compressed data that is smaller
+ * @return		Size of compressed data, 0 if it doesn't fit in dest
+ */
+uint16_t Compression_Compress(const uint8_t *src, uint16_t srcLength, uint8_t *dest, uint16_t destSize)
+{
+	uint32_t startCycles = DWT_CYCCNT;
+	uint16_t srcPos = 0, destPos = 0, flagPos = 0;
+	uint8_t flagBit = 8;
+
+	while (srcPos < srcLength)
+	{
+		uint16_t maxLength = srcLength - srcPos;
+		uint16_t bestLength = 0, bestDistance = 0;
+		uint16_t distance;
+
+		if (maxLength > COMPRESSION_MAX_MATCH)
+			maxLength = COMPRESSION_MAX_MATCH;
+
+		// Longest match in the window, the nearest one if there are several
+		for (distance = 1; distance <= COMPRESSION_WINDOW_SIZE && distance <= srcPos; distance++)
+		{
+			const uint8_t *match = src + srcPos - distance;
+			uint16_t length = 0;
+
+			while (length < maxLength && match[length] == src[srcPos + length])
+				length++;
+
+			if (length > bestLength)
+			{
+				bestLength = length;
+				bestDistance = distance;
+
+				if (length == maxLength)
+					break;
+			}
+		}
+
+		// Start a new group every 8 tokens
+		if (flagBit == 8)
+		{
+			if (destPos == destSize)
+				break;
+
+			flagPos = destPos;
+			dest[destPos++] = 0;
+			flagBit = 0;
+		}
+
+		if (bestLength >= COMPRESSION_MIN_MATCH)
+		{
+			if (destSize - destPos < 2)
+				break;
+
+			dest[flagPos] |= _BIT(flagBit);
+			dest[destPos++] = bestDistance - 1;
+			dest[destPos++] = bestLength - COMPRESSION_MIN_MATCH;
+			srcPos += bestLength;
+		}
+		else
+		{
+			if (destPos == destSize)
+				break;
+
+			dest[destPos++] = src[srcPos++];
+		}
+
+		flagBit++;
+	}
+
+	// Data that doesn't compress is sent as is
+	if (srcPos < srcLength)
+		destPos = 0;
+
+	_stats.count++;
+	_stats.inputBytes += srcLength;
+	_stats.outputBytes += destPos ? destPos : srcLength;
+	_stats.cycles += DWT_CYCCNT - startCycles;
+
+	return destPos;
+}
+
+/*
+ * @brief		Decompress data compressed by Compression_Compress(), reference for the shore side
+ * @param[in]	src Compressed data
+ * @param[in]	srcLength Size of compressed data
+ * @param[out]	dest Decompressed data
+ * @param[in]	destSize Size of dest
+ * @return		Size of decompressed data, 0 if the compressed data is invalid or doesn't fit in dest
+ */
+uint16_t Compression_Decompress(const uint8_t *src, uint16_t srcLength, uint8_t *dest, uint16_t destSize)
+{
+	uint16_t srcPos = 0, destPos = 0;
+	uint8_t flags = 0, flagBit = 8;
+
+	while (srcPos < srcLength)
+	{
+		if (flagBit == 8)
+		{
+			flags = src[srcPos++];
+			flagBit = 0;
+			continue;
+		}
+
+		if (flags & _BIT(flagBit))
+		{
+			if (srcLength - srcPos < 2)
+				return 0;
+
+			uint16_t distance = src[srcPos++] + 1;
+			uint16_t length = src[srcPos++] + COMPRESSION_MIN_MATCH;
+
+			if (distance > destPos || length > destSize - destPos)
+				return 0;
+
+			// Byte by byte, matches may overlap themselves
+			while (length--)
+			{
+				dest[destPos] = dest[destPos - distance];
+				destPos++;
+			}
+		}
+		else
+		{
+			if (destPos == destSize)
+				return 0;
+
+			dest[destPos++] = src[srcPos++];
+		}
+
+		flagBit++;
+	}
+
+	return destPos;
+}
+
+void Compression_GetStats(COMPRESSION_STATS_T *stats)
+{
+	// Statistics are written by the compressing task, prevent a torn copy
+	CoSchedLock();
+	*stats = _stats;
+	CoSchedUnlock();
+}
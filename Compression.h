@@ -0,0 +1,42 @@
+/* Name: Packet compression
+ * Description: LZSS compression of telemetry packet tables, the window is the data compressed so far
+ */
+
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <CoOs.h>
+
+#include "Misc.h"
+
+/* Defines */
+
+// Compressed data is a sequence of groups: a flag byte followed by up to 8 tokens, bit 0 of the flag byte
+// belongs to the first token. A set bit is a match of two bytes, distance - 1 and length - COMPRESSION_MIN_MATCH,
+// copying length bytes starting distance bytes back (matches may overlap themselves). A clear bit is a literal byte.
+#define COMPRESSION_WINDOW_SIZE					256
+#define COMPRESSION_MIN_MATCH					3
+#define COMPRESSION_MAX_MATCH					(255 + COMPRESSION_MIN_MATCH)
+
+/* Structs */
+
+// Compression ratio and load, uncompressed data counts as output
+typedef struct {
+
+	uint32_t count;
+	uint32_t inputBytes;
+	uint32_t outputBytes;
+	uint32_t cycles;		// DWT cycles spent compressing
+
+} COMPRESSION_STATS_T;
+
+/* Prototypes */
+
+uint16_t Compression_Compress(const uint8_t *src, uint16_t srcLength, uint8_t *dest, uint16_t destSize);
+uint16_t Compression_Decompress(const uint8_t *src, uint16_t srcLength, uint8_t *dest, uint16_t destSize);
+void Compression_GetStats(COMPRESSION_STATS_T *stats);
+
+#endif
@@ -7,6 +7,8 @@
 /* Includes */
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "GM862.h"
 
@@ -57,6 +59,10 @@ static void GM862_SendAt(const char *command);
 static GM862_RESULT GM862_GetResult();
 static int GM862_GetResponseFormat(const char *format, ...);
 static BOOL GM862_GetResponse(char *respBuffer, uint16_t buffSize);
+static void GM862_SetMode(GM862_MODE mode);
+static BOOL GM862_SendOnline(uint8_t *packet, uint16_t packetLength);
+static BOOL GM862_SendCommand(uint8_t *packet, uint16_t packetLength);
+static BOOL GM862_WaitForPrompt();
 static BOOL GM862_UART_SendByte(uint8_t b);
 static uint16_t GM862_UART_ReceiveByte();
 static uint32_t GM862_UART_Send(uint8_t *txbuf, uint32_t buflen);
@@ -67,6 +73,16 @@ static uint32_t GM862_UART_Receive(uint8_t *rxbuf, uint32_t buflen);
 static UART_RING_BUFFER_T _ringBuffer; // UART RX ring buffer
 static uint16_t _timeout; // UART RX timeout in CoOS ticks
 static char _globalBuffer[128]; // global command/response buffer
+static GM862_GPS_DATA _gpsCache; // latest GPS fix
+static uint32_t _gpsCacheTime; // CoOS tick count at latest GPS fix
+static BOOL _gpsCacheValid; // cache holds a GPS fix
+static BOOL _online; // socket is in online mode, AT commands need an escape first
+static GM862_MODE _mode; // current mode, for statistics
+static uint32_t _modeTime; // CoOS tick count at entering current mode
+static GM862_MODE_STATS_T _modeStats;
+static GM862_SEND_PATH _sendPath; // send path of the next socket
+static GM862_SEND_PATH _socketPath; // send path of the open socket
+static GM862_SEND_STATS_T _sendStats[GM862_SEND_PATH_COUNT];
 
 /* Implementation */
 
@@ -86,6 +102,10 @@ BOOL GM862_Init()
 	// Set timeout to default state
 	_timeout = UART_TIMEOUT_DEFAULT;
 
+	// Modem starts in command mode
+	_online = FALSE;
+	GM862_SetMode(GM862_MODE_COMMAND);
+
 	// UART1 pin configuration
 	pinConfig.Funcnum = PINSEL_FUNC_2;
 	pinConfig.OpenDrain = PINSEL_PINMODE_NORMAL;
@@ -326,10 +346,15 @@ int8_t GM862_GetGprs()
  */
 BOOL GM862_OpenSocket(const char *address, uint16_t port)
 {
-	// Construct AT command to dial socket
+	// Construct AT command to dial socket, as online or command mode connection
+	_socketPath = _sendPath;
 	GM862_SendAtFormat("AT#SD=%d,0,%d,\"", 1, port);
 	GM862_SendAt(address);
-	GM862_SendAt("\",0,0,0\r");
+	GM862_SendAtFormat("\",0,0,%d\r", _socketPath == GM862_SEND_PATH_COMMAND ? 1 : 0);
+
+	// Command mode connections stay in command mode
+	if (_socketPath == GM862_SEND_PATH_COMMAND)
+		return (GM862_GetResult() == GM862_RESULT_OK);
 
 	// GM862_SetTimeout(1000); // Temporary set timeout to 10 sec
 
@@ -341,11 +366,21 @@ BOOL GM862_OpenSocket(const char *address, uint16_t port)
 
 	// GM862_SetTimeout(UART_TIMEOUT_DEFAULT); // Reset timeout
 
+	_online = TRUE;
+	GM862_SetMode(GM862_MODE_ONLINE);
+
+	// Stay in transparent mode, the first packet doesn't need to restore the socket
+	if (GM862_ONLINE_PERSISTENT)
+		return TRUE;
+
 	// We are now in transparent mode, pulse DTR pin to re-enter command mode
+	GM862_SetMode(GM862_MODE_SWITCHING);
 	GPIO_SetValue(GM862_DTR_PORT, _BIT(GM862_DTR_PIN));
 	CoTimeDelay(0, 0, 0, 500); // TODO: tweak delay
 	GPIO_ClearValue(GM862_DTR_PORT, _BIT(GM862_DTR_PIN));
 	CoTimeDelay(0, 0, 0, 500);
+	_online = FALSE;
+	GM862_SetMode(GM862_MODE_COMMAND);
 
 	return (GM862_GetResult() == GM862_RESULT_OK);
 }
@@ -358,29 +393,183 @@ BOOL GM862_OpenSocket(const char *address, uint16_t port)
  */
 BOOL GM862_SendThroughSocket(uint8_t *packet, uint16_t packetLength)
 {
-	// Try to restore socket
-	GM862_SendAtFormat("AT#SO=%d\r", 1);
+	uint32_t startTime = (uint32_t)CoGetOSTime();
+	BOOL sent;
 
-	if (GM862_GetResult() != GM862_RESULT_CONNECT)
+	if (_socketPath == GM862_SEND_PATH_COMMAND)
+		sent = GM862_SendCommand(packet, packetLength);
+	else
+		sent = GM862_SendOnline(packet, packetLength);
+
+	if (!sent)
 		return FALSE;
 
+	// Update send time of the path
+	uint32_t sendTime = (uint32_t)CoGetOSTime() - startTime;
+
+	CoSchedLock();
+	_sendStats[_socketPath].packets++;
+	_sendStats[_socketPath].lastTime = sendTime;
+	if (sendTime > _sendStats[_socketPath].maxTime)
+		_sendStats[_socketPath].maxTime = sendTime;
+	_sendStats[_socketPath].totalTime += sendTime;
+	CoSchedUnlock();
+
+	return TRUE;
+}
+
+/*
+ * @brief		Select how packets are sent, takes effect with the next GM862_OpenSocket()
+ * @param[in]	path Send path, GM862_SEND_PATH_COMMAND needs modem firmware with command mode connections
+ * @return		None
+ */
+void GM862_SetSendPath(GM862_SEND_PATH path)
+{
+	_sendPath = path;
+}
+
+/*
+ * @brief		Get send path selected by GM862_SetSendPath()
+ * @return		Send path
+ */
+GM862_SEND_PATH GM862_GetSendPath()
+{
+	return _sendPath;
+}
+
+/*
+ * @brief		Get number and send time of packets sent through a send path
+ * @param[in]	path Send path
+ * @param[out]	stats Send statistics
+ * @return		None
+ */
+void GM862_GetSendStats(GM862_SEND_PATH path, GM862_SEND_STATS_T *stats)
+{
+	// Statistics are written by the task owning the modem, prevent a torn copy
+	CoSchedLock();
+	*stats = _sendStats[path];
+	CoSchedUnlock();
+}
+
+/*
+ * @brief		Send a packet through an online mode connection, restores the socket first if needed
+ * @return		TRUE if all data is successfully sent, FALSE if connection failed or timeout occurred
+ */
+BOOL GM862_SendOnline(uint8_t *packet, uint16_t packetLength)
+{
+	// Try to restore socket, unless it is still in online mode
+	if (!_online)
+	{
+		GM862_SetMode(GM862_MODE_SWITCHING);
+		GM862_SendAtFormat("AT#SO=%d\r", 1);
+
+		if (GM862_GetResult() != GM862_RESULT_CONNECT)
+		{
+			GM862_SetMode(GM862_MODE_COMMAND);
+			return FALSE;
+		}
+
+		_online = TRUE;
+		GM862_SetMode(GM862_MODE_ONLINE);
+	}
+
 	// We are now in transparent mode, send all bytes
 	while (packetLength--)
 	{
 		// If DCD pin goes high, socket is closed and we are back in command mode, stop sending
 		if (GPIO_ReadValue(GM862_DCD_PORT) & _BIT(GM862_DCD_PIN))
+		{
+			_online = FALSE;
+			GM862_SetMode(GM862_MODE_COMMAND);
 			return FALSE;
+		}
+
+		GM862_UART_SendByte(*packet++);
+	}
+
+	// Stay in online mode for the next packet, AT commands escape by themselves
+	if (!GM862_ONLINE_PERSISTENT)
+		GM862_EnterCommandMode();
+
+	return TRUE;
+}
+
+/*
+ * @brief		Send a packet through a command mode connection with #SSENDEXT, no mode switches are needed
+ * @return		TRUE if all data is successfully sent, FALSE if connection failed or timeout occurred
+ */
+BOOL GM862_SendCommand(uint8_t *packet, uint16_t packetLength)
+{
+	GM862_SendAtFormat("AT#SSENDEXT=%d,%u\r", 1, packetLength);
+
+	if (!GM862_WaitForPrompt())
+		return FALSE;
 
+	// Modem takes exactly packetLength bytes, no escaping needed
+	while (packetLength--)
 		GM862_UART_SendByte(*packet++);
+
+	return (GM862_GetResult() == GM862_RESULT_OK);
+}
+
+/*
+ * @brief		Wait for the data prompt ("> ") of a socket send command, which isn't terminated by \r
+ * @return		TRUE if the prompt is received, FALSE if timeout occurred
+ */
+BOOL GM862_WaitForPrompt()
+{
+	BOOL prompt = FALSE;
+
+	for (;;)
+	{
+		uint16_t recv = GM862_UART_ReceiveByte();
+		if (recv & UART_TIMEOUT_OCCURRED)
+		{
+			Debug_Send(DM_ERROR, "Timeout occurred.");
+			return FALSE;
+		}
+
+		// Take the space after '>' too, else it starts the line of the result code
+		if (prompt && recv == ' ')
+			return TRUE;
+
+		prompt = (recv == '>');
 	}
+}
+
+/*
+ * @brief		Leave online mode, the socket stays open and is restored by GM862_SendThroughSocket(). AT commands
+ * 				call this by themselves.
+ * @return		None
+ */
+void GM862_EnterCommandMode()
+{
+	if (!_online)
+		return;
 
 	// Pulse DTR pin to re-enter command mode (this can be tweaked for sure)
+	GM862_SetMode(GM862_MODE_SWITCHING);
 	GPIO_SetValue(GM862_DTR_PORT, _BIT(GM862_DTR_PIN));
 	CoTimeDelay(0, 0, 0, 250);
 	GPIO_ClearValue(GM862_DTR_PORT, _BIT(GM862_DTR_PIN));
 	CoTimeDelay(0, 0, 0, 250);
 
-	return TRUE;
+	_online = FALSE;
+	GM862_SetMode(GM862_MODE_COMMAND);
+}
+
+/*
+ * @brief		Get time spent in every mode, including the current one
+ * @param[out]	stats Mode statistics
+ * @return		None
+ */
+void GM862_GetModeStats(GM862_MODE_STATS_T *stats)
+{
+	// Statistics are written by the task owning the modem, prevent a torn copy
+	CoSchedLock();
+	*stats = _modeStats;
+	stats->time[_mode] += (uint32_t)CoGetOSTime() - _modeTime;
+	CoSchedUnlock();
 }
 
 /*
@@ -425,7 +614,8 @@ BOOL GM862_GpsGetPosition(GM862_GPS_DATA *gpsData)
 	GM862_SendAt("AT$GPSACP\r");
 
 	// Parse GPS data (example: "$GPSACP: 161514.000,5312.7499N,00547.9893E,31.6,70.8,2,258.70,0.82,0.44,070612,03")
-	int result = GM862_GetResponseFormat("$GPSACP: %*lf,%lf%c,%lf%c,%*lf,%*lf,%u,%*lf,%lf,%*lf,%*u,%u",
+	// Position widths are fixed (ddmm.mmmm, dddmm.mmmm), they keep the E of eastern longitudes out of the number
+	int result = GM862_GetResponseFormat("$GPSACP: %*lf,%9lf%c,%10lf%c,%*lf,%*lf,%u,%*lf,%lf,%*lf,%*u,%u",
 			&latitude, &latitudePos, &longitude, &longitudePos, &fix, &spkm, &nsat);
 
 	// This returns always OK with correct settings (GPS enabled)
@@ -443,7 +633,7 @@ BOOL GM862_GpsGetPosition(GM862_GPS_DATA *gpsData)
 
 	// Convert to 32 bit
 	gpsData->longitude = (uint32_t)(longitude * 10000);
-	if (longitudePos = 'E')
+	if (longitudePos == 'E')
 		gpsData->longitude |= _BIT(28);
 
 	gpsData->sog = (uint16_t)(spkm * 100);
@@ -453,6 +643,46 @@ BOOL GM862_GpsGetPosition(GM862_GPS_DATA *gpsData)
 	return TRUE;
 }
 
+/*
+ * @brief		Request GPS position and keep it for GM862_GpsGetCachedPosition(), call from the task owning the modem
+ * @return		TRUE if a new GPS fix is cached, FALSE if there is no GPS fix or on failure (cache is kept)
+ */
+BOOL GM862_GpsUpdateCache()
+{
+	GM862_GPS_DATA gpsData;
+
+	if (!GM862_GpsGetPosition(&gpsData))
+		return FALSE;
+
+	// Readers may run in other tasks, prevent a torn copy
+	CoSchedLock();
+	_gpsCache = gpsData;
+	_gpsCacheTime = (uint32_t)CoGetOSTime();
+	_gpsCacheValid = TRUE;
+	CoSchedUnlock();
+
+	return TRUE;
+}
+
+/*
+ * @brief		Get GPS position cached by GM862_GpsUpdateCache(), doesn't communicate with the modem
+ * @param[out]	gpsData Latest GPS fix
+ * @param[out]	fixTime CoOS tick count at latest GPS fix, age is CoGetOSTime() - fixTime
+ * @return		TRUE if a GPS fix is cached, else FALSE
+ */
+BOOL GM862_GpsGetCachedPosition(GM862_GPS_DATA *gpsData, uint32_t *fixTime)
+{
+	BOOL valid;
+
+	CoSchedLock();
+	*gpsData = _gpsCache;
+	*fixTime = _gpsCacheTime;
+	valid = _gpsCacheValid;
+	CoSchedUnlock();
+
+	return valid;
+}
+
 /*
  * @brief		Send AT command in specified format and arguments
  * @param[in]	format Format string, use printf() as reference
@@ -477,12 +707,15 @@ void GM862_SendAtFormat(const char *format, ...)
 }
 
 /*
- * @brief		Send AT command, clears response buffer to get rid of unsolicited messages
+ * @brief		Send AT command, leaves online mode first and clears response buffer to get rid of unsolicited messages
  * @param[in]	command AT command including \r
  * @return		None
  */
 void GM862_SendAt(const char *command)
 {
+	// AT commands are only accepted in command mode
+	GM862_EnterCommandMode();
+
 	// Destroy all unsolicited messages spat out by GM862
 	uint8_t recv;
 	while (GM862_UART_Receive(&recv, 1) == 1);
@@ -491,6 +724,24 @@ void GM862_SendAt(const char *command)
 		GM862_UART_SendByte(*command++);
 }
 
+/*
+ * @brief		Account the time spent in the current mode and enter another one
+ * @param[in]	mode New mode
+ * @return		None
+ */
+void GM862_SetMode(GM862_MODE mode)
+{
+	uint32_t now = (uint32_t)CoGetOSTime();
+
+	CoSchedLock();
+	_modeStats.time[_mode] += now - _modeTime;
+	if (mode == GM862_MODE_SWITCHING)
+		_modeStats.switches++;
+	_mode = mode;
+	_modeTime = now;
+	CoSchedUnlock();
+}
+
 /*
  * @brief		Get AT command result
  * @return		AT result, whereby GM862_RESULT_UNKNOWN if timeout occurred
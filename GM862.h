@@ -25,6 +25,9 @@
 #define UART_TIMEOUT_INFINITE	(0xFFFFFFFF)
 #define UART_TIMEOUT_DEFAULT	(300)
 
+// Keep the socket in online mode between packets, leave it only for AT commands (1 = enabled)
+#define GM862_ONLINE_PERSISTENT	1
+
 /* Enums */
 
 typedef enum {
@@ -36,6 +39,19 @@ typedef enum {
 	GM862_REPORT_REGISTERED_ROAMING				= 5
 } GM862_NETREG_REPORT;
 
+typedef enum {
+	GM862_MODE_COMMAND							= 0,	// AT commands are accepted
+	GM862_MODE_ONLINE							= 1,	// socket data is sent transparently
+	GM862_MODE_SWITCHING						= 2,	// restoring the socket or escaping with DTR
+	GM862_MODE_COUNT							= 3
+} GM862_MODE;
+
+typedef enum {
+	GM862_SEND_PATH_ONLINE						= 0,	// online mode connection, data sent transparently
+	GM862_SEND_PATH_COMMAND						= 1,	// command mode connection, data sent with #SSENDEXT
+	GM862_SEND_PATH_COUNT						= 2
+} GM862_SEND_PATH;
+
 /* Structs */
 
 typedef struct {
@@ -48,6 +64,24 @@ typedef struct {
 
 } GM862_GPS_DATA;
 
+// Time spent in every GM862_MODE (CoOS ticks)
+typedef struct {
+
+	uint32_t time[GM862_MODE_COUNT];
+	uint32_t switches;		// number of times the modem switched between command and online mode
+
+} GM862_MODE_STATS_T;
+
+// Packets sent successfully through a send path and their send time (CoOS ticks)
+typedef struct {
+
+	uint32_t packets;
+	uint32_t lastTime;
+	uint32_t maxTime;
+	uint64_t totalTime;
+
+} GM862_SEND_STATS_T;
+
 /* Prototypes */
 
 BOOL GM862_Init();
@@ -62,7 +96,14 @@ int8_t GM862_GetGprs();
 BOOL GM862_OpenSocket(const char *address, uint16_t port);
 BOOL GM862_SendThroughSocket(uint8_t *packet, uint16_t packetLength);
 BOOL GM862_CloseSocket();
+void GM862_EnterCommandMode();
+void GM862_GetModeStats(GM862_MODE_STATS_T *stats);
+void GM862_SetSendPath(GM862_SEND_PATH path);
+GM862_SEND_PATH GM862_GetSendPath();
+void GM862_GetSendStats(GM862_SEND_PATH path, GM862_SEND_STATS_T *stats);
 BOOL GM862_GetSocketStatus();
 BOOL GM862_GpsGetPosition(GM862_GPS_DATA *gpsData);
+BOOL GM862_GpsUpdateCache();
+BOOL GM862_GpsGetCachedPosition(GM862_GPS_DATA *gpsData, uint32_t *fixTime);
 
 #endif
@@ -0,0 +1,113 @@
+/* Name: CAN captures
+ * Description: Reading captures written by the CAN task (CANDATA.CAN, see CAN_CAPTURE_RECORD_T) and making
+ * captures of synthetic sensor bus traffic, for host tools and tests
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CanCapture.h"
+#include "SyntheticTraffic.h"
+
+/* Implementation */
+
+/*
+ * @brief		Read a capture
+ * @param[in]	fileName Capture file
+ * @param[out]	count Number of records
+ * @return		Records (free() when done), NULL if the capture can't be read
+ */
+CAN_CAPTURE_RECORD_T *CanCapture_Read(const char *fileName, uint32_t *count)
+{
+	CAN_CAPTURE_RECORD_T *records;
+	long size;
+	FILE *file;
+
+	file = fopen(fileName, "rb");
+	if (file == NULL)
+	{
+		perror(fileName);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	rewind(file);
+
+	// A capture cut off by a reset ends in a partial record, it is ignored
+	*count = size / sizeof(CAN_CAPTURE_RECORD_T);
+	records = malloc(*count * sizeof(CAN_CAPTURE_RECORD_T) + 1);
+	if (records == NULL || fread(records, sizeof(CAN_CAPTURE_RECORD_T), *count, file) != *count)
+	{
+		fprintf(stderr, "%s: read failed\n", fileName);
+		free(records);
+		records = NULL;
+	}
+
+	fclose(file);
+	return records;
+}
+
+/*
+ * @brief		Frame of a capture record, as received by the CAN task
+ * @param[in]	record Capture record, not a sync marker
+ * @param[out]	msg Frame
+ * @param[out]	controller Controller that received the frame
+ * @return		None
+ */
+void CanCapture_MakeMessage(const CAN_CAPTURE_RECORD_T *record, CAN_MSG_Type *msg, uint8_t *controller)
+{
+	msg->id = record->id;
+	msg->len = record->flags & CAN_CAPTURE_FLAG_LEN_MASK;
+	msg->format = record->flags & CAN_CAPTURE_FLAG_EXT ? EXT_ID_FORMAT : STD_ID_FORMAT;
+	msg->type = record->flags & CAN_CAPTURE_FLAG_REMOTE ? REMOTE_FRAME : DATA_FRAME;
+	memcpy(msg->dataA, record->data, 4);
+	memcpy(msg->dataB, record->data + 4, 4);
+
+	*controller = record->flags & CAN_CAPTURE_FLAG_CAN1 ? CAN1_CTRL : CAN2_CTRL;
+}
+
+/*
+ * @brief		Capture record of the n-th frame of the synthetic traffic, received by CAN2
+ * 				CAN_CAPTURE_SYNTHETIC_INTERVAL after the previous one
+ * @param[in]	n Frame number
+ * @param[out]	record Capture record
+ * @return		None
+ */
+void CanCapture_MakeSyntheticRecord(uint32_t n, CAN_CAPTURE_RECORD_T *record)
+{
+	CAN_MSG_Type msg;
+
+	SyntheticTraffic_MakeFrame(n, &msg);
+
+	record->timestamp = (n + 1) * CAN_CAPTURE_SYNTHETIC_INTERVAL;
+	record->id = msg.id;
+	record->flags = (msg.len & CAN_CAPTURE_FLAG_LEN_MASK) | (msg.format == EXT_ID_FORMAT ? CAN_CAPTURE_FLAG_EXT : 0);
+	memcpy(record->data, msg.dataA, 4);
+	memcpy(record->data + 4, msg.dataB, 4);
+}
+
+/*
+ * @brief		Synthetic capture in memory, without the sync marker of a capture file
+ * @param[in]	seconds Length of the capture
+ * @param[out]	count Number of records
+ * @return		Records (free() when done), NULL if out of memory
+ */
+CAN_CAPTURE_RECORD_T *CanCapture_MakeSynthetic(uint32_t seconds, uint32_t *count)
+{
+	CAN_CAPTURE_RECORD_T *records;
+	uint32_t i;
+
+	*count = seconds * (1000000 / CAN_CAPTURE_SYNTHETIC_INTERVAL);
+	records = malloc(*count * sizeof(CAN_CAPTURE_RECORD_T) + 1);
+	if (records == NULL)
+		return NULL;
+
+	for (i = 0; i < *count; i++)
+		CanCapture_MakeSyntheticRecord(i, &records[i]);
+
+	return records;
+}
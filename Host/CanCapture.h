@@ -0,0 +1,25 @@
+/* Name: CAN captures
+ * Description: Reading captures written by the CAN task (CANDATA.CAN, see CAN_CAPTURE_RECORD_T) and making
+ * captures of synthetic sensor bus traffic, for host tools and tests
+ */
+
+#ifndef CAN_CAPTURE_H
+#define CAN_CAPTURE_H
+
+/* Includes */
+
+#include "CanTask.h"
+
+/* Defines */
+
+// Time between the frames of synthetic captures (microseconds)
+#define CAN_CAPTURE_SYNTHETIC_INTERVAL			500
+
+/* Prototypes */
+
+CAN_CAPTURE_RECORD_T *CanCapture_Read(const char *fileName, uint32_t *count);
+void CanCapture_MakeMessage(const CAN_CAPTURE_RECORD_T *record, CAN_MSG_Type *msg, uint8_t *controller);
+void CanCapture_MakeSyntheticRecord(uint32_t n, CAN_CAPTURE_RECORD_T *record);
+CAN_CAPTURE_RECORD_T *CanCapture_MakeSynthetic(uint32_t seconds, uint32_t *count);
+
+#endif
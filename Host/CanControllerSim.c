@@ -0,0 +1,129 @@
+/* Name: CAN controller simulation
+ * Description: Receive side of the two CAN controllers and the FullCAN message objects for host programs that run the
+ * CAN task's interrupt handler. Frames are put in by the thread that plays the interrupt hardware, which then runs
+ * the handler.
+ */
+
+/* Includes */
+
+#include "CanControllerSim.h"
+
+/* Structs */
+
+typedef struct {
+
+	CAN_MSG_Type frames[CAN_CONTROLLER_SIM_DEPTH];
+	uint8_t head;
+	uint8_t count;
+	BOOL overrun;			// data overrun not yet cleared by the handler
+	uint32_t overruns;		// frames lost to overruns
+
+} CAN_CONTROLLER_SIM_T;
+
+// FullCAN message object, keeps the latest frame of its identifier
+typedef struct {
+
+	CAN_MSG_Type msg;
+	BOOL updated;			// semaphore bits set, not yet read
+
+} CAN_FULLCAN_SIM_T;
+
+/* Variables */
+
+static CAN_CONTROLLER_SIM_T _controllers[2];
+static CAN_FULLCAN_SIM_T _fullCanObjects[CAN_CONTROLLER_SIM_FULLCAN];
+
+/* Implementation */
+
+static CAN_CONTROLLER_SIM_T *CanControllerSim_Get(LPC_CAN_TypeDef *CANx)
+{
+	return &_controllers[CANx == LPC_CAN1 ? CAN1_CTRL : CAN2_CTRL];
+}
+
+/*
+ * @brief		Frame received from the bus
+ * @param[in]	controller CAN1_CTRL or CAN2_CTRL
+ * @param[in]	msg Frame
+ * @return		TRUE if the controller took the frame, FALSE if it overran
+ */
+BOOL CanControllerSim_Receive(uint8_t controller, const CAN_MSG_Type *msg)
+{
+	CAN_CONTROLLER_SIM_T *sim = &_controllers[controller];
+
+	if (sim->count == CAN_CONTROLLER_SIM_DEPTH)
+	{
+		sim->overrun = TRUE;
+		sim->overruns++;
+		return FALSE;
+	}
+
+	sim->frames[(sim->head + sim->count++) % CAN_CONTROLLER_SIM_DEPTH] = *msg;
+	return TRUE;
+}
+
+/*
+ * @brief		Frame received from the bus into a FullCAN message object, overwrites a frame that wasn't read
+ * @param[in]	index Message object
+ * @param[in]	msg Frame
+ * @return		None
+ */
+void CanControllerSim_ReceiveFullCan(uint8_t index, const CAN_MSG_Type *msg)
+{
+	_fullCanObjects[index].msg = *msg;
+	_fullCanObjects[index].updated = TRUE;
+}
+
+uint32_t CanControllerSim_GetOverruns(uint8_t controller)
+{
+	return _controllers[controller].overruns;
+}
+
+Status __wrap_CAN_ReceiveMsg(LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg)
+{
+	CAN_CONTROLLER_SIM_T *sim = CanControllerSim_Get(CANx);
+
+	if (sim->count == 0)
+		return ERROR;
+
+	*CAN_Msg = sim->frames[sim->head];
+	sim->head = (sim->head + 1) % CAN_CONTROLLER_SIM_DEPTH;
+	sim->count--;
+
+	return SUCCESS;
+}
+
+uint32_t __wrap_CAN_IntGetStatus(LPC_CAN_TypeDef *CANx)
+{
+	CAN_CONTROLLER_SIM_T *sim = CanControllerSim_Get(CANx);
+
+	return (sim->count != 0 ? CAN_ICR_RI : 0) | (sim->overrun ? CAN_ICR_DOI : 0);
+}
+
+uint32_t __wrap_CAN_GetCTRLStatus(LPC_CAN_TypeDef *CANx, CAN_CTRL_STS_Type arg)
+{
+	// Error free bus
+	return 0;
+}
+
+void __wrap_CAN_SetCommand(LPC_CAN_TypeDef *CANx, uint32_t CMRType)
+{
+	if (CMRType & CAN_CMR_CDO)
+		CanControllerSim_Get(CANx)->overrun = FALSE;
+}
+
+void __wrap_CAN_ModeConfig(LPC_CAN_TypeDef *CANx, CAN_MODE_Type mode, FunctionalState NewState)
+{
+}
+
+CAN_ERROR __wrap_FCAN_ReadObjByIndex(LPC_CANAF_TypeDef *CANAFx, uint8_t index, CAN_MSG_Type *CAN_Msg)
+{
+	CAN_FULLCAN_SIM_T *object = &_fullCanObjects[index];
+
+	if (!object->updated)
+		return CAN_FULL_OBJ_NOT_RCV;
+
+	*CAN_Msg = object->msg;
+	object->updated = FALSE;
+
+	return CAN_OK;
+}
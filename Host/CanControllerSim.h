@@ -0,0 +1,30 @@
+/* Name: CAN controller simulation
+ * Description: Receive side of the two CAN controllers and the FullCAN message objects for host programs that run the
+ * CAN task's interrupt handler. Programs are linked with --wrap for the peripheral library functions the handler uses
+ * (see Makefile).
+ */
+
+#ifndef CAN_CONTROLLER_SIM_H
+#define CAN_CONTROLLER_SIM_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <lpc17xx_can.h>
+#include <CoOs.h>
+
+/* Defines */
+
+// Frames a controller holds until they are read, more frames overrun it
+#define CAN_CONTROLLER_SIM_DEPTH				3
+
+// FullCAN message objects of the acceptance filter
+#define CAN_CONTROLLER_SIM_FULLCAN				16
+
+/* Prototypes */
+
+BOOL CanControllerSim_Receive(uint8_t controller, const CAN_MSG_Type *msg);
+void CanControllerSim_ReceiveFullCan(uint8_t index, const CAN_MSG_Type *msg);
+uint32_t CanControllerSim_GetOverruns(uint8_t controller);
+
+#endif
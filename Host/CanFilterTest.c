@@ -0,0 +1,380 @@
+/* Name: CAN acceptance filter builder test
+ * Description: Unit tests of CanFilter_Build() for sorting, range grouping, padding and overflow, and of the
+ * sensor identifier list loaded through the real CAN_SetupAFLUT() into a simulated look-up table
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "CanFilter.h"
+#include "SensorDataManager.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Look-up table entry fields (UM10360 chapter 16)
+#define LUT_STD_CONTROLLER(e)					(((e) >> 13) & 0x7)
+#define LUT_STD_DISABLE(e)						(((e) >> 12) & 0x1)
+#define LUT_STD_ID(e)							((e) & 0x7FF)
+#define LUT_EXT_CONTROLLER(e)					((e) >> 29)
+#define LUT_EXT_ID(e)							((e) & 0x1FFFFFFF)
+
+/* Variables */
+
+// The peripheral library keeps addresses in uint32_t, tables passed to it must be static (see Makefile)
+static CAN_FILTER_TABLES_T _tables;
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("CanFilterTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+static void TestSorting()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x402),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x302),
+		CAN_FILTER_STD_ID(CAN1_CTRL, 0x050),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x100)
+	};
+
+	CHECK(CanFilter_Build(entries, 4, &_tables) == CAN_OK);
+	CHECK(_tables.section.SFF_NumEntry == 4);
+	CHECK(_tables.sff[0].controller == CAN1_CTRL && _tables.sff[0].id_11 == 0x050);
+	CHECK(_tables.sff[1].controller == CAN2_CTRL && _tables.sff[1].id_11 == 0x100);
+	CHECK(_tables.sff[2].controller == CAN2_CTRL && _tables.sff[2].id_11 == 0x302);
+	CHECK(_tables.sff[3].controller == CAN2_CTRL && _tables.sff[3].id_11 == 0x402);
+	CHECK(_tables.section.SFF_GPR_Sec == NULL && _tables.section.FullCAN_Sec == NULL);
+}
+
+static void TestPaddingAndDuplicates()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x302),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x402),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x302),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x500)
+	};
+
+	// Duplicate 0x302 is dropped, three identifiers are padded to a pair
+	CHECK(CanFilter_Build(entries, 4, &_tables) == CAN_OK);
+	CHECK(_tables.section.SFF_NumEntry == 4);
+	CHECK(_tables.sff[0].id_11 == 0x302 && _tables.sff[1].id_11 == 0x402 && _tables.sff[2].id_11 == 0x500);
+	CHECK(_tables.sff[0].disable == MSG_ENABLE && _tables.sff[2].disable == MSG_ENABLE);
+	CHECK(_tables.sff[3].id_11 == 0x500 && _tables.sff[3].disable == MSG_DISABLE);
+}
+
+static void TestGrouping()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x185, 0x188),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x18B),
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x189, 0x18A),	// adjacent on both sides
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x285, 0x288),
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x280, 0x286),	// overlapping
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x301),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x302),			// adjacent single identifiers
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x400)
+	};
+
+	CHECK(CanFilter_Build(entries, 8, &_tables) == CAN_OK);
+	CHECK(_tables.section.SFF_GPR_NumEntry == 3);
+	CHECK(_tables.sffGroup[0].lowerID == 0x185 && _tables.sffGroup[0].upperID == 0x18B);
+	CHECK(_tables.sffGroup[1].lowerID == 0x280 && _tables.sffGroup[1].upperID == 0x288);
+	CHECK(_tables.sffGroup[2].lowerID == 0x301 && _tables.sffGroup[2].upperID == 0x302);
+	CHECK(_tables.sffGroup[0].controller1 == CAN2_CTRL && _tables.sffGroup[0].controller2 == CAN2_CTRL);
+
+	// The remaining single identifier is padded to a pair
+	CHECK(_tables.section.SFF_NumEntry == 2);
+	CHECK(_tables.sff[0].id_11 == 0x400 && _tables.sff[1].disable == MSG_DISABLE);
+}
+
+static void TestControllersNotMerged()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x200, 0x2FF),
+		CAN_FILTER_STD_RANGE(CAN1_CTRL, 0x100, 0x1FF),
+		CAN_FILTER_EXT_RANGE(CAN1_CTRL, 0x1000, 0x1FFF),
+		CAN_FILTER_EXT_ID(CAN2_CTRL, 0x2000)
+	};
+
+	CHECK(CanFilter_Build(entries, 4, &_tables) == CAN_OK);
+	CHECK(_tables.section.SFF_GPR_NumEntry == 2);
+	CHECK(_tables.sffGroup[0].controller1 == CAN1_CTRL && _tables.sffGroup[0].upperID == 0x1FF);
+	CHECK(_tables.sffGroup[1].controller1 == CAN2_CTRL && _tables.sffGroup[1].lowerID == 0x200);
+	CHECK(_tables.section.EFF_GPR_NumEntry == 1 && _tables.effGroup[0].upperEID == 0x1FFF);
+	CHECK(_tables.section.EFF_NumEntry == 1 && _tables.eff[0].ID_29 == 0x2000);
+}
+
+static void TestInterleavedControllers()
+{
+	// Sorted by controller the identifiers go down, which the driver rejects
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_STD_ID(CAN1_CTRL, 0x300),
+		CAN_FILTER_STD_ID(CAN2_CTRL, 0x100)
+	};
+	static const CAN_FILTER_ENTRY_T ranges[] = {
+		CAN_FILTER_STD_RANGE(CAN1_CTRL, 0x000, 0x7FF),
+		CAN_FILTER_STD_RANGE(CAN2_CTRL, 0x300, 0x301)
+	};
+
+	CHECK(CanFilter_Build(entries, 2, &_tables) == CAN_AF_ENTRY_ERROR);
+	CHECK(CanFilter_Build(ranges, 2, &_tables) == CAN_AF_ENTRY_ERROR);
+}
+
+static void TestPgn()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_PGN_ID(CAN2_CTRL, 0x18FD)
+	};
+	uint8_t i;
+
+	// One group per priority and data page prefix, covering every source address
+	CHECK(CanFilter_Build(entries, 1, &_tables) == CAN_OK);
+	CHECK(_tables.section.EFF_GPR_NumEntry == CAN_FILTER_PGN_PREFIXES);
+	for (i = 0; i < _tables.section.EFF_GPR_NumEntry; i++)
+	{
+		CHECK(_tables.effGroup[i].lowerEID == (((uint32_t)i << 24) | 0x18FD00));
+		CHECK(_tables.effGroup[i].upperEID == (((uint32_t)i << 24) | 0x18FDFF));
+	}
+}
+
+static void TestFullCan()
+{
+	static const CAN_FILTER_ENTRY_T entries[] = {
+		CAN_FILTER_FULLCAN_ID(CAN2_CTRL, 0x288),
+		CAN_FILTER_FULLCAN_ID(CAN2_CTRL, 0x185),
+		CAN_FILTER_FULLCAN_ID(CAN2_CTRL, 0x186),
+		CAN_FILTER_FULLCAN_ID(CAN2_CTRL, 0x185)
+	};
+
+	// Sorted, duplicate dropped and padded to a pair
+	CHECK(CanFilter_Build(entries, 4, &_tables) == CAN_OK);
+	CHECK(_tables.section.FC_NumEntry == 4);
+	CHECK(_tables.fullCan[0].id_11 == 0x185 && _tables.fullCan[1].id_11 == 0x186);
+	CHECK(_tables.fullCan[2].id_11 == 0x288 && _tables.fullCan[2].disable == MSG_ENABLE);
+	CHECK(_tables.fullCan[3].disable == MSG_DISABLE);
+}
+
+static void TestErrors()
+{
+	CAN_FILTER_ENTRY_T entries[CAN_FILTER_MAX_SFF + 1];
+	uint8_t i;
+
+	// Identifiers two apart can't be merged
+	for (i = 0; i <= CAN_FILTER_MAX_SFF; i++)
+	{
+		entries[i].type = CAN_FILTER_STD;
+		entries[i].controller = CAN2_CTRL;
+		entries[i].lowerId = entries[i].upperId = 0x100 + 2 * i;
+	}
+	CHECK(CanFilter_Build(entries, CAN_FILTER_MAX_SFF, &_tables) == CAN_OK);
+	CHECK(CanFilter_Build(entries, CAN_FILTER_MAX_SFF + 1, &_tables) == CAN_OBJECTS_FULL_ERROR);
+
+	// Two PGNs need more extended groups than there are
+	entries[0].type = entries[1].type = CAN_FILTER_PGN;
+	entries[1].lowerId = entries[1].upperId = 0x102;
+	CHECK(CanFilter_Build(entries, 2, &_tables) == CAN_OBJECTS_FULL_ERROR);
+
+	entries[0].type = 7;
+	CHECK(CanFilter_Build(entries, 1, &_tables) == CAN_AF_ENTRY_ERROR);
+}
+
+/*
+ * @brief		Check if the look-up table in the simulated acceptance filter RAM accepts a frame, the way the
+ * 				hardware reads it
+ */
+static BOOL LutAccepts(uint8_t controller, BOOL extended, uint32_t id)
+{
+	uint32_t i, entry;
+
+	if (!extended)
+	{
+		// FullCAN and explicit entries are two per word, the first one in the upper half
+		for (i = 0; i < LPC_CANAF->SFF_GRP_sa / 2; i++)
+		{
+			entry = i & 1 ? Host_CanAfRam.mask[i / 2] & 0xFFFF : Host_CanAfRam.mask[i / 2] >> 16;
+			if (LUT_STD_CONTROLLER(entry) == controller && !LUT_STD_DISABLE(entry) && LUT_STD_ID(entry) == id)
+				return TRUE;
+		}
+
+		for (i = LPC_CANAF->SFF_GRP_sa / 4; i < LPC_CANAF->EFF_sa / 4; i++)
+		{
+			entry = Host_CanAfRam.mask[i];
+			if (LUT_STD_CONTROLLER(entry >> 16) == controller && !LUT_STD_DISABLE(entry >> 16) &&
+					LUT_STD_ID(entry >> 16) <= id && id <= LUT_STD_ID(entry))
+				return TRUE;
+		}
+	}
+	else
+	{
+		for (i = LPC_CANAF->EFF_sa / 4; i < LPC_CANAF->EFF_GRP_sa / 4; i++)
+		{
+			entry = Host_CanAfRam.mask[i];
+			if (LUT_EXT_CONTROLLER(entry) == controller && LUT_EXT_ID(entry) == id)
+				return TRUE;
+		}
+
+		for (i = LPC_CANAF->EFF_GRP_sa / 4; i < LPC_CANAF->ENDofTable / 4; i += 2)
+		{
+			entry = Host_CanAfRam.mask[i];
+			if (LUT_EXT_CONTROLLER(entry) == controller && LUT_EXT_ID(entry) <= id &&
+					id <= LUT_EXT_ID(Host_CanAfRam.mask[i + 1]))
+				return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * @brief		Check if an entry of the declarative list accepts a frame
+ */
+static BOOL ListAccepts(const CAN_FILTER_ENTRY_T *entries, uint8_t count, uint8_t controller, BOOL extended,
+		uint32_t id)
+{
+	uint8_t i;
+
+	for (i = 0; i < count; i++)
+	{
+		if (entries[i].controller != controller)
+			continue;
+
+		switch (entries[i].type)
+		{
+			case CAN_FILTER_STD:
+			case CAN_FILTER_FULLCAN:
+			case CAN_FILTER_EXT:
+				if (extended == (entries[i].type == CAN_FILTER_EXT) && entries[i].lowerId <= id &&
+						id <= (entries[i].type == CAN_FILTER_FULLCAN ? entries[i].lowerId : entries[i].upperId))
+					return TRUE;
+				break;
+
+			case CAN_FILTER_PGN:
+				if (extended && ((id >> 8) & 0xFFFF) == entries[i].lowerId)
+					return TRUE;
+				break;
+		}
+	}
+
+	return FALSE;
+}
+
+/*
+ * @brief		Every section of the look-up table must be sorted by controller and identifier for the hardware's
+ * 				binary search
+ */
+static BOOL LutSorted()
+{
+	uint32_t i, previous = 0, entry;
+
+	for (i = 0; i < LPC_CANAF->SFF_sa / 2; i++, previous = entry)
+	{
+		entry = i & 1 ? Host_CanAfRam.mask[i / 2] & 0xE7FF : (Host_CanAfRam.mask[i / 2] >> 16) & 0xE7FF;
+		if (i > 0 && entry < previous)
+			return FALSE;
+	}
+
+	for (i = LPC_CANAF->SFF_sa / 2; i < LPC_CANAF->SFF_GRP_sa / 2; i++, previous = entry)
+	{
+		entry = i & 1 ? Host_CanAfRam.mask[i / 2] & 0xE7FF : (Host_CanAfRam.mask[i / 2] >> 16) & 0xE7FF;
+		if (i > LPC_CANAF->SFF_sa / 2 && entry < previous)
+			return FALSE;
+	}
+
+	for (i = LPC_CANAF->SFF_GRP_sa / 4; i < LPC_CANAF->EFF_sa / 4; i++, previous = entry)
+	{
+		entry = Host_CanAfRam.mask[i] & 0xE7FFE7FF;
+		if ((entry >> 16) > (entry & 0xFFFF) || (i > LPC_CANAF->SFF_GRP_sa / 4 && (entry >> 16) < (previous & 0xFFFF)))
+			return FALSE;
+	}
+
+	for (i = LPC_CANAF->EFF_sa / 4; i < LPC_CANAF->ENDofTable / 4; i++, previous = entry)
+	{
+		entry = Host_CanAfRam.mask[i];
+		if (i > LPC_CANAF->EFF_sa / 4 && i != LPC_CANAF->EFF_GRP_sa / 4 && entry < previous)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void TestSensorFilter()
+{
+	const CAN_FILTER_ENTRY_T *entries;
+	uint8_t count, controller, i;
+	uint32_t id, mismatches = 0;
+
+	entries = SensorDataManager_GetCanFilter(&count);
+	CHECK(CanFilter_Build(entries, count, &_tables) == CAN_OK);
+
+	// Loaded twice, the driver's entry counters must start over every time
+	CHECK(CanFilter_Apply(&_tables) == CAN_OK);
+	CHECK(CanFilter_Apply(&_tables) == CAN_OK);
+	CHECK(LPC_CANAF->SFF_sa == (_tables.section.FC_NumEntry + 1) / 2 * 4);
+	CHECK(LPC_CANAF->ENDofTable <= sizeof(Host_CanAfRam.mask));
+	CHECK(LutSorted());
+
+	// Every standard identifier on both controllers
+	for (controller = CAN1_CTRL; controller <= CAN2_CTRL; controller++)
+		for (id = 0; id <= 0x7FF; id++)
+			if (LutAccepts(controller, FALSE, id) != ListAccepts(entries, count, controller, FALSE, id))
+				mismatches++;
+
+	// Extended identifiers around every entry and a spread of others
+	for (controller = CAN1_CTRL; controller <= CAN2_CTRL; controller++)
+	{
+		for (i = 0; i < count; i++)
+		{
+			uint32_t base = entries[i].type == CAN_FILTER_PGN ? entries[i].lowerId << 8 : entries[i].lowerId;
+			uint32_t prefix;
+
+			for (prefix = 0; prefix < 0x20; prefix += 7)
+				for (id = base - 2; id != base + 0x102; id++)
+					if (LutAccepts(controller, TRUE, (prefix << 24 | id) & 0x1FFFFFFF) !=
+							ListAccepts(entries, count, controller, TRUE, (prefix << 24 | id) & 0x1FFFFFFF))
+						mismatches++;
+		}
+
+		for (id = 0; id <= 0x1FFFFFFF - 0x10001; id += 0x10001)
+			if (LutAccepts(controller, TRUE, id) != ListAccepts(entries, count, controller, TRUE, id))
+				mismatches++;
+	}
+
+	CHECK(mismatches == 0);
+}
+
+int main()
+{
+	TestSorting();
+	TestPaddingAndDuplicates();
+	TestGrouping();
+	TestControllersNotMerged();
+	TestInterleavedControllers();
+	TestPgn();
+	TestFullCan();
+	TestErrors();
+	TestSensorFilter();
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,197 @@
+/* Name: CAN capture replay
+ * Description: Replays a capture written by the CAN task (CANDATA.CAN, see CAN_CAPTURE_RECORD_T) into
+ * SensorDataManager_PutCanData() and packs tables in between like the telemetry task, as fast as possible or at a
+ * multiple of real time. Reports the decode and pack cost and the packet sizes. Also writes synthetic captures.
+ *
+ *   CanReplay <capture> [speed]            replay, speed 0 (default) is as fast as possible
+ *   CanReplay -s <capture> [seconds]       write a capture of synthetic sensor bus traffic
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "CanCapture.h"
+#include "Compression.h"
+#include "SensorDataManager.h"
+#include "HostStubs.h"
+
+/* Defines */
+
+// Packets are packed at the interval of the telemetry task (TELEMETRY_INTERVAL) into tables of its size
+// (TELEMETRY_TABLES_SIZE), see TelemetryTask.c
+#define REPLAY_PACKET_INTERVAL					(3 * CFG_SYSTICK_FREQ / 2)
+#define REPLAY_TABLES_SIZE						243
+
+// Microseconds per OS tick
+#define REPLAY_TICK_US							(1000000 / CFG_SYSTICK_FREQ)
+
+// Pacing sleeps only when the replay is at least this far ahead of the capture (nanoseconds)
+#define REPLAY_SLEEP_THRESHOLD					1000000
+
+// Default length of synthetic captures (seconds)
+#define SYNTHETIC_CAPTURE_SECONDS				60
+
+/* Implementation */
+
+static int WriteSyntheticCapture(const char *fileName, uint32_t seconds)
+{
+	CAN_CAPTURE_RECORD_T record;
+	uint32_t frames = seconds * (1000000 / CAN_CAPTURE_SYNTHETIC_INTERVAL);
+	uint32_t unixTime = (uint32_t)time(NULL);
+	uint32_t n;
+	FILE *file;
+
+	file = fopen(fileName, "wb");
+	if (file == NULL)
+	{
+		perror(fileName);
+		return 1;
+	}
+
+	// Capture starts with a sync marker, like CanTask_CaptureSync()
+	memset(&record, 0, sizeof(record));
+	record.flags = CAN_CAPTURE_FLAG_SYNC;
+	memcpy(record.data, &unixTime, sizeof(unixTime));
+	fwrite(&record, sizeof(record), 1, file);
+
+	for (n = 0; n < frames; n++)
+	{
+		CanCapture_MakeSyntheticRecord(n, &record);
+		fwrite(&record, sizeof(record), 1, file);
+	}
+
+	if (fclose(file) != 0)
+	{
+		perror(fileName);
+		return 1;
+	}
+
+	printf("Wrote %u frames (%u s) to %s\n", frames, seconds, fileName);
+	return 0;
+}
+
+static void SleepUntil(uint64_t nanoseconds)
+{
+	struct timespec time;
+
+	time.tv_sec = nanoseconds / 1000000000ULL;
+	time.tv_nsec = nanoseconds % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &time, NULL) != 0);
+}
+
+static int Replay(const char *fileName, double speed)
+{
+	uint8_t tableBuffer[REPLAY_TABLES_SIZE], compressBuffer[REPLAY_TABLES_SIZE];
+	uint64_t decodeTime = 0, packTime = 0, tableBytes = 0, compressedBytes = 0, alarmBytes = 0;
+	uint64_t captureTime = 0, replayStart, now, due, maxLag = 0, start;
+	uint32_t count, i, frames = 0, syncs = 0, packets = 0, osTicks = 0, nextPacket = REPLAY_PACKET_INTERVAL;
+	uint32_t previousTimestamp = 0;
+	uint16_t tablesSize, compressedSize;
+	CAN_CAPTURE_RECORD_T *records;
+	CAN_MSG_Type msg;
+	uint8_t controller;
+
+	records = CanCapture_Read(fileName, &count);
+	if (records == NULL)
+		return 1;
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	replayStart = Host_GetNanoseconds();
+	for (i = 0; i < count; i++)
+	{
+		// Capture time is kept in 64 bit, the 32 bit timestamps wrap every 71 minutes
+		if (i > 0)
+			captureTime += (uint32_t)(records[i].timestamp - previousTimestamp);
+		previousTimestamp = records[i].timestamp;
+
+		if (records[i].flags & CAN_CAPTURE_FLAG_SYNC)
+		{
+			syncs++;
+			continue;
+		}
+
+		// Keep the pace, sleeping only when far enough ahead
+		if (speed > 0)
+		{
+			due = replayStart + (uint64_t)(captureTime * 1000 / speed);
+			now = Host_GetNanoseconds();
+			if (due > now + REPLAY_SLEEP_THRESHOLD)
+				SleepUntil(due);
+			else if (now > due && now - due > maxLag)
+				maxLag = now - due;
+		}
+
+		// OS time follows the capture, so the byte budget and table ages behave as on the boat
+		if (captureTime / REPLAY_TICK_US > osTicks)
+		{
+			Host_AdvanceOSTime(captureTime / REPLAY_TICK_US - osTicks);
+			osTicks = captureTime / REPLAY_TICK_US;
+		}
+
+		// Pack tables at the telemetry interval, every packet is acknowledged
+		if (osTicks >= nextPacket)
+		{
+			start = Host_GetNanoseconds();
+			tablesSize = SensorDataManager_GetTables(tableBuffer, sizeof(tableBuffer));
+			compressedSize = tablesSize ? Compression_Compress(tableBuffer, tablesSize, compressBuffer, tablesSize - 1) : 0;
+			SensorDataManager_AcknowledgeTables(TRUE);
+			alarmBytes += SensorDataManager_GetAlarms(tableBuffer, sizeof(tableBuffer));
+			SensorDataManager_AcknowledgeAlarms(TRUE);
+			packTime += Host_GetNanoseconds() - start;
+
+			tableBytes += tablesSize;
+			compressedBytes += compressedSize ? compressedSize : tablesSize;
+			packets++;
+			nextPacket = osTicks + REPLAY_PACKET_INTERVAL;
+		}
+
+		CanCapture_MakeMessage(&records[i], &msg, &controller);
+
+		start = Host_GetNanoseconds();
+		SensorDataManager_PutCanData(&msg, controller, records[i].timestamp);
+		decodeTime += Host_GetNanoseconds() - start;
+		frames++;
+	}
+	now = Host_GetNanoseconds();
+
+	free(records);
+
+	printf("Frames: %u, sync markers: %u, packets: %u\n", frames, syncs, packets);
+	printf("Capture: %.3f s, replay: %.3f s (%.1fx real time", captureTime / 1e6, (now - replayStart) / 1e9,
+			captureTime * 1e3 / (now - replayStart));
+	if (speed > 0)
+		printf(", target %gx, max lag %.3f ms", speed, maxLag / 1e6);
+	printf(")\n");
+	if (frames > 0)
+		printf("Decode: %.1f ns/frame\n", (double)decodeTime / frames);
+	if (packets > 0)
+	{
+		printf("Pack: %.1f ns/packet, %.1f bytes/packet, %.1f compressed, %.1f alarm bytes/packet\n",
+				(double)packTime / packets, (double)tableBytes / packets, (double)compressedBytes / packets,
+				(double)alarmBytes / packets);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc >= 3 && strcmp(argv[1], "-s") == 0)
+		return WriteSyntheticCapture(argv[2], argc > 3 ? strtoul(argv[3], NULL, 0) : SYNTHETIC_CAPTURE_SECONDS);
+
+	if (argc >= 2 && argv[1][0] != '-')
+		return Replay(argv[1], argc > 2 ? strtod(argv[2], NULL) : 0);
+
+	fprintf(stderr, "Usage: %s <capture> [speed, 0 = as fast as possible]\n"
+			"       %s -s <capture> [seconds]   write a synthetic capture\n", argv[0], argv[0]);
+	return 1;
+}
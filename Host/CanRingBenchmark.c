@@ -0,0 +1,154 @@
+/* Name: CAN RX ring benchmark
+ * Description: Frames per second through the CAN interrupt handler, the ring buffers and the CAN task's receive
+ * path, with the handler and the task in one thread and in two threads
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The ring buffers and the receive path are private to the CAN task
+#include "CanTask.c"
+
+#include "CanControllerSim.h"
+#include "HostStubs.h"
+
+/* Defines */
+
+#define BENCHMARK_FRAMES						4000000
+
+// Frames per round in one thread, the ring takes them all
+#define BENCHMARK_ROUND_FRAMES					(CAN_RING_BUFFER_SIZE - CAN_CONTROLLER_SIM_DEPTH)
+
+/* Variables */
+
+static CAN_MSG_Type _msg;
+static uint32_t _frames;
+static BOOL _lossless; // producer waits for room in the ring instead of overflowing it
+static volatile BOOL _producerDone;
+
+/* Implementation */
+
+/*
+ * @brief		Bus and interrupt hardware: bursts that fill the controller, alternating controllers
+ */
+static void *Producer(void *arg)
+{
+	uint32_t n, i;
+
+	for (n = 0; n < _frames; n += CAN_CONTROLLER_SIM_DEPTH)
+	{
+		uint8_t controller = (n / CAN_CONTROLLER_SIM_DEPTH) & 1;
+		CAN_RING_BUFFER_T *rb = &_ringBuffers[controller];
+
+		// Yield rather than spin, the host may have a single core
+		if (_lossless)
+			while (rb->rxBufferHead - rb->rxBufferTail > CAN_RING_BUFFER_SIZE - CAN_CONTROLLER_SIM_DEPTH)
+				sched_yield();
+
+		for (i = 0; i < CAN_CONTROLLER_SIM_DEPTH; i++)
+			CanControllerSim_Receive(controller, &_msg);
+		Host_InvokeIsr(CAN_IRQn, CAN_IRQHandler);
+	}
+
+	__atomic_store_n(&_producerDone, TRUE, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/*
+ * @brief		Run the handler and the receive path in two threads
+ * @param[in]	lossless Wait for room in the ring rather than overflow it
+ * @return		None
+ */
+static void RunThreads(BOOL lossless)
+{
+	pthread_t producer;
+	CAN_RX_FRAME_T frame;
+	CAN_BUS_STATS_T stats;
+	uint8_t controller;
+	uint32_t received = 0, overflows = 0, i;
+	uint64_t start;
+
+	memset(_ringBuffers, 0, sizeof(_ringBuffers));
+	memset(_busStats, 0, sizeof(_busStats));
+	_lossless = lossless;
+	_producerDone = FALSE;
+
+	start = Host_GetNanoseconds();
+	pthread_create(&producer, NULL, Producer, NULL);
+	for (;;)
+	{
+		BOOL done = __atomic_load_n(&_producerDone, __ATOMIC_ACQUIRE);
+
+		if (CanTask_CanReceive(&frame, &controller))
+			received++;
+		else if (done)
+			break;
+		else
+			sched_yield();
+	}
+	pthread_join(producer, NULL);
+	uint64_t elapsed = Host_GetNanoseconds() - start;
+
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+	{
+		CanTask_GetBusStats(i, &stats);
+		overflows += stats.ringOverflows;
+	}
+
+	printf("Two threads, %s: %.2f Mframes/s received, %.2f%% ring overflows\n",
+			lossless ? "handler waits for room" : "unpaced", received * 1000.0 / elapsed,
+			100.0 * overflows / (received + overflows));
+}
+
+/*
+ * @brief		Run the handler and the receive path in turns in one thread, the cost of each side per frame
+ */
+static void RunSingleThread()
+{
+	CAN_RX_FRAME_T frame;
+	uint8_t controller;
+	uint64_t isrTime = 0, receiveTime = 0, start;
+	uint32_t n, i;
+
+	memset(_ringBuffers, 0, sizeof(_ringBuffers));
+
+	for (n = 0; n < _frames; n += BENCHMARK_ROUND_FRAMES)
+	{
+		start = Host_GetNanoseconds();
+		for (i = 0; i < BENCHMARK_ROUND_FRAMES; i += CAN_CONTROLLER_SIM_DEPTH)
+		{
+			CanControllerSim_Receive(CAN2_CTRL, &_msg);
+			CanControllerSim_Receive(CAN2_CTRL, &_msg);
+			CanControllerSim_Receive(CAN2_CTRL, &_msg);
+			Host_InvokeIsr(CAN_IRQn, CAN_IRQHandler);
+		}
+		isrTime += Host_GetNanoseconds() - start;
+
+		start = Host_GetNanoseconds();
+		while (CanTask_CanReceive(&frame, &controller));
+		receiveTime += Host_GetNanoseconds() - start;
+	}
+
+	printf("One thread: interrupt handler %.1f ns/frame, receive %.1f ns/frame, %.2f Mframes/s\n",
+			(double)isrTime / n, (double)receiveTime / n, n * 1000.0 / (isrTime + receiveTime));
+}
+
+int main(int argc, char *argv[])
+{
+	_frames = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCHMARK_FRAMES;
+
+	_msg.format = STD_ID_FORMAT;
+	_msg.type = DATA_FRAME;
+	_msg.id = 0x302;
+	_msg.len = 8;
+
+	RunSingleThread();
+	RunThreads(TRUE);
+	RunThreads(FALSE);
+
+	return 0;
+}
@@ -0,0 +1,252 @@
+/* Name: CAN RX ring stress test
+ * Description: Runs the CAN interrupt handler and the CAN task's receive path in two threads against simulated
+ * controllers, with random bursts and pauses so the ring buffers run both empty and full. Every frame must come
+ * out exactly once, intact and in order per controller, or be counted as a ring overflow. FullCAN message objects
+ * are polled by the CAN task and may not enter the interrupt handler.
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// The ring buffers and the receive path are private to the CAN task
+#include "CanTask.c"
+
+#include "CanControllerSim.h"
+#include "HostStubs.h"
+
+/* Defines */
+
+#define TEST_FRAMES								2000000
+#define TEST_ID_BASE							0x100
+
+// Frames between statistics reads of the consumer, which hold off the interrupt handler
+#define TEST_STATS_INTERVAL						4096
+
+/* Variables */
+
+static uint32_t _sent[CAN_CONTROLLER_COUNT];
+static volatile BOOL _producerDone;
+
+/* Implementation */
+
+static uint32_t Random(uint32_t *state)
+{
+	// xorshift32
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+/*
+ * @brief		Bus and interrupt hardware: bursts of frames on random controllers, each burst followed by the
+ * 				interrupt handler and a random pause
+ */
+static void *Producer(void *arg)
+{
+	uint32_t state = 0x12345678;
+	uint32_t sent[CAN_CONTROLLER_COUNT] = { 0 };
+	uint32_t n = 0, i;
+	CAN_MSG_Type msg;
+
+	memset(&msg, 0, sizeof(CAN_MSG_Type));
+	msg.format = STD_ID_FORMAT;
+	msg.type = DATA_FRAME;
+	msg.len = 8;
+
+	while (n < TEST_FRAMES)
+	{
+		uint32_t burst = 1 + Random(&state) % CAN_CONTROLLER_SIM_DEPTH;
+
+		for (i = 0; i < burst; i++, n++)
+		{
+			uint8_t controller = Random(&state) & 1;
+			uint32_t check = ~sent[controller];
+
+			msg.id = TEST_ID_BASE + controller;
+			memcpy(msg.dataA, &sent[controller], sizeof(uint32_t));
+			memcpy(msg.dataB, &check, sizeof(uint32_t));
+			CanControllerSim_Receive(controller, &msg);
+			sent[controller]++;
+		}
+
+		Host_InvokeIsr(CAN_IRQn, CAN_IRQHandler);
+
+		// Mostly short pauses that fill the ring, now and then a long one that lets it drain
+		uint32_t pause = Random(&state) % 256;
+		if (pause == 0)
+			sched_yield();
+		else
+			for (i = 0; i < pause; i++)
+				__asm__ volatile ("" ::: "memory");
+	}
+
+	memcpy(_sent, sent, sizeof(_sent));
+	__atomic_store_n(&_producerDone, TRUE, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+/*
+ * @brief		Poll FullCAN message objects, the latest frame of every updated object is read once
+ * @return		Number of errors
+ */
+static uint32_t TestFullCan()
+{
+	CAN_ISR_STATS_T isrBefore, isrAfter;
+	CAN_BUS_STATS_T busBefore, busAfter;
+	CAN_MSG_Type msg;
+	uint32_t errors = 0;
+
+	memset(&msg, 0, sizeof(CAN_MSG_Type));
+	msg.format = STD_ID_FORMAT;
+	msg.type = DATA_FRAME;
+	msg.len = 8;
+	msg.id = TEST_ID_BASE;
+
+	_fullCanCount = 2;
+	_filterTables.fullCan[0].controller = CAN2_CTRL;
+	_filterTables.fullCan[1].controller = CAN2_CTRL;
+
+	CanTask_GetIsrStats(&isrBefore);
+	CanTask_GetBusStats(CAN2_CTRL, &busBefore);
+
+	// Second frame of the first object overwrites the first, then nothing is updated until the next poll
+	CanControllerSim_ReceiveFullCan(0, &msg);
+	CanControllerSim_ReceiveFullCan(0, &msg);
+	CanControllerSim_ReceiveFullCan(1, &msg);
+	CanTask_SampleFullCan();
+	CanTask_SampleFullCan();
+
+	CanTask_GetIsrStats(&isrAfter);
+	CanTask_GetBusStats(CAN2_CTRL, &busAfter);
+
+	printf("FullCAN: %u frames polled, %u interrupts\n", busAfter.frames - busBefore.frames,
+			isrAfter.entries - isrBefore.entries);
+
+	if (busAfter.frames - busBefore.frames != 2)
+	{
+		printf("FullCAN: %u frames polled from 2 updated objects\n", busAfter.frames - busBefore.frames);
+		errors++;
+	}
+	if (isrAfter.entries != isrBefore.entries)
+	{
+		printf("FullCAN: frames entered the interrupt handler\n");
+		errors++;
+	}
+
+	_fullCanCount = 0;
+
+	return errors;
+}
+
+int main()
+{
+	pthread_t producer;
+	CAN_RX_FRAME_T frame;
+	CAN_BUS_STATS_T stats;
+	uint8_t controller;
+	uint32_t next[CAN_CONTROLLER_COUNT] = { 0 };
+	uint32_t received[CAN_CONTROLLER_COUNT] = { 0 };
+	uint32_t lastCycles[CAN_CONTROLLER_COUNT] = { 0 };
+	uint32_t errors = 0, total = 0, seq, check;
+	uint8_t i;
+
+	pthread_create(&producer, NULL, Producer, NULL);
+
+	// CAN task
+	for (;;)
+	{
+		BOOL done = __atomic_load_n(&_producerDone, __ATOMIC_ACQUIRE);
+
+		if (!CanTask_CanReceive(&frame, &controller))
+		{
+			// Everything published before done was seen is in the rings, so they are drained
+			if (done)
+				break;
+
+			// Yield rather than spin, the host may have a single core
+			sched_yield();
+			continue;
+		}
+
+		memcpy(&seq, frame.msg.dataA, sizeof(uint32_t));
+		memcpy(&check, frame.msg.dataB, sizeof(uint32_t));
+
+		if (frame.msg.id != TEST_ID_BASE + controller || check != ~seq || frame.msg.len != 8)
+		{
+			if (errors++ < 10)
+				printf("Corrupt frame on controller %u: id 0x%X, seq %u, check 0x%08X\n", controller,
+						(unsigned)frame.msg.id, seq, check);
+		}
+		else if (seq < next[controller])
+		{
+			if (errors++ < 10)
+				printf("Frame %u on controller %u out of order or twice, expected %u or later\n", seq, controller,
+						next[controller]);
+		}
+		else if (received[controller] > 0 && (int32_t)(frame.cycles - lastCycles[controller]) < 0)
+		{
+			if (errors++ < 10)
+				printf("Frame %u on controller %u stamped before its predecessor\n", seq, controller);
+		}
+		else
+		{
+			next[controller] = seq + 1;
+		}
+
+		lastCycles[controller] = frame.cycles;
+		received[controller]++;
+
+		// Statistics reads disable the interrupt like on target
+		if (++total % TEST_STATS_INTERVAL == 0)
+			CanTask_GetBusStats(controller, &stats);
+	}
+
+	pthread_join(producer, NULL);
+
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+	{
+		CanTask_GetBusStats(i, &stats);
+
+		printf("Controller %u: %u sent, %u received, %u ring overflows, peak occupancy %u of %u\n", i, _sent[i],
+				received[i], stats.ringOverflows, stats.peakRingOccupancy, CAN_RING_BUFFER_SIZE);
+
+		if (CanControllerSim_GetOverruns(i) != 0)
+		{
+			printf("Controller %u overran, the interrupt handler didn't drain it\n", i);
+			errors++;
+		}
+		if (stats.frames != _sent[i])
+		{
+			printf("Controller %u: handler counted %u frames\n", i, stats.frames);
+			errors++;
+		}
+		if (received[i] + stats.ringOverflows != _sent[i])
+		{
+			printf("Controller %u: %u frames neither received nor counted as overflow\n", i,
+					_sent[i] - received[i] - stats.ringOverflows);
+			errors++;
+		}
+		if (stats.peakRingOccupancy > CAN_RING_BUFFER_SIZE)
+		{
+			printf("Controller %u: ring occupancy above its size\n", i);
+			errors++;
+		}
+	}
+
+	errors += TestFullCan();
+
+	if (errors != 0)
+	{
+		printf("FAILED: %u errors\n", errors);
+		return 1;
+	}
+
+	printf("PASSED\n");
+	return 0;
+}
@@ -0,0 +1,189 @@
+/* Name: Packet compression benchmark
+ * Description: Compression ratio and cost of Compression_Compress() and Compression_Decompress() on the tables of
+ * packets packed like the telemetry task. Costs are in nanoseconds on the host, the firmware counts DWT cycles of
+ * the compression in Compression_GetStats().
+ *
+ *   CompressionBenchmark                   synthetic sensor bus traffic
+ *   CompressionBenchmark <capture>         recorded traffic, a capture of the CAN task (CANDATA.CAN)
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SensorDataManager.h"
+#include "CanCapture.h"
+#include "Compression.h"
+#include "HostStubs.h"
+
+/* Defines */
+
+// Tables are packed at the interval of the telemetry task (TELEMETRY_INTERVAL) into tables of its size
+// (TELEMETRY_TABLES_SIZE), see TelemetryTask.c
+#define BENCHMARK_PACKET_INTERVAL				(3 * CFG_SYSTICK_FREQ / 2)
+#define BENCHMARK_TABLES_SIZE					243
+
+// Length of the synthetic traffic (seconds) and the times every packet is compressed and decompressed
+#define BENCHMARK_SYNTHETIC_SECONDS				600
+#define BENCHMARK_ROUNDS						20
+
+// Microseconds per OS tick
+#define BENCHMARK_TICK_US						(1000000 / CFG_SYSTICK_FREQ)
+
+/* Structs */
+
+typedef struct {
+
+	uint16_t size;
+	uint8_t tables[BENCHMARK_TABLES_SIZE];
+
+} BENCHMARK_PACKET_T;
+
+/* Implementation */
+
+/*
+ * @brief		Pack the tables of a capture like the telemetry task
+ * @param[in]	records Capture
+ * @param[in]	count Records in the capture
+ * @param[out]	packets Tables of every packet, allocated, free() after use
+ * @return		Number of packets
+ */
+static uint32_t PackTables(const CAN_CAPTURE_RECORD_T *records, uint32_t count, BENCHMARK_PACKET_T **packets)
+{
+	uint64_t captureTime = 0;
+	uint32_t i, packetCount = 0, osTicks = 0, nextPacket = BENCHMARK_PACKET_INTERVAL;
+	uint32_t previousTimestamp = 0;
+	uint8_t tables[BENCHMARK_TABLES_SIZE];
+	uint16_t tablesSize;
+	CAN_MSG_Type msg;
+	uint8_t controller;
+
+	// Never more than a packet per record
+	*packets = malloc(count * sizeof(BENCHMARK_PACKET_T));
+	if (*packets == NULL)
+		return 0;
+
+	for (i = 0; i < count; i++)
+	{
+		if (i > 0)
+			captureTime += (uint32_t)(records[i].timestamp - previousTimestamp);
+		previousTimestamp = records[i].timestamp;
+
+		if (records[i].flags & CAN_CAPTURE_FLAG_SYNC)
+			continue;
+
+		if (captureTime / BENCHMARK_TICK_US > osTicks)
+		{
+			Host_AdvanceOSTime(captureTime / BENCHMARK_TICK_US - osTicks);
+			osTicks = captureTime / BENCHMARK_TICK_US;
+		}
+
+		if (osTicks >= nextPacket)
+		{
+			nextPacket = osTicks + BENCHMARK_PACKET_INTERVAL;
+
+			tablesSize = SensorDataManager_GetTables(tables, sizeof(tables));
+			SensorDataManager_AcknowledgeTables(TRUE);
+			if (tablesSize != 0)
+			{
+				(*packets)[packetCount].size = tablesSize;
+				memcpy((*packets)[packetCount].tables, tables, tablesSize);
+				packetCount++;
+			}
+		}
+
+		CanCapture_MakeMessage(&records[i], &msg, &controller);
+		SensorDataManager_PutCanData(&msg, controller, records[i].timestamp);
+	}
+
+	return packetCount;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t compressed[BENCHMARK_TABLES_SIZE], decompressed[BENCHMARK_TABLES_SIZE];
+	uint64_t tableBytes = 0, compressedBytes = 0, decompressedBytes = 0, compressNs = 0, decompressNs = 0;
+	uint64_t start, ns, maxNs = 0;
+	uint32_t count, packetCount, compressedPackets = 0, mismatches = 0, i, round;
+	CAN_CAPTURE_RECORD_T *records;
+	BENCHMARK_PACKET_T *packets;
+	uint16_t compressedSize;
+
+	records = argc > 1 ? CanCapture_Read(argv[1], &count) :
+			CanCapture_MakeSynthetic(BENCHMARK_SYNTHETIC_SECONDS, &count);
+	if (records == NULL)
+		return 1;
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	SensorDataManager_RequestSchema();
+	packetCount = PackTables(records, count, &packets);
+	free(records);
+
+	if (packetCount == 0)
+	{
+		fprintf(stderr, "No packets packed\n");
+		return 1;
+	}
+
+	for (i = 0; i < packetCount; i++)
+	{
+		// Only compressed data that is smaller is sent, like the telemetry task
+		compressedSize = Compression_Compress(packets[i].tables, packets[i].size, compressed, packets[i].size - 1);
+		tableBytes += packets[i].size;
+		compressedBytes += compressedSize ? compressedSize : packets[i].size;
+
+		if (compressedSize == 0)
+			continue;
+
+		compressedPackets++;
+		decompressedBytes += packets[i].size;
+		if (Compression_Decompress(compressed, compressedSize, decompressed, sizeof(decompressed)) != packets[i].size ||
+				memcmp(decompressed, packets[i].tables, packets[i].size) != 0)
+			mismatches++;
+	}
+
+	for (round = 0; round < BENCHMARK_ROUNDS; round++)
+	{
+		for (i = 0; i < packetCount; i++)
+		{
+			start = Host_GetNanoseconds();
+			compressedSize = Compression_Compress(packets[i].tables, packets[i].size, compressed, packets[i].size - 1);
+			ns = Host_GetNanoseconds() - start;
+			compressNs += ns;
+			if (ns > maxNs)
+				maxNs = ns;
+
+			if (compressedSize == 0)
+				continue;
+
+			start = Host_GetNanoseconds();
+			Compression_Decompress(compressed, compressedSize, decompressed, sizeof(decompressed));
+			decompressNs += Host_GetNanoseconds() - start;
+		}
+	}
+
+	printf("Packets: %u, %u compressed, %.1f bytes/packet, %.1f compressed (%.1f%%)\n", packetCount,
+			compressedPackets, (double)tableBytes / packetCount, (double)compressedBytes / packetCount,
+			100.0 * compressedBytes / tableBytes);
+	printf("Compress: %.1f ns/byte, %.1f us/packet (max %.1f us)\n", (double)compressNs / (tableBytes * BENCHMARK_ROUNDS),
+			compressNs / 1e3 / (packetCount * BENCHMARK_ROUNDS), maxNs / 1e3);
+	if (decompressedBytes != 0)
+		printf("Decompress: %.1f ns/byte\n", (double)decompressNs / (decompressedBytes * BENCHMARK_ROUNDS));
+
+	free(packets);
+
+	if (mismatches != 0)
+	{
+		fprintf(stderr, "%u packets didn't decompress to their tables\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,239 @@
+/* Name: Packet compression test
+ * Description: Round trips of Compression_Compress() and Compression_Decompress() on the tables of packets packed
+ * from synthetic sensor bus traffic and on edge cases: long runs, matches at the window edge, data that doesn't
+ * compress, a destination that is too small and invalid compressed data.
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SensorDataManager.h"
+#include "Compression.h"
+#include "HostStubs.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Packets packed from synthetic traffic, frames between packets and the ticks between them (TELEMETRY_INTERVAL)
+#define TEST_PACKETS							1000
+#define TEST_FRAMES_PER_PACKET					(4 * SYNTHETIC_FRAMES_PER_ROUND)
+#define TEST_PACKET_TICKS						(3 * CFG_SYSTICK_FREQ / 2)
+
+// Tables of a single packet (TELEMETRY_TABLES_SIZE)
+#define TEST_TABLES_SIZE						243
+
+// Largest data of the edge cases, and room for its compressed form when it doesn't compress (a flag byte per 8)
+#define TEST_DATA_SIZE							1024
+#define TEST_COMPRESSED_SIZE					(TEST_DATA_SIZE + TEST_DATA_SIZE / 8 + 1)
+
+/* Variables */
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("CompressionTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+/*
+ * @brief		Compress and decompress data
+ * @param[in]	data Data
+ * @param[in]	length Size of data
+ * @param[in]	destSize Size the compressed data must fit in
+ * @return		Size of compressed data, 0 if it didn't fit
+ */
+static uint16_t RoundTrip(const uint8_t *data, uint16_t length, uint16_t destSize)
+{
+	static uint8_t compressed[TEST_COMPRESSED_SIZE], decompressed[TEST_DATA_SIZE];
+	uint16_t compressedSize;
+
+	compressedSize = Compression_Compress(data, length, compressed, destSize);
+	CHECK(compressedSize <= destSize);
+	if (compressedSize == 0)
+		return 0;
+
+	CHECK(Compression_Decompress(compressed, compressedSize, decompressed, sizeof(decompressed)) == length);
+	CHECK(memcmp(decompressed, data, length) == 0);
+
+	// Exactly the original size is enough room
+	CHECK(Compression_Decompress(compressed, compressedSize, decompressed, length) == length);
+	if (length != 0)
+		CHECK(Compression_Decompress(compressed, compressedSize, decompressed, length - 1) == 0);
+
+	return compressedSize;
+}
+
+static void TestPackets()
+{
+	uint8_t tables[TEST_TABLES_SIZE];
+	uint32_t packet, i, packets = 0, compressedPackets = 0, tableBytes = 0, compressedBytes = 0;
+	uint16_t tablesSize, compressedSize;
+	CAN_MSG_Type msg;
+
+	if (!SensorDataManager_Init())
+	{
+		CHECK(FALSE);
+		return;
+	}
+
+	SensorDataManager_RequestSchema();
+
+	for (packet = 0; packet < TEST_PACKETS; packet++)
+	{
+		for (i = 0; i < TEST_FRAMES_PER_PACKET; i++)
+		{
+			SyntheticTraffic_MakeFrame(packet * TEST_FRAMES_PER_PACKET + i, &msg);
+			SensorDataManager_PutCanData(&msg, CAN2_CTRL, packet * 1000 + i);
+		}
+		Host_AdvanceOSTime(TEST_PACKET_TICKS);
+
+		tablesSize = SensorDataManager_GetTables(tables, sizeof(tables));
+		SensorDataManager_AcknowledgeTables(TRUE);
+		if (tablesSize == 0)
+			continue;
+
+		// Every packet round trips with room to spare, and in the room the telemetry task gives it
+		CHECK(RoundTrip(tables, tablesSize, TEST_COMPRESSED_SIZE) != 0);
+		compressedSize = RoundTrip(tables, tablesSize, tablesSize - 1);
+
+		packets++;
+		tableBytes += tablesSize;
+		if (compressedSize != 0)
+		{
+			compressedPackets++;
+			compressedBytes += compressedSize;
+		}
+		else
+		{
+			compressedBytes += tablesSize;
+		}
+	}
+
+	printf("Packets: %u, %u compressed, %.1f%% of the table bytes\n", packets, compressedPackets,
+			100.0 * compressedBytes / tableBytes);
+	CHECK(packets != 0 && compressedPackets != 0 && compressedBytes < tableBytes);
+}
+
+/*
+ * @brief		Fill data with bytes that don't repeat within the window
+ * @param[out]	data Data
+ * @param[in]	length Size of data
+ * @return		None
+ */
+static void MakeRandom(uint8_t *data, uint16_t length)
+{
+	uint32_t seed = 12345;
+	uint16_t i;
+
+	for (i = 0; i < length; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+}
+
+static void TestEdgeCases()
+{
+	static uint8_t data[TEST_DATA_SIZE];
+
+	// Nothing to compress
+	CHECK(Compression_Compress(data, 0, data, 0) == 0);
+
+	// Run of one byte: a group of one literal and overlapping matches of the longest length
+	memset(data, 0xA5, TEST_DATA_SIZE);
+	CHECK(RoundTrip(data, TEST_DATA_SIZE, TEST_COMPRESSED_SIZE) ==
+			1 + 1 + 2 * ((TEST_DATA_SIZE - 1 + COMPRESSION_MAX_MATCH - 1) / COMPRESSION_MAX_MATCH));
+
+	// Repeat at the window edge: 32 groups of literals, then a group with the match
+	MakeRandom(data, TEST_DATA_SIZE);
+	memcpy(data + COMPRESSION_WINDOW_SIZE, data, 16);
+	CHECK(RoundTrip(data, COMPRESSION_WINDOW_SIZE + 16, TEST_COMPRESSED_SIZE) ==
+			COMPRESSION_WINDOW_SIZE / 8 * 9 + 1 + 2);
+
+	// Repeat just past the window edge: literals only
+	MakeRandom(data, TEST_DATA_SIZE);
+	memcpy(data + COMPRESSION_WINDOW_SIZE + 1, data, 16);
+	CHECK(RoundTrip(data, COMPRESSION_WINDOW_SIZE + 1 + 16, TEST_COMPRESSED_SIZE) ==
+			(COMPRESSION_WINDOW_SIZE + 16) / 8 * 9 + 1 + 1);
+
+	// Data that doesn't compress doesn't fit in the room the telemetry task gives it, which then sends it as is
+	MakeRandom(data, TEST_DATA_SIZE);
+	CHECK(RoundTrip(data, TEST_TABLES_SIZE, TEST_TABLES_SIZE - 1) == 0);
+	CHECK(RoundTrip(data, TEST_TABLES_SIZE, TEST_COMPRESSED_SIZE) == TEST_TABLES_SIZE + (TEST_TABLES_SIZE + 7) / 8);
+}
+
+static void TestStats()
+{
+	static uint8_t data[TEST_DATA_SIZE], compressed[TEST_COMPRESSED_SIZE];
+	COMPRESSION_STATS_T before, after;
+	uint16_t compressedSize;
+
+	// Compressed data counts at its compressed size
+	memset(data, 0xA5, TEST_DATA_SIZE);
+	Compression_GetStats(&before);
+	compressedSize = Compression_Compress(data, TEST_DATA_SIZE, compressed, sizeof(compressed));
+	Compression_GetStats(&after);
+	CHECK(after.count == before.count + 1);
+	CHECK(after.inputBytes == before.inputBytes + TEST_DATA_SIZE);
+	CHECK(after.outputBytes == before.outputBytes + compressedSize);
+
+	// Data that doesn't compress counts at its input size
+	MakeRandom(data, TEST_DATA_SIZE);
+	Compression_GetStats(&before);
+	CHECK(Compression_Compress(data, TEST_TABLES_SIZE, compressed, TEST_TABLES_SIZE - 1) == 0);
+	Compression_GetStats(&after);
+	CHECK(after.count == before.count + 1);
+	CHECK(after.inputBytes == before.inputBytes + TEST_TABLES_SIZE);
+	CHECK(after.outputBytes == before.outputBytes + TEST_TABLES_SIZE);
+}
+
+static void TestInvalidData()
+{
+	uint8_t dest[16];
+
+	// Match before the start of the data
+	static const uint8_t farMatch[] = { 0x02, 'a', 0x01, 0x00 };
+	CHECK(Compression_Decompress(farMatch, sizeof(farMatch), dest, sizeof(dest)) == 0);
+
+	// Match cut off after its distance
+	static const uint8_t cutMatch[] = { 0x02, 'a', 0x00 };
+	CHECK(Compression_Decompress(cutMatch, sizeof(cutMatch), dest, sizeof(dest)) == 0);
+
+	// Match longer than the destination
+	static const uint8_t longMatch[] = { 0x02, 'a', 0x00, 0x20 };
+	CHECK(Compression_Decompress(longMatch, sizeof(longMatch), dest, sizeof(dest)) == 0);
+
+	// Literals past the end of the destination
+	static const uint8_t literals[] = { 0x00, 'a', 'b', 'c' };
+	CHECK(Compression_Decompress(literals, sizeof(literals), dest, 2) == 0);
+	CHECK(Compression_Decompress(literals, sizeof(literals), dest, 3) == 3 && memcmp(dest, "abc", 3) == 0);
+}
+
+int main()
+{
+	TestEdgeCases();
+	TestInvalidData();
+	TestStats();
+	TestPackets();
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,148 @@
+/* Name: Sensor table contention benchmark
+ * Description: The CAN task decoding frames while the telemetry task packs tables, in two threads. Compares the
+ * sequence locks of the sensor tables with the single data mutex they replaced, which was held by
+ * SensorDataManager_PutCanData() and for all of SensorDataManager_GetTables(). Reports the decode throughput and
+ * time per frame, and how often and how long the CAN task waited for the telemetry task.
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SensorDataManager.h"
+#include "HostStubs.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define BENCHMARK_FRAMES						1000000
+
+// Ticks between packets, enough to refill the byte budget of the sensor data manager
+#define BENCHMARK_PACKET_TICKS					(10 * CFG_SYSTICK_FREQ)
+
+/* Variables */
+
+static CAN_MSG_Type *_msgs;
+static uint32_t *_latencies; // nanoseconds per frame
+static uint32_t _frames;
+
+static BOOL _useMutex; // serialize decoding and packing with one mutex, the replaced design
+static pthread_mutex_t _dataMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile BOOL _writerDone;
+
+static uint32_t _packets;
+
+/* Implementation */
+
+/*
+ * @brief		Telemetry task: packs tables continuously until the CAN task is done, the worst case for it
+ */
+static void *Reader(void *arg)
+{
+	uint8_t tableBuffer[1024];
+
+	while (!__atomic_load_n(&_writerDone, __ATOMIC_ACQUIRE))
+	{
+		Host_AdvanceOSTime(BENCHMARK_PACKET_TICKS);
+
+		if (_useMutex)
+			pthread_mutex_lock(&_dataMutex);
+		SensorDataManager_GetTables(tableBuffer, sizeof(tableBuffer));
+		SensorDataManager_AcknowledgeTables(TRUE);
+		if (_useMutex)
+			pthread_mutex_unlock(&_dataMutex);
+
+		_packets++;
+	}
+
+	return NULL;
+}
+
+static int CompareLatencies(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void Run(BOOL useMutex)
+{
+	pthread_t reader;
+	uint64_t start, total, frameStart, waitStart, wait, maxWait = 0;
+	uint32_t n, waits = 0;
+
+	_useMutex = useMutex;
+	_writerDone = FALSE;
+	_packets = 0;
+
+	pthread_create(&reader, NULL, Reader, NULL);
+
+	// CAN task: decodes frames back to back
+	start = Host_GetNanoseconds();
+	for (n = 0; n < _frames; n++)
+	{
+		frameStart = Host_GetNanoseconds();
+		if (useMutex && pthread_mutex_trylock(&_dataMutex) != 0)
+		{
+			// Telemetry task holds the tables
+			waitStart = Host_GetNanoseconds();
+			pthread_mutex_lock(&_dataMutex);
+			wait = Host_GetNanoseconds() - waitStart;
+			if (wait > maxWait)
+				maxWait = wait;
+			waits++;
+		}
+		SensorDataManager_PutCanData(&_msgs[n], CAN2_CTRL, n);
+		if (useMutex)
+			pthread_mutex_unlock(&_dataMutex);
+		_latencies[n] = Host_GetNanoseconds() - frameStart;
+	}
+	total = Host_GetNanoseconds() - start;
+
+	__atomic_store_n(&_writerDone, TRUE, __ATOMIC_RELEASE);
+	pthread_join(reader, NULL);
+
+	qsort(_latencies, _frames, sizeof(uint32_t), CompareLatencies);
+
+	// Sequence locks never wait, the reader retries instead
+	printf("%s: %.2f Mframes/s, %u packets, decode median %u ns, 99.9%% %u ns, %u waits for the reader "
+			"(max %.3f ms)\n", useMutex ? "Data mutex    " : "Sequence locks", _frames * 1000.0 / total, _packets,
+			_latencies[_frames / 2], _latencies[_frames - _frames / 1000 - 1], waits, maxWait / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t n;
+
+	_frames = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCHMARK_FRAMES;
+	if (_frames == 0)
+	{
+		fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+		return 1;
+	}
+
+	_msgs = malloc(_frames * sizeof(CAN_MSG_Type));
+	_latencies = malloc(_frames * sizeof(uint32_t));
+	if (_msgs == NULL || _latencies == NULL)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return 1;
+	}
+
+	for (n = 0; n < _frames; n++)
+		SyntheticTraffic_MakeFrame(n, &_msgs[n]);
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	Run(TRUE);
+	Run(FALSE);
+
+	return 0;
+}
@@ -0,0 +1,95 @@
+/* Name: Sensor decoder benchmark
+ * Description: Cost of SensorDataManager_PutCanData() for every message of the decoder table and for frames it
+ * doesn't decode, to show the lookup cost doesn't depend on where a message is in the table
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SensorDataManager.h"
+#include "HostStubs.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define BENCHMARK_ITERATIONS					200000
+
+// Second BMS identifier, decoded like SYNTHETIC_ID_BMS
+#define BENCHMARK_ID_BMS_TEMP					0x402
+
+// One frame of every message in the synthetic mix (5 BMS, 8 MPPT and a temperature frame), the BMS frames on
+// BENCHMARK_ID_BMS_TEMP and two frames that aren't decoded
+#define BENCHMARK_MIX_MESSAGES					14
+#define BENCHMARK_MESSAGES						(BENCHMARK_MIX_MESSAGES + 5 + 2)
+
+// Ticks between runs, enough to refill the byte budget of the sensor data manager
+#define BENCHMARK_RUN_TICKS						(10 * CFG_SYSTICK_FREQ)
+
+/* Implementation */
+
+int main(int argc, char *argv[])
+{
+	static CAN_MSG_Type msgs[BENCHMARK_MESSAGES];
+	uint8_t tableBuffer[1024];
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCHMARK_ITERATIONS;
+	double cost, minCost = 0, maxCost = 0;
+	uint64_t start;
+	uint32_t i, n;
+
+	if (iterations == 0)
+	{
+		fprintf(stderr, "Usage: %s [iterations per message]\n", argv[0]);
+		return 1;
+	}
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < BENCHMARK_MIX_MESSAGES; i++)
+		SyntheticTraffic_MakeFrame(i, &msgs[i]);
+	for (i = 0; i < 5; i++)
+	{
+		msgs[BENCHMARK_MIX_MESSAGES + i] = msgs[i];
+		msgs[BENCHMARK_MIX_MESSAGES + i].id = BENCHMARK_ID_BMS_TEMP;
+	}
+
+	// Identifiers below and above the decoder table
+	msgs[BENCHMARK_MESSAGES - 2] = msgs[0];
+	msgs[BENCHMARK_MESSAGES - 2].id = 0x001;
+	msgs[BENCHMARK_MESSAGES - 1] = msgs[BENCHMARK_MIX_MESSAGES - 1];
+	msgs[BENCHMARK_MESSAGES - 1].id = 0x1CFFFF21;
+
+	printf("%-12s %-10s %s\n", "Identifier", "Sub-index", "ns/frame");
+	for (i = 0; i < BENCHMARK_MESSAGES; i++)
+	{
+		start = Host_GetNanoseconds();
+		for (n = 0; n < iterations; n++)
+			SensorDataManager_PutCanData(&msgs[i], CAN2_CTRL, n);
+		cost = (double)(Host_GetNanoseconds() - start) / iterations;
+
+		if (i == 0 || cost < minCost)
+			minCost = cost;
+		if (i == 0 || cost > maxCost)
+			maxCost = cost;
+
+		// Only BMS messages are decoded by sub-index
+		if (msgs[i].id == SYNTHETIC_ID_BMS || msgs[i].id == BENCHMARK_ID_BMS_TEMP)
+			printf("0x%-10X %-10u %.1f\n", msgs[i].id, msgs[i].dataA[3], cost);
+		else
+			printf("0x%-10X %-10s %.1f%s\n", msgs[i].id, "-", cost, i >= BENCHMARK_MESSAGES - 2 ? " (not decoded)" : "");
+
+		// Empty the tables between runs, like the telemetry task
+		Host_AdvanceOSTime(BENCHMARK_RUN_TICKS);
+		SensorDataManager_GetTables(tableBuffer, sizeof(tableBuffer));
+		SensorDataManager_AcknowledgeTables(TRUE);
+	}
+
+	printf("Spread: %.1f .. %.1f ns/frame\n", minCost, maxCost);
+
+	return 0;
+}
@@ -0,0 +1,284 @@
+/* Name: Delta table round trip test
+ * Description: Packs sensor bus traffic into tables like the telemetry task, loses some of the packets and decodes
+ * the others with the packet decoder. After every packet the shore side copy of each sensor table must equal the
+ * table the firmware encodes its deltas against, and every value must be within its deadband of the firmware's.
+ * Reports the bytes saved by delta tables and by compression, and checks that a delta table only needs room for
+ * its encoded size. Includes SensorDataManager.c to reach its tables.
+ *
+ *   DeltaRoundTripTest                     synthetic sensor bus traffic
+ *   DeltaRoundTripTest <capture>           recorded traffic, a capture of the CAN task (CANDATA.CAN)
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SensorDataManager.c"
+
+#include "CanCapture.h"
+#include "Compression.h"
+#include "HostStubs.h"
+#include "PacketDecoder.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Tables are packed at the interval of the telemetry task (TELEMETRY_INTERVAL) into tables of its size
+// (TELEMETRY_TABLES_SIZE), see TelemetryTask.c
+#define TEST_PACKET_INTERVAL					(3 * CFG_SYSTICK_FREQ / 2)
+#define TEST_TABLES_SIZE						243
+
+// Length of the synthetic traffic (seconds)
+#define TEST_SYNTHETIC_SECONDS					600
+
+// Every n-th packet is lost, its tables are sent again against the previous reference
+#define TEST_LOSS_INTERVAL						7
+
+// Microseconds per OS tick
+#define TEST_TICK_US							(1000000 / CFG_SYSTICK_FREQ)
+
+/* Variables */
+
+static PACKET_DECODER_T _decoder;
+
+// Sensor table bytes as sent, and as they would have been sent in full
+static uint64_t _deltaBytes;
+static uint64_t _fullBytes;
+static uint32_t _deltaTables;
+static uint32_t _fullTables;
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("DeltaRoundTripTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+static void HandleEvent(void *context, const PACKET_EVENT_T *event)
+{
+	const PACKET_TABLE_T *table = event->table;
+	uint8_t size, i;
+
+	if (event->type != PACKET_EVENT_TABLE)
+		return;
+
+	// Table ID, timestamp and bitmap followed by the fields in the bitmap
+	if (event->delta)
+	{
+		size = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t);
+		for (i = 0; i < table->fieldCount; i++)
+		{
+			if (event->fields & _BIT(i))
+				size += _fieldWidths[table->fields[i].type];
+		}
+
+		_deltaTables++;
+	}
+	else
+	{
+		size = sizeof(uint8_t) + table->size;
+		_fullTables++;
+	}
+
+	_deltaBytes += size;
+	_fullBytes += sizeof(uint8_t) + table->size;
+}
+
+/*
+ * @brief		Compare the shore side tables with the firmware's after a packet was acknowledged
+ * @param[in]	snapshots Sensor tables read when the packet was packed, indexed by DECODER_TABLE
+ * @param[in]	sent Sensor tables in the packet (bit per DECODER_TABLE)
+ * @return		None
+ */
+static void CheckTables(uint8_t snapshots[][PACKET_DECODER_MAX_TABLE_SIZE], uint8_t sent)
+{
+	uint8_t i, j;
+
+	for (i = 0; i < DECODER_TABLE_COUNT; i++)
+	{
+		const DECODER_TABLE_T *decoderTable = &_decoderTables[i];
+		const PACKET_TABLE_T *table = PacketDecoder_FindTable(&_decoder, decoderTable->id);
+
+		if (table == NULL || !table->valid)
+			continue;
+
+		// Shore side applies deltas to the same table the firmware encodes them against
+		CHECK(table->size == decoderTable->size);
+		CHECK(memcmp(table->table, decoderTable->reference, decoderTable->size) == 0);
+
+		if (!(sent & _BIT(i)))
+			continue;
+
+		// Fields left out of the delta stay within their deadband
+		for (j = 0; j < decoderTable->fieldCount; j++)
+		{
+			const TABLE_FIELD_T *field = &decoderTable->fields[j];
+			float change = SensorDataManager_GetFieldValue(snapshots[i] + field->offset, field->type) -
+					SensorDataManager_GetFieldValue(decoderTable->reference + field->offset, field->type);
+
+			CHECK(change <= field->deadband && change >= -field->deadband);
+		}
+	}
+}
+
+/*
+ * @brief		Put a BMS delta table with a single moved field in a buffer that fits only that delta table
+ * @return		None
+ */
+static void CheckDeltaRoom()
+{
+	const DECODER_TABLE_T *decoderTable = &_decoderTables[DECODER_TABLE_BMS];
+	uint8_t dest[sizeof(uint8_t) + sizeof(TableBms_t)];
+	uint16_t dataReady, voltage;
+	CAN_MSG_Type msg;
+
+	// Acknowledged table equals the current one, then only the voltage moves
+	SensorDataManager_ReadTable(DECODER_TABLE_BMS, decoderTable->reference, &dataReady);
+	_tableSend[DECODER_TABLE_BMS].keyframeDue = FALSE;
+
+	memset(&msg, 0, sizeof(CAN_MSG_Type));
+	msg.format = STD_ID_FORMAT;
+	msg.id = SYNTHETIC_ID_BMS;
+	msg.len = 8;
+	msg.dataA[3] = SI_BMS_VOLTAGE;
+	voltage = ((TableBms_t *)decoderTable->reference)->voltage + 10;
+	memcpy(msg.dataB, &voltage, sizeof(uint16_t));
+	SensorDataManager_PutCanData(&msg, CAN2_CTRL, 0);
+
+	// Table ID, timestamp, bitmap and the voltage
+	uint8_t deltaSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t);
+	CHECK(deltaSize < sizeof(dest));
+	CHECK(SensorDataManager_PutSensorTable(DECODER_TABLE_BMS, dest, deltaSize - 1) == 0);
+	CHECK(SensorDataManager_PutSensorTable(DECODER_TABLE_BMS, dest, deltaSize) == deltaSize);
+	CHECK(dest[0] == TABLE_ID_DELTA(TABLE_ID_BMS));
+
+	SensorDataManager_AcknowledgeTables(FALSE);
+}
+
+static BOOL SchemaComplete()
+{
+	return PacketDecoder_SchemaComplete(&_decoder) && _decoder.tableCount == DECODER_TABLE_COUNT;
+}
+
+int main(int argc, char *argv[])
+{
+	static uint8_t snapshots[DECODER_TABLE_COUNT][PACKET_DECODER_MAX_TABLE_SIZE];
+	uint8_t tables[TEST_TABLES_SIZE], compressed[TEST_TABLES_SIZE];
+	uint64_t captureTime = 0, tableBytes = 0, compressedBytes = 0;
+	uint32_t count, i, packets = 0, lost = 0, osTicks = 0, nextPacket = TEST_PACKET_INTERVAL;
+	uint32_t previousTimestamp = 0;
+	uint16_t tablesSize, compressedSize, dataReady;
+	CAN_CAPTURE_RECORD_T *records;
+	PACKET_RESULT result;
+	CAN_MSG_Type msg;
+	uint8_t controller, sent, j;
+
+	records = argc > 1 ? CanCapture_Read(argv[1], &count) : CanCapture_MakeSynthetic(TEST_SYNTHETIC_SECONDS, &count);
+	if (records == NULL)
+		return 1;
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	SensorDataManager_RequestSchema();
+	PacketDecoder_Init(&_decoder, HandleEvent, NULL);
+
+	for (i = 0; i < count; i++)
+	{
+		// OS time follows the capture, so the byte budget and keyframes behave as on the boat
+		if (i > 0)
+			captureTime += (uint32_t)(records[i].timestamp - previousTimestamp);
+		previousTimestamp = records[i].timestamp;
+
+		if (records[i].flags & CAN_CAPTURE_FLAG_SYNC)
+			continue;
+
+		if (captureTime / TEST_TICK_US > osTicks)
+		{
+			Host_AdvanceOSTime(captureTime / TEST_TICK_US - osTicks);
+			osTicks = captureTime / TEST_TICK_US;
+		}
+
+		if (osTicks >= nextPacket)
+		{
+			nextPacket = osTicks + TEST_PACKET_INTERVAL;
+
+			tablesSize = SensorDataManager_GetTables(tables, sizeof(tables));
+			if (tablesSize == 0)
+				continue;
+
+			sent = 0;
+			for (j = 0; j < DECODER_TABLE_COUNT; j++)
+			{
+				SensorDataManager_ReadTable(j, snapshots[j], &dataReady);
+				if (_tableSend[j].pending)
+					sent |= _BIT(j);
+			}
+
+			compressedSize = Compression_Compress(tables, tablesSize, compressed, tablesSize - 1);
+			tableBytes += tablesSize;
+			compressedBytes += compressedSize ? compressedSize : tablesSize;
+			packets++;
+
+			if (packets % TEST_LOSS_INTERVAL == 0)
+			{
+				SensorDataManager_AcknowledgeTables(FALSE);
+				sent = 0;
+				lost++;
+			}
+			else
+			{
+				SensorDataManager_AcknowledgeTables(TRUE);
+
+				// Tables behind a table of unknown layout are skipped until every sensor table is described
+				result = PacketDecoder_DecodeTables(&_decoder, tables, tablesSize, osTicks / CFG_SYSTICK_FREQ);
+				CHECK(result == PACKET_OK || (result == PACKET_UNKNOWN_TABLE && !SchemaComplete()));
+			}
+
+			CheckTables(snapshots, sent);
+		}
+
+		CanCapture_MakeMessage(&records[i], &msg, &controller);
+		SensorDataManager_PutCanData(&msg, controller, records[i].timestamp);
+	}
+
+	free(records);
+
+	CheckDeltaRoom();
+
+	CHECK(packets != 0 && SchemaComplete());
+	CHECK(_fullTables != 0 && _deltaTables != 0);
+	CHECK(_deltaBytes <= _fullBytes);
+
+	printf("Packets: %u (%u lost), %.1f s\n", packets, lost, captureTime / 1e6);
+	if (_fullBytes != 0 && tableBytes != 0)
+	{
+		printf("Sensor tables: %u full, %u delta, %llu bytes, %llu in full (%.1f%%)\n", _fullTables, _deltaTables,
+				(unsigned long long)_deltaBytes, (unsigned long long)_fullBytes, 100.0 * _deltaBytes / _fullBytes);
+		printf("All tables: %.1f bytes/packet, %.1f compressed (%.1f%%)\n", (double)tableBytes / packets,
+				(double)compressedBytes / packets, 100.0 * compressedBytes / tableBytes);
+	}
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,375 @@
+/* Name: GM862 modem simulation
+ * Description: The GM862 as seen through UART1 and its control pins, for host programs that run the modem driver.
+ * Bytes written by the driver are handled right away, responses reach the driver's ring buffer through its
+ * interrupt handler once their response time passed.
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <lpc17xx_gpio.h>
+#include <lpc17xx_pinsel.h>
+#include <lpc17xx_uart.h>
+
+#include "ModemSim.h"
+
+/* Defines */
+
+// Control pins of the modem (see GM862.c)
+#define MODEM_SIM_CONTROL_PORT					2
+#define MODEM_SIM_SHUTDOWN_PORT					0
+#define MODEM_SIM_SHUTDOWN_PIN					6
+#define MODEM_SIM_RESET_PIN						11
+#define MODEM_SIM_ENABLE_PIN					12
+#define MODEM_SIM_PWRMON_PIN					8
+#define MODEM_SIM_DCD_PIN						3
+#define MODEM_SIM_DTR_PIN						5
+
+// Responses on their way to the driver
+#define MODEM_SIM_OUTPUT_SIZE					512
+
+#define MODEM_SIM_LINE_SIZE						128
+#define MODEM_SIM_PORT_COUNT					5
+
+// Nanoseconds per CoOS tick
+#define MODEM_SIM_TICK_NS						(1000000000ULL / CFG_SYSTICK_FREQ)
+
+// Position report of the GPS receiver (AT$GPSACP)
+#define MODEM_SIM_GPS_POSITION					"$GPSACP: 161514.000,5312.7499N,00547.9893E,31.6,70.8,2,258.70,0.82,0.44,070612,03"
+
+/* Variables */
+
+static uint8_t _output[MODEM_SIM_OUTPUT_SIZE];
+static uint32_t _outputTimes[MODEM_SIM_OUTPUT_SIZE]; // OS time every byte reaches the UART
+static uint16_t _outputHead;
+static uint16_t _outputCount;
+
+static char _line[MODEM_SIM_LINE_SIZE]; // AT command being received
+static uint8_t _lineLength;
+
+static BOOL _powered;
+static BOOL _connected; // socket is open
+static BOOL _online; // socket data is sent transparently
+static uint16_t _dataExpected; // socket data bytes of #SSENDEXT still to come
+
+static uint32_t _pins[MODEM_SIM_PORT_COUNT]; // output pins set by the driver (bit per pin)
+static uint64_t _uartTime; // nanoseconds of UART transfer not yet passed as OS time
+
+static uint8_t _payload[MODEM_SIM_PAYLOAD_SIZE];
+static uint32_t _payloadLength;
+
+static MODEM_SIM_STATS_T _stats;
+
+/* Prototypes */
+
+// Interrupt handler of the driver, see GM862.c
+void UART1_IRQHandler();
+
+/* Implementation */
+
+/*
+ * @brief		Power the modem off and forget the collected socket data
+ * @return		None
+ */
+void ModemSim_Reset()
+{
+	_outputHead = 0;
+	_outputCount = 0;
+	_lineLength = 0;
+	_powered = FALSE;
+	_connected = FALSE;
+	_online = FALSE;
+	_dataExpected = 0;
+	_payloadLength = 0;
+	memset(_pins, 0, sizeof(_pins));
+	memset(&_stats, 0, sizeof(_stats));
+}
+
+/*
+ * @brief		Get the socket data received since ModemSim_Reset()
+ * @param[out]	payload Socket data
+ * @return		Number of bytes
+ */
+uint32_t ModemSim_GetPayload(const uint8_t **payload)
+{
+	*payload = _payload;
+	return _payloadLength;
+}
+
+void ModemSim_GetStats(MODEM_SIM_STATS_T *stats)
+{
+	*stats = _stats;
+}
+
+/*
+ * @brief		Queue a response, it reaches the driver after the given time and after earlier responses
+ */
+static void ModemSim_Respond(const char *response, uint32_t ticks)
+{
+	uint32_t time = (uint32_t)CoGetOSTime() + ticks;
+
+	if (_outputCount != 0 && (int32_t)(_outputTimes[(_outputHead + _outputCount - 1) % MODEM_SIM_OUTPUT_SIZE] - time) > 0)
+		time = _outputTimes[(_outputHead + _outputCount - 1) % MODEM_SIM_OUTPUT_SIZE];
+
+	while (*response && _outputCount < MODEM_SIM_OUTPUT_SIZE)
+	{
+		uint16_t tail = (_outputHead + _outputCount++) % MODEM_SIM_OUTPUT_SIZE;
+
+		_output[tail] = *response++;
+		_outputTimes[tail] = time;
+	}
+}
+
+static BOOL ModemSim_OutputReady()
+{
+	return _outputCount != 0 && (int32_t)((uint32_t)CoGetOSTime() - _outputTimes[_outputHead]) >= 0;
+}
+
+static void ModemSim_PutPayload(uint8_t b)
+{
+	if (_payloadLength < MODEM_SIM_PAYLOAD_SIZE)
+		_payload[_payloadLength++] = b;
+}
+
+/*
+ * @brief		Answer an AT command, results are numeric (ATV0)
+ * @param[in]	command Command line without the terminating \r
+ */
+static void ModemSim_Execute(const char *command)
+{
+	char response[MODEM_SIM_LINE_SIZE];
+	unsigned int length;
+	int connMode;
+
+	_stats.commands++;
+
+	if (strncmp(command, "AT", 2) != 0)
+	{
+		ModemSim_Respond("4\r", MODEM_SIM_COMMAND_TICKS);
+		return;
+	}
+	command += 2;
+
+	if (sscanf(command, "#SD=%*d,%*d,%*d,\"%*[^\"]\",%*d,%*d,%d", &connMode) == 1)
+	{
+		// Command mode connections answer OK and stay in command mode
+		_connected = TRUE;
+		_online = connMode == 0;
+		ModemSim_Respond(_online ? "1\r" : "0\r", MODEM_SIM_DIAL_TICKS);
+	}
+	else if (strncmp(command, "#SO=", 4) == 0)
+	{
+		if (!_connected || _online)
+		{
+			ModemSim_Respond("4\r", MODEM_SIM_COMMAND_TICKS);
+			return;
+		}
+
+		_online = TRUE;
+		_stats.restores++;
+		ModemSim_Respond("1\r", MODEM_SIM_RESTORE_TICKS);
+	}
+	else if (sscanf(command, "#SSENDEXT=%*d,%u", &length) == 1)
+	{
+		if (!_connected || length == 0 || length > 1500)
+		{
+			ModemSim_Respond("4\r", MODEM_SIM_COMMAND_TICKS);
+			return;
+		}
+
+		// Prompt isn't terminated, the data follows it
+		_dataExpected = length;
+		_stats.sends++;
+		ModemSim_Respond("> ", MODEM_SIM_COMMAND_TICKS);
+	}
+	else if (strncmp(command, "#SH=", 4) == 0)
+	{
+		_connected = FALSE;
+		_online = FALSE;
+		ModemSim_Respond("0\r", MODEM_SIM_COMMAND_TICKS);
+	}
+	else if (strncmp(command, "#SS=", 4) == 0)
+	{
+		sprintf(response, "#SS: 1,%d\r0\r", _connected ? 2 : 0);
+		ModemSim_Respond(response, MODEM_SIM_COMMAND_TICKS);
+	}
+	else if (strcmp(command, "$GPSACP") == 0)
+	{
+		ModemSim_Respond(MODEM_SIM_GPS_POSITION "\r0\r", MODEM_SIM_COMMAND_TICKS);
+	}
+	else
+	{
+		ModemSim_Respond("0\r", MODEM_SIM_COMMAND_TICKS);
+	}
+}
+
+/*
+ * @brief		Byte from the driver: socket data, or part of an AT command
+ */
+static void ModemSim_Receive(uint8_t b)
+{
+	if (!_powered)
+		return;
+
+	if (_dataExpected != 0)
+	{
+		ModemSim_PutPayload(b);
+		if (--_dataExpected == 0)
+			ModemSim_Respond("0\r", MODEM_SIM_COMMAND_TICKS);
+		return;
+	}
+
+	if (_online)
+	{
+		ModemSim_PutPayload(b);
+		return;
+	}
+
+	if (b == '\r')
+	{
+		_line[_lineLength] = '\0';
+		_lineLength = 0;
+		ModemSim_Execute(_line);
+	}
+	else if (b != '\n' && _lineLength < MODEM_SIM_LINE_SIZE - 1)
+	{
+		_line[_lineLength++] = b;
+	}
+}
+
+/*
+ * @brief		Pass the transfer time of bytes on the UART as OS time
+ */
+static void ModemSim_Transfer(uint32_t bytes)
+{
+	uint32_t ticks;
+
+	// Start bit, 8 data bits and a stop bit
+	_uartTime += bytes * 10 * 1000000000ULL / MODEM_SIM_BITRATE;
+	ticks = _uartTime / MODEM_SIM_TICK_NS;
+	if (ticks != 0)
+	{
+		Host_AdvanceOSTime(ticks);
+		_uartTime -= ticks * MODEM_SIM_TICK_NS;
+	}
+}
+
+uint32_t __wrap_UART_Send(LPC_UART_TypeDef *UARTx, uint8_t *txbuf, uint32_t buflen, TRANSFER_BLOCK_Type flag)
+{
+	uint32_t i;
+
+	for (i = 0; i < buflen; i++)
+		ModemSim_Receive(txbuf[i]);
+
+	ModemSim_Transfer(buflen);
+	return buflen;
+}
+
+uint32_t __wrap_UART_Receive(LPC_UART_TypeDef *UARTx, uint8_t *rxbuf, uint32_t buflen, TRANSFER_BLOCK_Type flag)
+{
+	uint32_t count = 0;
+
+	while (count < buflen && ModemSim_OutputReady())
+	{
+		rxbuf[count++] = _output[_outputHead];
+		_outputHead = (_outputHead + 1) % MODEM_SIM_OUTPUT_SIZE;
+		_outputCount--;
+	}
+
+	return count;
+}
+
+uint32_t __wrap_UART_GetIntId(LPC_UART_TypeDef *UARTx)
+{
+	return ModemSim_OutputReady() ? UART_IIR_INTID_RDA : UART_IIR_INTSTAT_PEND;
+}
+
+/*
+ * @brief		Responses are delivered when the driver touches the RX interrupt, the interrupt of bytes that arrived
+ * 				before it was disabled has run by then
+ */
+void __wrap_UART_IntConfig(LPC_UART_TypeDef *UARTx, UART_INT_Type UARTIntCfg, FunctionalState NewState)
+{
+	if (UARTIntCfg == UART_INTCFG_RBR && ModemSim_OutputReady())
+		UART1_IRQHandler();
+}
+
+void __wrap_UART_Init(LPC_UART_TypeDef *UARTx, UART_CFG_Type *UART_ConfigStruct)
+{
+}
+
+void __wrap_UART_ConfigStructInit(UART_CFG_Type *UART_InitStruct)
+{
+}
+
+void __wrap_UART_FIFOConfig(LPC_UART_TypeDef *UARTx, UART_FIFO_CFG_Type *FIFOCfg)
+{
+}
+
+void __wrap_UART_FIFOConfigStructInit(UART_FIFO_CFG_Type *UART_FIFOInitStruct)
+{
+}
+
+void __wrap_UART_TxCmd(LPC_UART_TypeDef *UARTx, FunctionalState NewState)
+{
+}
+
+void __wrap_PINSEL_ConfigPin(PINSEL_CFG_Type *PinCfg)
+{
+}
+
+void __wrap_GPIO_SetDir(uint8_t portNum, uint32_t bitValue, uint8_t dir)
+{
+}
+
+void __wrap_GPIO_SetValue(uint8_t portNum, uint32_t bitValue)
+{
+	_pins[portNum] |= bitValue;
+}
+
+/*
+ * @brief		Pulses end when the driver clears the pin: SHUTDOWN and RESET power the modem off, ENABLE powers it
+ * 				on and DTR escapes from online mode
+ */
+void __wrap_GPIO_ClearValue(uint8_t portNum, uint32_t bitValue)
+{
+	uint32_t pulses = _pins[portNum] & bitValue;
+
+	_pins[portNum] &= ~bitValue;
+
+	if ((portNum == MODEM_SIM_SHUTDOWN_PORT && (pulses & _BIT(MODEM_SIM_SHUTDOWN_PIN))) ||
+			(portNum == MODEM_SIM_CONTROL_PORT && (pulses & _BIT(MODEM_SIM_RESET_PIN))))
+	{
+		_powered = FALSE;
+		_connected = FALSE;
+		_online = FALSE;
+		_dataExpected = 0;
+		_outputCount = 0;
+	}
+
+	if (portNum != MODEM_SIM_CONTROL_PORT)
+		return;
+
+	if (pulses & _BIT(MODEM_SIM_ENABLE_PIN))
+		_powered = TRUE;
+
+	if ((pulses & _BIT(MODEM_SIM_DTR_PIN)) && _online)
+	{
+		_online = FALSE;
+		_stats.escapes++;
+		ModemSim_Respond("0\r", MODEM_SIM_COMMAND_TICKS);
+	}
+}
+
+/*
+ * @brief		PWRMON is high while the modem is powered, DCD is high unless the socket is in online mode
+ */
+uint32_t __wrap_GPIO_ReadValue(uint8_t portNum)
+{
+	if (portNum != MODEM_SIM_CONTROL_PORT)
+		return 0;
+
+	return (_powered ? _BIT(MODEM_SIM_PWRMON_PIN) : 0) | (!_online ? _BIT(MODEM_SIM_DCD_PIN) : 0);
+}
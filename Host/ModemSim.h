@@ -0,0 +1,46 @@
+/* Name: GM862 modem simulation
+ * Description: The GM862 as seen through UART1 and its control pins, for host programs that run the modem driver.
+ * Programs are linked with --wrap for the peripheral library functions the driver uses (see Makefile). The modem
+ * answers AT commands, keeps one socket in online or command mode and collects the socket data. Time passes in
+ * CoOS ticks: for every byte on the UART and for the modem's response times below.
+ */
+
+#ifndef MODEM_SIM_H
+#define MODEM_SIM_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <CoOs.h>
+
+/* Defines */
+
+// UART1 bitrate, the driver's
+#define MODEM_SIM_BITRATE						115200
+
+// Response times (CoOS ticks): AT commands, dialing a socket (#SD) and restoring it to online mode (#SO)
+#define MODEM_SIM_COMMAND_TICKS					2
+#define MODEM_SIM_DIAL_TICKS					100
+#define MODEM_SIM_RESTORE_TICKS					5
+
+// Socket data collected for the program
+#define MODEM_SIM_PAYLOAD_SIZE					65536
+
+/* Structs */
+
+typedef struct {
+
+	uint32_t commands;		// AT commands answered
+	uint32_t escapes;		// DTR escapes from online mode
+	uint32_t restores;		// #SO restores to online mode
+	uint32_t sends;			// #SSENDEXT commands
+
+} MODEM_SIM_STATS_T;
+
+/* Prototypes */
+
+void ModemSim_Reset();
+uint32_t ModemSim_GetPayload(const uint8_t **payload);
+void ModemSim_GetStats(MODEM_SIM_STATS_T *stats);
+
+#endif
@@ -0,0 +1,605 @@
+/* Name: Telemetry packet decoder
+ * Description: Shore side decoder of the packets of the telemetry task
+ */
+
+/* Includes */
+
+#include <string.h>
+
+#include "PacketDecoder.h"
+#include "Compression.h"
+#include "Misc.h"
+
+/* Defines */
+
+// Sync, size (8 bit), schema version, id and timestamp in front of the tables of a single packet
+#define PACKET_HEADER_SIZE						(3 * sizeof(uint8_t) + 2 * sizeof(uint32_t))
+
+// Sync, size (16 bit), schema version, id and record count in front of the records of a batch packet
+#define PACKET_BATCH_HEADER_SIZE				(3 * sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t))
+
+// Timestamp and tables size in front of the tables of a record
+#define PACKET_RECORD_HEADER_SIZE				(sizeof(uint32_t) + sizeof(uint8_t))
+
+// Largest batch packet: 16 bit size
+#define PACKET_MAX_SIZE							0xFFFF
+
+// Schema table: table ID, aggregate table ID, field index, field count, type, scale and bias before the strings
+#define PACKET_SCHEMA_HEADER_SIZE				(5 * sizeof(uint8_t) + 2 * sizeof(float))
+
+// Flags in the schema version byte
+#define PACKET_FLAGS							(PACKET_FLAG_COMPRESSED | PACKET_FLAG_OUTBOX)
+
+/* Variables */
+
+// Width of a field, indexed by PACKET_FIELD_TYPE
+static const uint8_t _fieldWidths[] = { 1, 1, 2, 2, 4 };
+
+/* Prototypes */
+
+static PACKET_RESULT PacketDecoder_DecodeRecords(PACKET_DECODER_T *decoder, const uint8_t *records, uint16_t size,
+		uint8_t count);
+static int16_t PacketDecoder_PutSchema(PACKET_DECODER_T *decoder, const uint8_t *src, uint16_t size);
+static int16_t PacketDecoder_PutSensorTable(PACKET_DECODER_T *decoder, PACKET_TABLE_T *table, BOOL delta,
+		const uint8_t *src, uint16_t size, uint32_t time);
+static int16_t PacketDecoder_PutAggregate(PACKET_DECODER_T *decoder, PACKET_TABLE_T *table, const uint8_t *src,
+		uint16_t size, uint32_t time);
+static void PacketDecoder_PutFixed(PACKET_DECODER_T *decoder, uint8_t type, const uint8_t *src, uint8_t size,
+		uint32_t time);
+static PACKET_TABLE_T *PacketDecoder_GetTable(PACKET_DECODER_T *decoder, uint8_t id, BOOL *aggregate);
+static void PacketDecoder_RestoreTables(PACKET_DECODER_T *decoder, const PACKET_TABLE_T *saved, uint8_t count);
+static float PacketDecoder_GetFieldValue(const uint8_t *src, uint8_t type);
+
+/* Implementation */
+
+void PacketDecoder_Init(PACKET_DECODER_T *decoder, PACKET_HANDLER_T handler, void *context)
+{
+	memset(decoder, 0, sizeof(PACKET_DECODER_T));
+	decoder->handler = handler;
+	decoder->context = context;
+}
+
+/*
+ * @brief		Decode the packet at the start of a stream of received bytes
+ * @param[in]	data Received bytes, starting with the sync byte
+ * @param[in]	length Number of received bytes
+ * @param[out]	packetLength Size of the packet, bytes to skip to the next one. 1 on a framing error.
+ * @return		PACKET_OK, or the reason the packet (or a table in it) couldn't be decoded
+ */
+PACKET_RESULT PacketDecoder_DecodePacket(PACKET_DECODER_T *decoder, const uint8_t *data, uint16_t length,
+		uint16_t *packetLength)
+{
+	static uint8_t tables[PACKET_MAX_SIZE];
+	static PACKET_TABLE_T saved[PACKET_DECODER_MAX_TABLES];
+	PACKET_RESULT result;
+	uint16_t headerSize, tablesSize, checksum;
+	uint32_t time = 0;
+	uint8_t version, count = 0, savedCount, i;
+
+	*packetLength = 1;
+
+	// Size counts the bytes following the size field
+	if (length < 2)
+		return PACKET_INCOMPLETE;
+	if (data[0] == PACKET_SYNC)
+	{
+		headerSize = PACKET_HEADER_SIZE;
+		*packetLength = 2 + data[1];
+	}
+	else if (data[0] == PACKET_SYNC_BATCH)
+	{
+		if (length < 3)
+			return PACKET_INCOMPLETE;
+
+		headerSize = PACKET_BATCH_HEADER_SIZE;
+		*packetLength = 3 + (data[1] | data[2] << 8);
+	}
+	else
+		return PACKET_FRAMING_ERROR;
+
+	if (*packetLength < headerSize + sizeof(uint16_t))
+	{
+		*packetLength = 1;
+		return PACKET_FRAMING_ERROR;
+	}
+
+	if (length < *packetLength)
+		return PACKET_INCOMPLETE;
+
+	// Checksum covers everything but the sync byte
+	memcpy(&checksum, data + *packetLength - sizeof(uint16_t), sizeof(uint16_t));
+	if (CalculateCrc16((char *)data + 1, *packetLength - 1 - sizeof(uint16_t)) != checksum)
+	{
+		decoder->stats.checksumErrors++;
+		*packetLength = 1;
+		return PACKET_CHECKSUM_ERROR;
+	}
+
+	decoder->stats.packets++;
+
+	if (data[0] == PACKET_SYNC)
+	{
+		version = data[2];
+		memcpy(&time, data + 7, sizeof(uint32_t));
+	}
+	else
+	{
+		version = data[3];
+		count = data[8];
+	}
+
+	// Layouts are learned again for another schema version
+	if ((version & ~PACKET_FLAGS) != decoder->version)
+	{
+		memset(decoder->tables, 0, sizeof(decoder->tables));
+		decoder->tableCount = 0;
+		decoder->version = version & ~PACKET_FLAGS;
+	}
+
+	tablesSize = *packetLength - headerSize - sizeof(uint16_t);
+	if (version & PACKET_FLAG_COMPRESSED)
+	{
+		tablesSize = Compression_Decompress(data + headerSize, tablesSize, tables, sizeof(tables));
+		if (tablesSize == 0)
+			return PACKET_COMPRESSION_ERROR;
+	}
+	else
+		memcpy(tables, data + headerSize, tablesSize);
+
+	// Delta tables of a packet from the outbox are encoded against tables that were decoded before the packets
+	// received since, they apply to full tables in the packet only. The shore side copy is left as it is.
+	savedCount = decoder->tableCount;
+	if (version & PACKET_FLAG_OUTBOX)
+	{
+		decoder->stats.outboxPackets++;
+
+		memcpy(saved, decoder->tables, savedCount * sizeof(PACKET_TABLE_T));
+		for (i = 0; i < savedCount; i++)
+			decoder->tables[i].valid = FALSE;
+	}
+
+	if (data[0] == PACKET_SYNC)
+		result = PacketDecoder_DecodeTables(decoder, tables, tablesSize, time);
+	else
+		result = PacketDecoder_DecodeRecords(decoder, tables, tablesSize, count);
+
+	if (version & PACKET_FLAG_OUTBOX)
+		PacketDecoder_RestoreTables(decoder, saved, savedCount);
+
+	return result;
+}
+
+/*
+ * @brief		Decode the tables of a packet or record, as written by SensorDataManager_GetTables()
+ * @param[in]	tables Uncompressed tables
+ * @param[in]	size Size of the tables
+ * @param[in]	time Unix time of the packet or record
+ * @return		PACKET_OK, or the reason a table couldn't be decoded. Tables following it are skipped.
+ */
+PACKET_RESULT PacketDecoder_DecodeTables(PACKET_DECODER_T *decoder, const uint8_t *tables, uint16_t size,
+		uint32_t time)
+{
+	uint16_t pos = 0;
+
+	while (pos < size)
+	{
+		uint8_t id = tables[pos++];
+		uint16_t left = size - pos;
+		int16_t used;
+
+		switch (id)
+		{
+			case PACKET_TABLE_ID_SCHEMA:
+				used = PacketDecoder_PutSchema(decoder, tables + pos, left);
+				break;
+
+			case PACKET_TABLE_ID_TRACKING:
+				used = sizeof(PACKET_TRACKING_T);
+				if (used <= left)
+					PacketDecoder_PutFixed(decoder, PACKET_EVENT_TRACKING, tables + pos, used, time);
+				break;
+
+			case PACKET_TABLE_ID_CAN_STATISTICS:
+				used = sizeof(PACKET_CAN_STATISTICS_T);
+				if (used <= left)
+					PacketDecoder_PutFixed(decoder, PACKET_EVENT_CAN_STATISTICS, tables + pos, used, time);
+				break;
+
+			case PACKET_TABLE_ID_ALARM:
+				used = sizeof(PACKET_ALARM_T);
+				if (used <= left)
+					PacketDecoder_PutFixed(decoder, PACKET_EVENT_ALARM, tables + pos, used, time);
+				break;
+
+			default:
+			{
+				BOOL aggregate;
+				PACKET_TABLE_T *table = PacketDecoder_GetTable(decoder, id & ~PACKET_TABLE_ID_DELTA, &aggregate);
+
+				// Without the size of the table the tables following it can't be found
+				if (table == NULL || table->size == 0 || (aggregate && (id & PACKET_TABLE_ID_DELTA)))
+				{
+					decoder->stats.unknownTables++;
+					return PACKET_UNKNOWN_TABLE;
+				}
+
+				if (aggregate)
+					used = PacketDecoder_PutAggregate(decoder, table, tables + pos, left, time);
+				else
+					used = PacketDecoder_PutSensorTable(decoder, table, (id & PACKET_TABLE_ID_DELTA) != 0, tables + pos,
+							left, time);
+				break;
+			}
+		}
+
+		if (used < 0 || used > left)
+			return PACKET_TABLE_ERROR;
+
+		decoder->stats.tables++;
+		pos += used;
+	}
+
+	return PACKET_OK;
+}
+
+/*
+ * @brief		Find a sensor table by its table ID
+ * @return		Table, NULL if no schema table described it yet
+ */
+const PACKET_TABLE_T *PacketDecoder_FindTable(const PACKET_DECODER_T *decoder, uint8_t id)
+{
+	uint8_t i;
+
+	for (i = 0; i < decoder->tableCount; i++)
+	{
+		if (decoder->tables[i].id == id)
+			return &decoder->tables[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief		Check if every field of the sensor tables seen so far is described
+ */
+BOOL PacketDecoder_SchemaComplete(const PACKET_DECODER_T *decoder)
+{
+	uint8_t i;
+
+	for (i = 0; i < decoder->tableCount; i++)
+	{
+		if (decoder->tables[i].size == 0)
+			return FALSE;
+	}
+
+	return decoder->tableCount != 0;
+}
+
+PACKET_RESULT PacketDecoder_DecodeRecords(PACKET_DECODER_T *decoder, const uint8_t *records, uint16_t size,
+		uint8_t count)
+{
+	uint16_t pos = 0;
+	uint32_t time;
+	uint8_t i, tablesSize;
+	PACKET_RESULT result = PACKET_OK;
+
+	for (i = 0; i < count; i++)
+	{
+		if (size - pos < PACKET_RECORD_HEADER_SIZE)
+			return PACKET_TABLE_ERROR;
+
+		memcpy(&time, records + pos, sizeof(uint32_t));
+		tablesSize = records[pos + sizeof(uint32_t)];
+		pos += PACKET_RECORD_HEADER_SIZE;
+
+		if (size - pos < tablesSize)
+			return PACKET_TABLE_ERROR;
+
+		// Records have their own size, an unknown table only loses the rest of its record
+		PACKET_RESULT recordResult = PacketDecoder_DecodeTables(decoder, records + pos, tablesSize, time);
+		if (recordResult != PACKET_OK)
+			result = recordResult;
+
+		decoder->stats.records++;
+		pos += tablesSize;
+	}
+
+	return result;
+}
+
+/*
+ * @brief		Learn a field from a schema table
+ * @return		Size of the schema table, -1 if it is cut off
+ */
+int16_t PacketDecoder_PutSchema(PACKET_DECODER_T *decoder, const uint8_t *src, uint16_t size)
+{
+	PACKET_TABLE_T *table;
+	PACKET_FIELD_T *field;
+	const uint8_t *name, *unit, *end;
+	uint8_t id = src[0], aggregateId = src[1], index = src[2], fieldCount = src[3], type = src[4];
+	uint8_t i, offset;
+	BOOL aggregate;
+
+	if (size < PACKET_SCHEMA_HEADER_SIZE + 2)
+		return -1;
+
+	name = src + PACKET_SCHEMA_HEADER_SIZE;
+	end = memchr(name, 0, size - PACKET_SCHEMA_HEADER_SIZE);
+	if (end == NULL)
+		return -1;
+	unit = end + 1;
+	end = memchr(unit, 0, src + size - unit);
+	if (end == NULL)
+		return -1;
+
+	// Fields the decoder can't hold are skipped, other tables stay decodable
+	if (index >= fieldCount || fieldCount > PACKET_DECODER_MAX_FIELDS || type >= sizeof(_fieldWidths))
+		return end + 1 - src;
+
+	table = PacketDecoder_GetTable(decoder, id, &aggregate);
+	if (table == NULL || aggregate || table->fieldCount != fieldCount)
+	{
+		// New table, or a table with another layout
+		if (table == NULL || aggregate)
+		{
+			if (decoder->tableCount == PACKET_DECODER_MAX_TABLES)
+				return end + 1 - src;
+			table = &decoder->tables[decoder->tableCount++];
+		}
+
+		memset(table, 0, sizeof(PACKET_TABLE_T));
+		table->id = id;
+		table->fieldCount = fieldCount;
+	}
+
+	table->aggregateId = aggregateId;
+
+	field = &table->fields[index];
+	field->type = type;
+	memcpy(&field->scale, src + 5, sizeof(float));
+	memcpy(&field->bias, src + 5 + sizeof(float), sizeof(float));
+	strncpy(field->name, (const char *)name, PACKET_DECODER_NAME_SIZE - 1);
+	strncpy(field->unit, (const char *)unit, PACKET_DECODER_UNIT_SIZE - 1);
+	table->described |= _BIT(index);
+
+	// Fields follow the timestamp in field order
+	if (table->described == (1UL << fieldCount) - 1)
+	{
+		offset = sizeof(uint32_t);
+		for (i = 0; i < fieldCount; i++)
+		{
+			table->fields[i].offset = offset;
+			offset += _fieldWidths[table->fields[i].type];
+		}
+		table->size = offset;
+	}
+
+	return end + 1 - src;
+}
+
+/*
+ * @brief		Apply a full or delta sensor table to the shore side copy
+ * @return		Size of the table, -1 if it is cut off
+ */
+int16_t PacketDecoder_PutSensorTable(PACKET_DECODER_T *decoder, PACKET_TABLE_T *table, BOOL delta,
+		const uint8_t *src, uint16_t size, uint32_t time)
+{
+	PACKET_EVENT_T event;
+	uint16_t fields = (1UL << table->fieldCount) - 1;
+	uint16_t used;
+	uint8_t i;
+
+	if (!delta)
+	{
+		if (size < table->size)
+			return -1;
+
+		memcpy(table->table, src, table->size);
+		table->valid = TRUE;
+		used = table->size;
+	}
+	else
+	{
+		// Timestamp, field bitmap and the fields in the bitmap
+		if (size < sizeof(uint32_t) + sizeof(uint16_t))
+			return -1;
+
+		memcpy(&fields, src + sizeof(uint32_t), sizeof(uint16_t));
+		used = sizeof(uint32_t) + sizeof(uint16_t);
+		for (i = 0; i < table->fieldCount; i++)
+		{
+			if (fields & _BIT(i))
+				used += _fieldWidths[table->fields[i].type];
+		}
+
+		if (size < used)
+			return -1;
+
+		// Fields that aren't included are those of the last full table
+		if (!table->valid)
+		{
+			decoder->stats.deltasSkipped++;
+			return used;
+		}
+
+		memcpy(table->table, src, sizeof(uint32_t));
+		used = sizeof(uint32_t) + sizeof(uint16_t);
+		for (i = 0; i < table->fieldCount; i++)
+		{
+			if (!(fields & _BIT(i)))
+				continue;
+
+			memcpy(table->table + table->fields[i].offset, src + used, _fieldWidths[table->fields[i].type]);
+			used += _fieldWidths[table->fields[i].type];
+		}
+	}
+
+	for (i = 0; i < table->fieldCount; i++)
+	{
+		const PACKET_FIELD_T *field = &table->fields[i];
+
+		table->values[i] = PacketDecoder_GetFieldValue(table->table + field->offset, field->type) * field->scale +
+				field->bias;
+	}
+
+	if (decoder->handler != NULL)
+	{
+		event.type = PACKET_EVENT_TABLE;
+		event.time = time;
+		event.table = table;
+		event.delta = delta;
+		event.fields = fields;
+		event.data = src;
+		event.size = used;
+		decoder->handler(decoder->context, &event);
+	}
+
+	return used;
+}
+
+/*
+ * @brief		Decode an aggregate table: timestamp, frame count and min, max and mean of every field
+ * @return		Size of the table, -1 if it is cut off
+ */
+int16_t PacketDecoder_PutAggregate(PACKET_DECODER_T *decoder, PACKET_TABLE_T *table, const uint8_t *src,
+		uint16_t size, uint32_t time)
+{
+	PACKET_EVENT_T event;
+	uint16_t used = sizeof(uint32_t) + sizeof(uint16_t);
+	uint8_t i;
+
+	if (size < used + 3 * (table->size - sizeof(uint32_t)))
+		return -1;
+
+	memcpy(&table->aggregateFrames, src + sizeof(uint32_t), sizeof(uint16_t));
+
+	for (i = 0; i < table->fieldCount; i++)
+	{
+		const PACKET_FIELD_T *field = &table->fields[i];
+		uint8_t width = _fieldWidths[field->type];
+
+		table->min[i] = PacketDecoder_GetFieldValue(src + used, field->type) * field->scale + field->bias;
+		table->max[i] = PacketDecoder_GetFieldValue(src + used + width, field->type) * field->scale + field->bias;
+		table->mean[i] = PacketDecoder_GetFieldValue(src + used + 2 * width, field->type) * field->scale + field->bias;
+		used += 3 * width;
+	}
+
+	if (decoder->handler != NULL)
+	{
+		event.type = PACKET_EVENT_AGGREGATE;
+		event.time = time;
+		event.table = table;
+		event.delta = FALSE;
+		event.fields = (1UL << table->fieldCount) - 1;
+		event.data = src;
+		event.size = used;
+		decoder->handler(decoder->context, &event);
+	}
+
+	return used;
+}
+
+void PacketDecoder_PutFixed(PACKET_DECODER_T *decoder, uint8_t type, const uint8_t *src, uint8_t size,
+		uint32_t time)
+{
+	PACKET_EVENT_T event;
+
+	if (decoder->handler == NULL)
+		return;
+
+	event.type = type;
+	event.time = time;
+	event.table = NULL;
+	event.delta = FALSE;
+	event.fields = 0;
+	event.data = src;
+	event.size = size;
+	decoder->handler(decoder->context, &event);
+}
+
+/*
+ * @brief		Find a sensor table by its table ID or the ID of its aggregate table
+ * @param[out]	aggregate TRUE if the ID is that of the aggregate table
+ * @return		Table, NULL if no schema table described it yet
+ */
+PACKET_TABLE_T *PacketDecoder_GetTable(PACKET_DECODER_T *decoder, uint8_t id, BOOL *aggregate)
+{
+	uint8_t i;
+
+	for (i = 0; i < decoder->tableCount; i++)
+	{
+		PACKET_TABLE_T *table = &decoder->tables[i];
+
+		if (table->id == id || (table->aggregateId != 0 && table->aggregateId == id))
+		{
+			*aggregate = table->id != id;
+			return table;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * @brief		Restore the values of the sensor tables after a packet from the outbox, layouts it described are kept
+ * @param[in]	saved Tables before the packet
+ * @param[in]	count Number of tables before the packet, tables the packet described have no values yet
+ * @return		None
+ */
+void PacketDecoder_RestoreTables(PACKET_DECODER_T *decoder, const PACKET_TABLE_T *saved, uint8_t count)
+{
+	uint8_t i;
+
+	for (i = 0; i < decoder->tableCount; i++)
+	{
+		PACKET_TABLE_T *table = &decoder->tables[i];
+
+		if (i >= count)
+		{
+			table->valid = FALSE;
+			continue;
+		}
+
+		table->valid = saved[i].valid;
+		memcpy(table->table, saved[i].table, sizeof(table->table));
+		memcpy(table->values, saved[i].values, sizeof(table->values));
+
+		table->aggregateFrames = saved[i].aggregateFrames;
+		memcpy(table->min, saved[i].min, sizeof(table->min));
+		memcpy(table->max, saved[i].max, sizeof(table->max));
+		memcpy(table->mean, saved[i].mean, sizeof(table->mean));
+	}
+}
+
+float PacketDecoder_GetFieldValue(const uint8_t *src, uint8_t type)
+{
+	switch (type)
+	{
+		case PACKET_FIELD_UINT8:
+			return *src;
+
+		case PACKET_FIELD_INT8:
+			return (int8_t)*src;
+
+		case PACKET_FIELD_UINT16:
+		{
+			uint16_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+
+		case PACKET_FIELD_INT16:
+		{
+			int16_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+
+		default:
+		{
+			float value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+	}
+}
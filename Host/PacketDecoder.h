@@ -0,0 +1,205 @@
+/* Name: Telemetry packet decoder
+ * Description: Shore side decoder of the packets of the telemetry task. Sensor table layouts are learned from the
+ * schema tables in the packets (see SensorDataManager.c), so adding a channel only touches the firmware field list.
+ * Tables with a fixed layout (tracking, CAN statistics and alarms) are passed on as they are.
+ */
+
+#ifndef PACKET_DECODER_H
+#define PACKET_DECODER_H
+
+/* Includes */
+
+#include <stdint.h>
+
+#include <CoOs.h>
+
+/* Defines */
+
+#define PACKET_DECODER_MAX_TABLES				8
+#define PACKET_DECODER_MAX_FIELDS				16
+#define PACKET_DECODER_NAME_SIZE				24
+#define PACKET_DECODER_UNIT_SIZE				8
+
+// Largest sensor table: timestamp and the widest fields
+#define PACKET_DECODER_MAX_TABLE_SIZE			(sizeof(uint32_t) + PACKET_DECODER_MAX_FIELDS * sizeof(float))
+
+// Sync/sof bytes of single packets and batch packets
+#define PACKET_SYNC								'$'
+#define PACKET_SYNC_BATCH						'#'
+
+// Set in the schema version byte of packets with compressed tables (records), and of packets sent again from the
+// outbox. Those arrive after packets packed later, their delta tables apply to their own full tables only.
+#define PACKET_FLAG_COMPRESSED					0x80
+#define PACKET_FLAG_OUTBOX						0x40
+
+// Table IDs with a fixed layout, and the delta flag of sensor tables (see TABLE_ID in SensorDataManager.c)
+#define PACKET_TABLE_ID_TRACKING				0x02
+#define PACKET_TABLE_ID_CAN_STATISTICS			0x05
+#define PACKET_TABLE_ID_SCHEMA					0x0A
+#define PACKET_TABLE_ID_ALARM					0x0B
+#define PACKET_TABLE_ID_DELTA					0x80
+
+// Entries of the CAN filter list in SensorDataManager.c, the CAN statistics table has a frame counter for each
+#define PACKET_CAN_FILTER_COUNT					11
+#define PACKET_CAN_CONTROLLER_COUNT				2
+
+/* Enumerators */
+
+typedef enum {
+
+	PACKET_OK								= 0,
+	PACKET_INCOMPLETE						= 1,	// more bytes are needed
+	PACKET_FRAMING_ERROR					= 2,	// no sync byte or an impossible size
+	PACKET_CHECKSUM_ERROR					= 3,
+	PACKET_COMPRESSION_ERROR				= 4,
+	PACKET_UNKNOWN_TABLE					= 5,	// layout not (yet) known, the rest of the tables is skipped
+	PACKET_TABLE_ERROR						= 6		// table runs past the end of the tables
+
+} PACKET_RESULT;
+
+// FIELD_TYPE of SensorDataManager.c
+typedef enum {
+
+	PACKET_FIELD_UINT8						= 0,
+	PACKET_FIELD_INT8						= 1,
+	PACKET_FIELD_UINT16						= 2,
+	PACKET_FIELD_INT16						= 3,
+	PACKET_FIELD_FLOAT						= 4
+
+} PACKET_FIELD_TYPE;
+
+typedef enum {
+
+	PACKET_EVENT_TABLE						= 0,	// full or delta sensor table applied
+	PACKET_EVENT_AGGREGATE					= 1,	// aggregate table of a sensor table
+	PACKET_EVENT_TRACKING					= 2,
+	PACKET_EVENT_CAN_STATISTICS				= 3,
+	PACKET_EVENT_ALARM						= 4
+
+} PACKET_EVENT_TYPE;
+
+/* Structs */
+
+typedef struct {
+
+	uint8_t type;				// PACKET_FIELD_TYPE
+	uint8_t offset;				// byte offset in table
+	float scale;				// value of one unit
+	float bias;					// value at zero
+	char name[PACKET_DECODER_NAME_SIZE];
+	char unit[PACKET_DECODER_UNIT_SIZE];
+
+} PACKET_FIELD_T;
+
+// Sensor table as learned from schema tables, with the shore side copy of its values
+typedef struct {
+
+	uint8_t id;
+	uint8_t aggregateId;
+	uint8_t fieldCount;
+	uint16_t described;			// fields described by schema tables (bit per field)
+	uint8_t size;				// of a full table, once every field is described
+	PACKET_FIELD_T fields[PACKET_DECODER_MAX_FIELDS];
+
+	BOOL valid;					// a full table was received, delta tables apply to it
+	uint8_t table[PACKET_DECODER_MAX_TABLE_SIZE];	// as packed by the firmware
+	float values[PACKET_DECODER_MAX_FIELDS];		// in the unit of the field
+
+	uint16_t aggregateFrames;	// frames in the aggregate window of the last aggregate table
+	float min[PACKET_DECODER_MAX_FIELDS];
+	float max[PACKET_DECODER_MAX_FIELDS];
+	float mean[PACKET_DECODER_MAX_FIELDS];
+
+} PACKET_TABLE_T;
+
+typedef struct {
+
+	uint8_t type;				// PACKET_EVENT_TYPE
+	uint32_t time;				// unix time of the packet or record
+	const PACKET_TABLE_T *table;	// sensor table of table and aggregate events
+	BOOL delta;					// delta table, the other fields are those of the last full table
+	uint16_t fields;			// fields in the table (bit per field)
+	const uint8_t *data;		// table following the table ID, of fixed layout events
+	uint8_t size;
+
+} PACKET_EVENT_T;
+
+typedef void (*PACKET_HANDLER_T)(void *context, const PACKET_EVENT_T *event);
+
+typedef struct {
+
+	uint32_t packets;
+	uint32_t records;
+	uint32_t tables;
+	uint32_t checksumErrors;
+	uint32_t unknownTables;		// tables skipped because their layout isn't known yet
+	uint32_t deltasSkipped;		// delta tables without a full table to apply them to
+	uint32_t outboxPackets;		// packets sent again from the outbox
+
+} PACKET_DECODER_STATS_T;
+
+typedef struct {
+
+	uint8_t version;			// schema version the tables were learned with
+	PACKET_TABLE_T tables[PACKET_DECODER_MAX_TABLES];
+	uint8_t tableCount;
+
+	PACKET_HANDLER_T handler;
+	void *context;
+
+	PACKET_DECODER_STATS_T stats;
+
+} PACKET_DECODER_T;
+
+// Fixed layout tables, following the table ID
+typedef struct {
+
+	uint32_t latitude;
+	uint32_t longitude;
+	uint16_t sog;
+	uint8_t nsat;
+	uint8_t fix;
+
+} PACKET_TRACKING_T;
+
+typedef struct {
+
+	uint16_t ringOverflows __attribute__ ((__packed__));
+	uint16_t dataOverruns __attribute__ ((__packed__));
+	uint8_t errorPassive __attribute__ ((__packed__));
+	uint8_t busOff __attribute__ ((__packed__));
+	uint8_t peakRingOccupancy __attribute__ ((__packed__));
+	uint8_t load __attribute__ ((__packed__));
+
+} PACKET_CAN_BUS_T;
+
+typedef struct {
+
+	uint16_t frameCounts[PACKET_CAN_FILTER_COUNT] __attribute__ ((__packed__));
+	PACKET_CAN_BUS_T buses[PACKET_CAN_CONTROLLER_COUNT] __attribute__ ((__packed__));
+
+} PACKET_CAN_STATISTICS_T;
+
+typedef struct {
+
+	uint8_t rule __attribute__ ((__packed__));
+	uint8_t table __attribute__ ((__packed__));
+	uint8_t field __attribute__ ((__packed__));
+	uint8_t condition __attribute__ ((__packed__));
+	uint8_t active __attribute__ ((__packed__));
+	float value __attribute__ ((__packed__));
+	uint32_t delay __attribute__ ((__packed__));
+
+} PACKET_ALARM_T;
+
+/* Prototypes */
+
+void PacketDecoder_Init(PACKET_DECODER_T *decoder, PACKET_HANDLER_T handler, void *context);
+PACKET_RESULT PacketDecoder_DecodePacket(PACKET_DECODER_T *decoder, const uint8_t *data, uint16_t length,
+		uint16_t *packetLength);
+PACKET_RESULT PacketDecoder_DecodeTables(PACKET_DECODER_T *decoder, const uint8_t *tables, uint16_t size,
+		uint32_t time);
+const PACKET_TABLE_T *PacketDecoder_FindTable(const PACKET_DECODER_T *decoder, uint8_t id);
+BOOL PacketDecoder_SchemaComplete(const PACKET_DECODER_T *decoder);
+
+#endif
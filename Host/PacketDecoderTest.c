@@ -0,0 +1,384 @@
+/* Name: Telemetry packet decoder test
+ * Description: Packs synthetic sensor bus traffic into packets like the telemetry task and decodes them with the
+ * packet decoder. Checks that the decoder learns every sensor table from the schema tables, that full tables
+ * match the firmware's tables, that batch packets and damaged packets are handled, and the decode rate.
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SensorDataManager.h"
+#include "Compression.h"
+#include "HostStubs.h"
+#include "PacketDecoder.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Packets packed by the test, the intervals tried to pack them, and the frames decoded between intervals
+#define TEST_PACKETS							400
+#define TEST_INTERVALS							(4 * TEST_PACKETS)
+#define TEST_FRAMES_PER_PACKET					(4 * SYNTHETIC_FRAMES_PER_ROUND)
+
+// Tables of a single packet (TELEMETRY_TABLES_SIZE) and records per batch packet (TELEMETRY_BATCH_SIZE)
+#define TEST_TABLES_SIZE						243
+#define TEST_BATCH_SIZE							4
+
+// Ticks between packets (TELEMETRY_INTERVAL)
+#define TEST_PACKET_TICKS						(3 * CFG_SYSTICK_FREQ / 2)
+
+// Largest packet: a batch of full records
+#define TEST_PACKET_SIZE						(16 + TEST_BATCH_SIZE * (5 + TEST_TABLES_SIZE))
+
+// Times every packet is decoded for the decode rate
+#define TEST_RATE_ROUNDS						50
+
+// Sensor table IDs (TABLE_ID in SensorDataManager.c)
+#define TEST_TABLE_ID_BMS						0x01
+#define TEST_TABLE_ID_TEMPERATURE				0x04
+#define TEST_TABLE_ID_MPPT						0x08
+#define TEST_TABLE_ID_MPPT_AGGREGATE			0x09
+#define TEST_SENSOR_TABLES						3
+
+/* Structs */
+
+typedef struct {
+
+	uint8_t data[TEST_PACKET_SIZE];
+	uint16_t length;
+
+} TEST_PACKET_T;
+
+/* Variables */
+
+static TEST_PACKET_T _packets[TEST_PACKETS];
+static uint32_t _packetCount;
+static uint32_t _packetId;
+
+static PACKET_DECODER_T _decoder;
+static uint8_t _fullTables; // sensor table IDs sent in full in the decoded packet (bit per DECODER_TABLE)
+static uint32_t _events[PACKET_EVENT_ALARM + 1];
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("PacketDecoderTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+/*
+ * @brief		Frame tables like TelemetryTask_SendPacket()
+ */
+static void MakePacket(TEST_PACKET_T *packet, const uint8_t *tables, uint16_t tablesSize, uint32_t time)
+{
+	uint8_t compressed[TEST_TABLES_SIZE];
+	uint16_t compressedSize, checksum;
+	uint8_t version = SENSOR_SCHEMA_VERSION;
+
+	compressedSize = Compression_Compress(tables, tablesSize, compressed, tablesSize - 1);
+	if (compressedSize != 0)
+	{
+		tables = compressed;
+		tablesSize = compressedSize;
+		version |= PACKET_FLAG_COMPRESSED;
+	}
+
+	packet->data[0] = PACKET_SYNC;
+	packet->data[1] = 2 * sizeof(uint32_t) + sizeof(uint8_t) + tablesSize + sizeof(uint16_t);
+	packet->data[2] = version;
+	memcpy(packet->data + 3, &_packetId, sizeof(uint32_t));
+	memcpy(packet->data + 7, &time, sizeof(uint32_t));
+	memcpy(packet->data + 11, tables, tablesSize);
+	checksum = CalculateCrc16((char *)packet->data + 1, 10 + tablesSize);
+	memcpy(packet->data + 11 + tablesSize, &checksum, sizeof(uint16_t));
+
+	packet->length = 13 + tablesSize;
+	_packetId++;
+}
+
+/*
+ * @brief		Frame records like TelemetryTask_SendBatch(), uncompressed
+ */
+static void MakeBatch(TEST_PACKET_T *packet, const uint8_t *records, uint16_t recordsSize, uint8_t count)
+{
+	uint16_t size = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + recordsSize + sizeof(uint16_t);
+	uint16_t checksum;
+
+	packet->data[0] = PACKET_SYNC_BATCH;
+	memcpy(packet->data + 1, &size, sizeof(uint16_t));
+	packet->data[3] = SENSOR_SCHEMA_VERSION;
+	memcpy(packet->data + 4, &_packetId, sizeof(uint32_t));
+	packet->data[8] = count;
+	memcpy(packet->data + 9, records, recordsSize);
+	checksum = CalculateCrc16((char *)packet->data + 1, 8 + recordsSize);
+	memcpy(packet->data + 9 + recordsSize, &checksum, sizeof(uint16_t));
+
+	packet->length = 11 + recordsSize;
+	_packetId++;
+}
+
+static void PutFrames(uint32_t interval)
+{
+	CAN_MSG_Type msg;
+	uint32_t i;
+
+	for (i = 0; i < TEST_FRAMES_PER_PACKET; i++)
+	{
+		SyntheticTraffic_MakeFrame(interval * TEST_FRAMES_PER_PACKET + i, &msg);
+		SensorDataManager_PutCanData(&msg, CAN2_CTRL, interval * 1000 + i);
+	}
+}
+
+static void HandleEvent(void *context, const PACKET_EVENT_T *event)
+{
+	uint8_t index;
+
+	_events[event->type]++;
+
+	// Remember full tables, they must equal the firmware's tables
+	if (event->type == PACKET_EVENT_TABLE && !event->delta)
+	{
+		index = event->table - _decoder.tables;
+		_fullTables |= _BIT(index);
+	}
+}
+
+/*
+ * @brief		Compare the full tables of the decoded packet with a snapshot of the firmware's tables
+ */
+static void CheckFullTables()
+{
+	static PACKET_DECODER_T snapshotDecoder;
+	uint8_t snapshot[TEST_TABLES_SIZE];
+	uint8_t size, i;
+
+	// Snapshot holds full tables only, every one of them must be known once the schema is complete
+	if (!PacketDecoder_SchemaComplete(&_decoder) || _decoder.tableCount != TEST_SENSOR_TABLES)
+		return;
+
+	size = SensorDataManager_GetSnapshot(snapshot, sizeof(snapshot));
+	snapshotDecoder = _decoder;
+	snapshotDecoder.handler = NULL;
+	CHECK(PacketDecoder_DecodeTables(&snapshotDecoder, snapshot, size, 0) == PACKET_OK);
+
+	for (i = 0; i < _decoder.tableCount; i++)
+	{
+		const PACKET_TABLE_T *table = &_decoder.tables[i];
+
+		if (_fullTables & _BIT(i))
+			CHECK(memcmp(table->table, snapshotDecoder.tables[i].table, table->size) == 0);
+	}
+}
+
+static void CheckSchema()
+{
+	static const char *mpptNames[] = { "currentIn1", "voltageIn4", "voltageOut1", "powerIn4" };
+	static const uint8_t mpptFields[] = { 0, 7, 8, 15 };
+	const PACKET_TABLE_T *table;
+	uint8_t i;
+
+	CHECK(PacketDecoder_SchemaComplete(&_decoder));
+	CHECK(_decoder.tableCount == TEST_SENSOR_TABLES);
+	CHECK(_decoder.version == SENSOR_SCHEMA_VERSION);
+
+	table = PacketDecoder_FindTable(&_decoder, TEST_TABLE_ID_BMS);
+	CHECK(table != NULL && table->fieldCount == 5 && table->size == 12);
+	CHECK(table != NULL && strcmp(table->fields[0].name, "voltage") == 0);
+	CHECK(table != NULL && strcmp(table->fields[3].unit, "%") == 0 && table->fields[3].type == PACKET_FIELD_UINT8);
+
+	table = PacketDecoder_FindTable(&_decoder, TEST_TABLE_ID_MPPT);
+	CHECK(table != NULL && table->fieldCount == 16 && table->size == 36);
+	CHECK(table != NULL && table->aggregateId == TEST_TABLE_ID_MPPT_AGGREGATE);
+	for (i = 0; table != NULL && i < sizeof(mpptFields); i++)
+		CHECK(strcmp(table->fields[mpptFields[i]].name, mpptNames[i]) == 0);
+	CHECK(table != NULL && table->fields[0].scale == 0.001f && strcmp(table->fields[0].unit, "A") == 0);
+
+	table = PacketDecoder_FindTable(&_decoder, TEST_TABLE_ID_TEMPERATURE);
+	CHECK(table != NULL && table->fieldCount == 7 && table->size == 11);
+	CHECK(table != NULL && strcmp(table->fields[6].name, "reference") == 0);
+}
+
+/*
+ * @brief		Values of the synthetic traffic in the decoded tables, in the units of the schema
+ */
+static void CheckValues()
+{
+	const PACKET_TABLE_T *table;
+	uint8_t i;
+
+	table = PacketDecoder_FindTable(&_decoder, TEST_TABLE_ID_MPPT);
+	CHECK(table != NULL && table->valid);
+	for (i = 0; table != NULL && i < 4; i++)
+	{
+		CHECK(table->values[i] >= 0 && table->values[i] <= 10.0f);		// currentIn, A
+		CHECK(table->values[4 + i] >= 40.0f && table->values[4 + i] <= 50.0f);	// voltageIn, V
+	}
+
+	table = PacketDecoder_FindTable(&_decoder, TEST_TABLE_ID_TEMPERATURE);
+	CHECK(table != NULL && table->valid && table->values[0] >= 25 && table->values[0] <= 28);
+}
+
+static void TestDamagedPackets()
+{
+	TEST_PACKET_T packet = _packets[_packetCount - 1];
+	PACKET_DECODER_T decoder = _decoder;
+	uint16_t packetLength;
+
+	decoder.handler = NULL;
+
+	CHECK(PacketDecoder_DecodePacket(&decoder, packet.data, packet.length, &packetLength) == PACKET_OK);
+	CHECK(packetLength == packet.length);
+
+	CHECK(PacketDecoder_DecodePacket(&decoder, packet.data, packet.length - 1, &packetLength) == PACKET_INCOMPLETE);
+	CHECK(PacketDecoder_DecodePacket(&decoder, packet.data + 1, packet.length - 1, &packetLength) ==
+			PACKET_FRAMING_ERROR && packetLength == 1);
+
+	packet.data[packet.length / 2] ^= 0x10;
+	CHECK(PacketDecoder_DecodePacket(&decoder, packet.data, packet.length, &packetLength) == PACKET_CHECKSUM_ERROR);
+	CHECK(decoder.stats.checksumErrors == _decoder.stats.checksumErrors + 1);
+}
+
+static void TestBatch()
+{
+	uint8_t records[TEST_BATCH_SIZE * (5 + TEST_TABLES_SIZE)];
+	uint16_t recordsSize = 0, packetLength;
+	uint32_t recordsBefore = _decoder.stats.records;
+	TEST_PACKET_T packet;
+	uint8_t i;
+
+	// Full tables in the first record, deltas in the others
+	SensorDataManager_RequestKeyframe();
+	for (i = 0; i < TEST_BATCH_SIZE; i++)
+	{
+		uint32_t time = 1000 + i;
+
+		PutFrames(TEST_INTERVALS + i);
+		Host_AdvanceOSTime(TEST_PACKET_TICKS);
+
+		memcpy(records + recordsSize, &time, sizeof(uint32_t));
+		records[recordsSize + 4] = SensorDataManager_GetTables(records + recordsSize + 5, TEST_TABLES_SIZE);
+		SensorDataManager_AcknowledgeTables(TRUE);
+		recordsSize += 5 + records[recordsSize + 4];
+	}
+
+	MakeBatch(&packet, records, recordsSize, TEST_BATCH_SIZE);
+
+	_fullTables = 0;
+	CHECK(PacketDecoder_DecodePacket(&_decoder, packet.data, packet.length, &packetLength) == PACKET_OK);
+	CHECK(_decoder.stats.records == recordsBefore + TEST_BATCH_SIZE);
+	CheckValues();
+}
+
+static void TestDecodeRate()
+{
+	PACKET_DECODER_T decoder = _decoder;
+	uint64_t start, elapsed;
+	uint32_t round, i, bytes = 0;
+	uint16_t packetLength;
+	BOOL ok = TRUE;
+
+	decoder.handler = NULL;
+
+	start = Host_GetNanoseconds();
+	for (round = 0; round < TEST_RATE_ROUNDS; round++)
+	{
+		for (i = 0; i < _packetCount; i++)
+		{
+			if (PacketDecoder_DecodePacket(&decoder, _packets[i].data, _packets[i].length, &packetLength) != PACKET_OK)
+				ok = FALSE;
+			bytes += _packets[i].length;
+		}
+	}
+	elapsed = Host_GetNanoseconds() - start;
+
+	CHECK(ok);
+
+	printf("Decode rate: %.0f packets/s (%.1f bytes/packet)\n",
+			TEST_RATE_ROUNDS * _packetCount * 1e9 / elapsed, (double)bytes / (TEST_RATE_ROUNDS * _packetCount));
+
+	// Shore side must keep up with thousands of packets per second
+	CHECK(TEST_RATE_ROUNDS * _packetCount * 1e9 / elapsed > 10000);
+}
+
+int main()
+{
+	uint8_t tables[TEST_TABLES_SIZE];
+	uint16_t tablesSize, packetLength;
+	uint32_t interval, schemaPacket = 0, unknownAfterSchema = 0;
+	TEST_PACKET_T *packet;
+	PACKET_RESULT result;
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	// Connection opened, like the telemetry task
+	SensorDataManager_RequestSchema();
+	PacketDecoder_Init(&_decoder, HandleEvent, NULL);
+
+	for (interval = 0; interval < TEST_INTERVALS && _packetCount < TEST_PACKETS; interval++)
+	{
+		PutFrames(interval);
+		Host_AdvanceOSTime(TEST_PACKET_TICKS);
+
+		// Nothing to send when no value left its deadband or the byte budget is used up
+		tablesSize = SensorDataManager_GetTables(tables, sizeof(tables));
+		if (tablesSize == 0)
+			continue;
+		SensorDataManager_AcknowledgeTables(TRUE);
+
+		packet = &_packets[_packetCount++];
+		MakePacket(packet, tables, tablesSize, interval);
+
+		_fullTables = 0;
+		result = PacketDecoder_DecodePacket(&_decoder, packet->data, packet->length, &packetLength);
+		CHECK(packetLength == packet->length);
+
+		// Until the schema is complete tables behind an undescribed one are skipped
+		if (schemaPacket == 0 && PacketDecoder_SchemaComplete(&_decoder) && _decoder.tableCount == TEST_SENSOR_TABLES)
+			schemaPacket = _packetCount;
+		if (schemaPacket == 0)
+			CHECK(result == PACKET_OK || result == PACKET_UNKNOWN_TABLE);
+		else if (result != PACKET_OK)
+			unknownAfterSchema++;
+
+		CheckFullTables();
+	}
+
+	printf("%u packets in %u intervals, schema learned after %u packets, %u tables skipped before\n", _packetCount,
+			interval, schemaPacket, _decoder.stats.unknownTables);
+
+	CHECK(_packetCount == TEST_PACKETS);
+	CHECK(schemaPacket != 0);
+	CHECK(unknownAfterSchema == 0);
+	CHECK(_events[PACKET_EVENT_TABLE] != 0 && _events[PACKET_EVENT_CAN_STATISTICS] != 0);
+	CheckSchema();
+	CheckValues();
+	TestDamagedPackets();
+	TestBatch();
+	TestDecodeRate();
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,177 @@
+/* Name: Socket send path test
+ * Description: Runs the modem driver against the modem simulation on both send paths, with packets and GPS queries
+ * at the intervals of the telemetry task. Checks that every packet reaches the socket intact and compares the
+ * per-packet latency of the transparent (online mode) path and the command mode (#SSENDEXT) path.
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "GM862.h"
+#include "ModemSim.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Packets sent on each path
+#define TEST_PACKETS							80
+
+// Intervals of the telemetry task (TELEMETRY_INTERVAL, TELEMETRY_GPS_INTERVAL) and its socket
+#define TEST_PACKET_INTERVAL					(3 * CFG_SYSTICK_FREQ / 2)
+#define TEST_GPS_INTERVAL						(4 * CFG_SYSTICK_FREQ)
+#define TEST_PORT								88
+
+// Packet sizes, a single packet up to a full batch
+#define TEST_PACKET_MIN_SIZE					20
+#define TEST_PACKET_MAX_SIZE					500
+
+/* Structs */
+
+typedef struct {
+
+	uint32_t packetTicks;		// sending packets, GPS queries included
+	uint32_t maxPacketTicks;
+	uint64_t sendTicks;			// in GM862_SendThroughSocket()
+	uint32_t gpsQueries;
+	uint32_t gpsTicks;
+
+} TEST_RESULT_T;
+
+/* Variables */
+
+static uint8_t _sent[TEST_PACKETS * TEST_PACKET_MAX_SIZE];
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("SendPathTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+static uint32_t Now()
+{
+	return (uint32_t)CoGetOSTime();
+}
+
+/*
+ * @brief		Send packets like the telemetry task, the GPS cache is refreshed between packets when due
+ * @param[in]	path Send path
+ * @param[out]	result Time spent per packet and per GPS query
+ * @return		None
+ */
+static void RunPath(GM862_SEND_PATH path, TEST_RESULT_T *result)
+{
+	static uint8_t packet[TEST_PACKET_MAX_SIZE];
+	GM862_GPS_DATA gpsData;
+	GM862_SEND_STATS_T sendStats;
+	MODEM_SIM_STATS_T simStats;
+	const uint8_t *payload;
+	uint32_t sentLength = 0, gpsTime, start, fixTime;
+	uint16_t length, i, n;
+
+	memset(result, 0, sizeof(TEST_RESULT_T));
+
+	ModemSim_Reset();
+	CHECK(GM862_Init());
+	GM862_SetSendPath(path);
+	CHECK(GM862_OpenSocket("127.0.0.1", TEST_PORT));
+	gpsTime = Now() - TEST_GPS_INTERVAL;
+
+	for (n = 0; n < TEST_PACKETS; n++)
+	{
+		uint32_t packetStart = Now();
+
+		length = TEST_PACKET_MIN_SIZE + n * 37 % (TEST_PACKET_MAX_SIZE - TEST_PACKET_MIN_SIZE);
+		for (i = 0; i < length; i++)
+			packet[i] = (uint8_t)(n * 7 + i);
+
+		// GPS queries interleave with the packets, online mode has to escape for them
+		if (Now() - gpsTime >= TEST_GPS_INTERVAL)
+		{
+			gpsTime = Now();
+			start = Now();
+			CHECK(GM862_GpsUpdateCache());
+			result->gpsTicks += Now() - start;
+			result->gpsQueries++;
+		}
+
+		CHECK(GM862_SendThroughSocket(packet, length));
+		memcpy(_sent + sentLength, packet, length);
+		sentLength += length;
+
+		uint32_t packetTicks = Now() - packetStart;
+		result->packetTicks += packetTicks;
+		if (packetTicks > result->maxPacketTicks)
+			result->maxPacketTicks = packetTicks;
+
+		if (packetTicks < TEST_PACKET_INTERVAL)
+			CoTickDelay(TEST_PACKET_INTERVAL - packetTicks);
+	}
+
+	// Every packet reached the socket, in order and intact
+	CHECK(ModemSim_GetPayload(&payload) == sentLength);
+	CHECK(memcmp(payload, _sent, sentLength) == 0);
+
+	GM862_GetSendStats(path, &sendStats);
+	CHECK(sendStats.packets == TEST_PACKETS);
+	result->sendTicks = sendStats.totalTime;
+
+	CHECK(GM862_GpsGetCachedPosition(&gpsData, &fixTime));
+	CHECK(gpsData.fix == 2 && gpsData.nsat == 3 && gpsData.sog == (uint16_t)(0.82 * 100));
+	CHECK(gpsData.latitude == ((uint32_t)(5312.7499 * 10000) | _BIT(28)));
+	CHECK(gpsData.longitude == ((uint32_t)(547.9893 * 10000) | _BIT(28)));
+
+	// Command mode connections never leave command mode
+	ModemSim_GetStats(&simStats);
+	if (path == GM862_SEND_PATH_COMMAND)
+		CHECK(simStats.escapes == 0 && simStats.restores == 0 && simStats.sends == TEST_PACKETS);
+	else
+		CHECK(simStats.escapes == result->gpsQueries && simStats.sends == 0);
+
+	CHECK(GM862_CloseSocket());
+}
+
+static void PrintResult(const char *name, const TEST_RESULT_T *result)
+{
+	double tickMs = 1000.0 / CFG_SYSTICK_FREQ;
+
+	printf("%-12s %6.1f ms/packet (max %5.1f ms), %5.1f ms of it sending, %u GPS queries %5.1f ms each\n", name,
+			result->packetTicks * tickMs / TEST_PACKETS, result->maxPacketTicks * tickMs,
+			result->sendTicks * tickMs / TEST_PACKETS, result->gpsQueries,
+			result->gpsQueries ? result->gpsTicks * tickMs / result->gpsQueries : 0.0);
+}
+
+int main()
+{
+	TEST_RESULT_T online, command;
+
+	RunPath(GM862_SEND_PATH_ONLINE, &online);
+	RunPath(GM862_SEND_PATH_COMMAND, &command);
+
+	PrintResult("Transparent:", &online);
+	PrintResult("Command:", &command);
+
+	// Without escapes and restores the command path is faster, GPS queries included
+	CHECK(command.packetTicks < online.packetTicks);
+	CHECK(command.gpsTicks < online.gpsTicks);
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,78 @@
+/* Name: Sensor data benchmark
+ * Description: Pushes synthetic sensor bus traffic through SensorDataManager_PutCanData() and packs tables in
+ * between like the telemetry task, reports the decode and pack cost per frame and per packet
+ */
+
+/* Includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "SensorDataManager.h"
+#include "Misc.h"
+#include "HostStubs.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define BENCHMARK_FRAMES						2000000
+#define BENCHMARK_FRAMES_PER_PACKET				100
+#define BENCHMARK_MAX_FRAMES_PER_PACKET			10000
+
+// Ticks between packets, enough to refill the byte budget of the sensor data manager
+#define BENCHMARK_PACKET_TICKS					(10 * CFG_SYSTICK_FREQ)
+
+/* Implementation */
+
+int main(int argc, char *argv[])
+{
+	static CAN_MSG_Type msgs[BENCHMARK_MAX_FRAMES_PER_PACKET];
+	uint8_t tableBuffer[1024];
+	uint64_t decodeTime = 0, packTime = 0, packedBytes = 0, start;
+	uint32_t frames = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCHMARK_FRAMES;
+	uint32_t framesPerPacket = argc > 2 ? strtoul(argv[2], NULL, 0) : BENCHMARK_FRAMES_PER_PACKET;
+	uint32_t n, i, timestamp, packets = 0;
+
+	if (framesPerPacket == 0 || framesPerPacket > BENCHMARK_MAX_FRAMES_PER_PACKET || frames < framesPerPacket)
+	{
+		fprintf(stderr, "Usage: %s [frames] [frames per packet, at most %u]\n", argv[0],
+				BENCHMARK_MAX_FRAMES_PER_PACKET);
+		return 1;
+	}
+
+	if (!SensorDataManager_Init())
+	{
+		fprintf(stderr, "SensorDataManager_Init() failed\n");
+		return 1;
+	}
+
+	frames -= frames % framesPerPacket;
+	for (n = 0; n < frames; n += framesPerPacket)
+	{
+		// Frames of one packet are made up front, so only the decoder is timed
+		for (i = 0; i < framesPerPacket; i++)
+			SyntheticTraffic_MakeFrame(n + i, &msgs[i]);
+		timestamp = MICROSECOND_TIMER;
+
+		start = Host_GetNanoseconds();
+		for (i = 0; i < framesPerPacket; i++)
+			SensorDataManager_PutCanData(&msgs[i], CAN2_CTRL, timestamp);
+		decodeTime += Host_GetNanoseconds() - start;
+
+		// Every packet is acknowledged, OS time moves on so the byte budget doesn't limit the tables
+		Host_AdvanceOSTime(BENCHMARK_PACKET_TICKS);
+
+		start = Host_GetNanoseconds();
+		packedBytes += SensorDataManager_GetTables(tableBuffer, sizeof(tableBuffer));
+		SensorDataManager_AcknowledgeTables(TRUE);
+		packTime += Host_GetNanoseconds() - start;
+		packets++;
+	}
+
+	printf("Frames: %u, packets: %u\n", frames, packets);
+	printf("Decode: %.1f ns/frame\n", (double)decodeTime / frames);
+	printf("Pack: %.1f ns/packet, %.1f bytes/packet\n", (double)packTime / packets, (double)packedBytes / packets);
+	printf("Total: %.1f ns/frame\n", (double)(decodeTime + packTime) / frames);
+
+	return 0;
+}
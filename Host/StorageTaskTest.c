@@ -0,0 +1,269 @@
+/* Name: Storage task test
+ * Description: Runs the storage task in a thread with FatFs on a RAM disk (see DiskioStub.c), the test plays the
+ * CAN task and the telemetry task. Checks that log and capture data reach the card and are synced on schedule,
+ * the outbox put, peek and pop handshake, that the outbox survives a power cycle, and that a card that hangs
+ * doesn't hold up telemetry: the outbox is skipped until the storage task caught up and the retry interval passed.
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// The ring buffers, files and outbox handshake are private to the storage task
+#include "StorageTask.c"
+
+#include "HostStubs.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Wait for the storage task to get something done, in real time (milliseconds)
+#define TEST_WAIT_MS							2000
+#define WAIT_UNTIL(condition) \
+	do { uint32_t wait; for (wait = 0; wait < TEST_WAIT_MS && !(condition); wait++) usleep(1000); } while (0)
+
+// Capture data written in chunks of an odd size, twice the ring buffer so it wraps
+#define TEST_CAN_SIZE							(2 * STORAGE_CAN_RING_BUFFER_SIZE)
+#define TEST_CAN_CHUNK							13
+
+#define TEST_LOG_LINE							"Storage task test.\r\n"
+
+// Outbox packets of different sizes, up to the largest one the outbox takes
+#define TEST_PACKETS							8
+#define TEST_PACKET_SIZE(i)						(STORAGE_OUTBOX_PACKET_SIZE - (i) * 111)
+
+/* Variables */
+
+static uint8_t _canData[TEST_CAN_SIZE];
+static uint8_t _packets[TEST_PACKETS][STORAGE_OUTBOX_PACKET_SIZE];
+static uint8_t _readBuffer[TEST_CAN_SIZE];
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("StorageTaskTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+static void *StorageTask(void *arg)
+{
+	StorageTask_Run(NULL);
+	return NULL;
+}
+
+/*
+ * @brief		Read a file of the card next to the storage task, which must be waiting for data
+ * @return		Bytes read
+ */
+static uint32_t ReadFile(const char *name, uint8_t *buffer, uint32_t size)
+{
+	FIL file;
+	UINT bytesRead;
+
+	if (f_open(&file, name, FA_READ) != FR_OK || f_read(&file, buffer, size, &bytesRead) != FR_OK)
+		return 0;
+
+	f_close(&file);
+	return bytesRead;
+}
+
+/*
+ * @brief		Check that the oldest packet in the outbox is the given test packet
+ */
+static BOOL PeekIs(uint8_t packet)
+{
+	uint16_t length;
+	const uint8_t *head = StorageTask_OutboxPeek(&length);
+
+	return head != NULL && length == TEST_PACKET_SIZE(packet) && memcmp(head, _packets[packet], length) == 0;
+}
+
+static void TestCapture()
+{
+	uint32_t i, len;
+
+	for (i = 0; i < TEST_CAN_SIZE; i++)
+		_canData[i] = i * 7 + i / 256;
+
+	// The CAN task never waits, a chunk that doesn't fit is tried again like a dropped record
+	for (i = 0; i < TEST_CAN_SIZE; i += len)
+	{
+		len = TEST_CAN_SIZE - i < TEST_CAN_CHUNK ? TEST_CAN_SIZE - i : TEST_CAN_CHUNK;
+		if (!StorageTask_WriteCanFile(_canData + i, len))
+		{
+			len = 0;
+			usleep(100);
+		}
+	}
+
+	StorageTask_WriteLogFile(TEST_LOG_LINE);
+
+	WAIT_UNTIL(_canRingBufferTail == _canRingBufferHead && _logFile.fsize == strlen(TEST_LOG_LINE));
+	CHECK(_canFile.fsize == TEST_CAN_SIZE);
+	CHECK(_logFile.fsize == strlen(TEST_LOG_LINE));
+
+	// Written data waits for the sync interval
+	CHECK(_canSyncedSize == 0);
+	CHECK(_logSyncedSize == 0);
+
+	Host_AdvanceOSTime(STORAGE_SYNC_INTERVAL);
+	CoSetFlag(_availableFlagId);
+	WAIT_UNTIL(_canSyncedSize == TEST_CAN_SIZE && _logSyncedSize == strlen(TEST_LOG_LINE));
+	CHECK(_canSyncedSize == TEST_CAN_SIZE);
+	CHECK(_logSyncedSize == strlen(TEST_LOG_LINE));
+
+	// Synced data is on the card, in order
+	CHECK(ReadFile(CAN_FILE_NAME, _readBuffer, sizeof(_readBuffer)) == TEST_CAN_SIZE);
+	CHECK(memcmp(_readBuffer, _canData, TEST_CAN_SIZE) == 0);
+	CHECK(ReadFile(LOG_FILE_NAME, _readBuffer, sizeof(_readBuffer)) == strlen(TEST_LOG_LINE));
+	CHECK(memcmp(_readBuffer, TEST_LOG_LINE, strlen(TEST_LOG_LINE)) == 0);
+}
+
+static void TestOutbox()
+{
+	uint32_t tail, size, i;
+	uint16_t length;
+
+	for (i = 0; i < TEST_PACKETS; i++)
+		memset(_packets[i], 'A' + i, TEST_PACKET_SIZE(i));
+
+	CHECK(StorageTask_OutboxPeek(&length) == NULL);
+
+	// Too large for the outbox, refused without asking the storage task
+	CHECK(!StorageTask_OutboxPut(_packets[0], STORAGE_OUTBOX_PACKET_SIZE + 1));
+	CHECK(_outboxRequests == 0);
+
+	// The oldest packet is loaded as soon as it is put
+	size = STORAGE_OUTBOX_HEADER_SIZE;
+	for (i = 0; i < TEST_PACKETS; i++)
+	{
+		CHECK(StorageTask_OutboxPut(_packets[i], TEST_PACKET_SIZE(i)));
+		CHECK(PeekIs(0));
+		size += sizeof(uint16_t) + TEST_PACKET_SIZE(i);
+	}
+
+	// Every put is synced, with the offset of the oldest packet in front
+	CHECK(ReadFile(OUTBOX_FILE_NAME, _readBuffer, sizeof(_readBuffer)) == size);
+	memcpy(&tail, _readBuffer, sizeof(uint32_t));
+	CHECK(tail == STORAGE_OUTBOX_HEADER_SIZE);
+
+	// The next packet is loaded once a pop returns
+	StorageTask_OutboxPop();
+	CHECK(PeekIs(1));
+	StorageTask_OutboxPop();
+	CHECK(PeekIs(2));
+
+	CHECK(ReadFile(OUTBOX_FILE_NAME, _readBuffer, sizeof(_readBuffer)) == size);
+	memcpy(&tail, _readBuffer, sizeof(uint32_t));
+	CHECK(tail == STORAGE_OUTBOX_HEADER_SIZE + 2 * sizeof(uint16_t) + TEST_PACKET_SIZE(0) + TEST_PACKET_SIZE(1));
+
+	// Power cycle: the storage task opens the outbox again, the packets that weren't sent are still there
+	_outboxHeadLength = 0;
+	CHECK(StorageTask_PrepareOutbox());
+	CoSetFlag(_availableFlagId);
+	WAIT_UNTIL(_outboxHeadLength != 0);
+
+	for (i = 2; i < TEST_PACKETS; i++)
+	{
+		CHECK(PeekIs(i));
+		StorageTask_OutboxPop();
+	}
+
+	// An empty outbox is truncated
+	CHECK(StorageTask_OutboxPeek(&length) == NULL);
+	CHECK(_outboxFile.fsize == STORAGE_OUTBOX_HEADER_SIZE);
+	CHECK(_outboxReady);
+}
+
+static void TestHangingCard()
+{
+	uint32_t errors = Host_GetDebugCount(DM_ERROR);
+	uint32_t requests;
+	uint64_t start;
+	uint16_t length;
+
+	// Put waits STORAGE_OUTBOX_TIMEOUT for a card that hangs, then the outbox is skipped
+	Host_SetDiskHang(TRUE);
+	start = Host_GetNanoseconds();
+	CHECK(!StorageTask_OutboxPut(_packets[0], TEST_PACKET_SIZE(0)));
+	CHECK(Host_GetNanoseconds() - start >= STORAGE_OUTBOX_TIMEOUT * (1000000000ULL / CFG_SYSTICK_FREQ));
+	CHECK(_outboxFailed);
+	CHECK(Host_GetDebugCount(DM_ERROR) == errors + 1);
+
+	// Skipped outbox doesn't wait anymore
+	requests = _outboxRequests;
+	start = Host_GetNanoseconds();
+	CHECK(!StorageTask_OutboxPut(_packets[1], TEST_PACKET_SIZE(1)));
+	CHECK(StorageTask_OutboxPeek(&length) == NULL);
+	CHECK(_outboxRequests == requests);
+	CHECK(Host_GetNanoseconds() - start < STORAGE_OUTBOX_TIMEOUT * (1000000000ULL / CFG_SYSTICK_FREQ) / 2);
+
+	// Still skipped after the retry interval, the storage task didn't catch up
+	Host_AdvanceOSTime(STORAGE_OUTBOX_RETRY_INTERVAL);
+	CHECK(!StorageTask_OutboxPut(_packets[1], TEST_PACKET_SIZE(1)));
+	CHECK(_outboxRequests == requests);
+
+	// The storage task catches up, the packet it was writing reaches the outbox
+	Host_SetDiskHang(FALSE);
+	WAIT_UNTIL(_outboxHandled == _outboxRequests && _outboxHeadLength != 0);
+	CHECK(_outboxHandled == _outboxRequests);
+	CHECK(PeekIs(0));
+	CHECK(!_outboxFailed);
+
+	// Once more, this time the storage task catches up right away
+	Host_SetDiskHang(TRUE);
+	CHECK(!StorageTask_OutboxPut(_packets[1], TEST_PACKET_SIZE(1)));
+	Host_SetDiskHang(FALSE);
+	WAIT_UNTIL(_outboxHandled == _outboxRequests);
+	CHECK(_outboxHandled == _outboxRequests);
+	CHECK(Host_GetDebugCount(DM_ERROR) == errors + 2);
+
+	// Still skipped until the retry interval passed
+	CHECK(StorageTask_OutboxPeek(&length) == NULL);
+	Host_AdvanceOSTime(STORAGE_OUTBOX_RETRY_INTERVAL);
+	CHECK(PeekIs(0));
+
+	StorageTask_OutboxPop();
+	CHECK(PeekIs(1));
+	StorageTask_OutboxPop();
+	CHECK(StorageTask_OutboxPeek(&length) == NULL);
+	CHECK(Host_GetDebugCount(DM_ERROR) == errors + 2);
+}
+
+int main()
+{
+	pthread_t thread;
+
+	// Blank card
+	f_mount(0, &_fatFs);
+	CHECK(f_mkfs(0, 1, 0) == FR_OK);
+
+	pthread_create(&thread, NULL, StorageTask, NULL);
+	WAIT_UNTIL(_outboxReady);
+	CHECK(_outboxReady);
+
+	TestCapture();
+	TestOutbox();
+	TestHangingCard();
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
@@ -0,0 +1,32 @@
+/* Name: CAN task host stub
+ * Description: Statistics of the CAN task for host programs that feed the sensor data manager directly, there is no
+ * bus traffic to count
+ */
+
+/* Includes */
+
+#include <string.h>
+
+#include "CanTask.h"
+
+/* Implementation */
+
+void CanTask_GetBusStats(uint8_t controller, CAN_BUS_STATS_T *stats)
+{
+	memset(stats, 0, sizeof(CAN_BUS_STATS_T));
+}
+
+void CanTask_GetLatencyStats(CAN_LATENCY_STATS_T *stats)
+{
+	memset(stats, 0, sizeof(CAN_LATENCY_STATS_T));
+}
+
+void CanTask_GetIsrStats(CAN_ISR_STATS_T *stats)
+{
+	memset(stats, 0, sizeof(CAN_ISR_STATS_T));
+}
+
+uint32_t CanTask_GetCaptureDropped()
+{
+	return 0;
+}
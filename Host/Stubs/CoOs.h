@@ -0,0 +1,74 @@
+/* Name: CoOS host stub
+ * Description: The part of the CoOS API used by the firmware sources, for host builds. Tasks are host threads,
+ * the scheduler lock is one global mutex and the OS time is advanced by the host program.
+ */
+
+#ifndef _CCRTOS_H
+#define _CCRTOS_H
+
+/* Includes */
+
+#include <stdint.h>
+
+/* Defines */
+
+#define CFG_SYSTICK_FREQ		100
+
+#define Co_NULL					((void *)0)
+#define Co_FALSE				(0)
+#define Co_TRUE					(1)
+
+#define E_CREATE_FAIL			(StatusType)-1
+#define E_OK					(StatusType)0
+#define E_INVALID_ID			(StatusType)1
+#define E_TIMEOUT				(StatusType)5
+
+#define TMR_TYPE_ONE_SHOT		0
+#define TMR_TYPE_PERIODIC		1
+
+#define CoEnterISR()
+#define CoExitISR()
+
+/* Types */
+
+typedef unsigned char			U8;
+typedef unsigned short			U16;
+typedef unsigned int			U32;
+typedef unsigned long long		U64;
+typedef unsigned char			BOOL;
+typedef unsigned int			OS_STK;
+typedef U8						OS_TID;
+typedef U8						OS_TCID;
+typedef U8						OS_MutexID;
+typedef U8						OS_FlagID;
+typedef U8						StatusType;
+typedef void					(*vFUNCPtr)(void);
+
+/* Prototypes */
+
+U64 CoGetOSTime(void);
+StatusType CoTickDelay(U32 ticks);
+StatusType CoTimeDelay(U8 hour, U8 minute, U8 sec, U16 millsec);
+
+void CoSchedLock(void);
+void CoSchedUnlock(void);
+
+OS_MutexID CoCreateMutex(void);
+StatusType CoEnterMutexSection(OS_MutexID mutexID);
+StatusType CoLeaveMutexSection(OS_MutexID mutexID);
+
+OS_FlagID CoCreateFlag(U8 bAutoReset, U8 bInitialState);
+StatusType CoSetFlag(OS_FlagID id);
+StatusType CoClearFlag(OS_FlagID id);
+StatusType CoWaitForSingleFlag(OS_FlagID id, U32 timeout);
+StatusType isr_SetFlag(OS_FlagID id);
+
+OS_TCID CoCreateTmr(U8 tmrType, U32 tmrCnt, U32 tmrReload, vFUNCPtr func);
+StatusType CoStartTmr(OS_TCID tmrID);
+
+void CoExitTask(void);
+
+// Host only: advance the OS time returned by CoGetOSTime()
+void Host_AdvanceOSTime(U32 ticks);
+
+#endif
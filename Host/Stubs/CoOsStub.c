@@ -0,0 +1,222 @@
+/* Name: CoOS host stub
+ * Description: Host implementation of the CoOS API in CoOs.h on top of POSIX threads
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "CoOs.h"
+
+/* Defines */
+
+#define COOS_STUB_MAX_MUTEXES			16
+#define COOS_STUB_MAX_FLAGS				32
+#define COOS_STUB_MAX_TIMERS			8
+
+/* Structs */
+
+typedef struct {
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	BOOL autoReset;
+	BOOL set;
+
+} COOS_STUB_FLAG_T;
+
+/* Variables */
+
+static volatile U64 _osTime; // CoOS ticks
+static pthread_mutex_t _schedMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static pthread_mutex_t _mutexes[COOS_STUB_MAX_MUTEXES];
+static U8 _mutexCount;
+
+static COOS_STUB_FLAG_T _flags[COOS_STUB_MAX_FLAGS];
+static U8 _flagCount;
+
+static U8 _timerCount;
+
+/* Implementation */
+
+U64 CoGetOSTime(void)
+{
+	return __atomic_load_n(&_osTime, __ATOMIC_RELAXED);
+}
+
+void Host_AdvanceOSTime(U32 ticks)
+{
+	__atomic_add_fetch(&_osTime, ticks, __ATOMIC_RELAXED);
+}
+
+/*
+ * @brief		Delays don't sleep on the host, they only move the OS time so simulations run as fast as possible.
+ * 				Other threads get to run, like other tasks during a delay.
+ */
+StatusType CoTickDelay(U32 ticks)
+{
+	Host_AdvanceOSTime(ticks);
+	sched_yield();
+	return E_OK;
+}
+
+StatusType CoTimeDelay(U8 hour, U8 minute, U8 sec, U16 millsec)
+{
+	Host_AdvanceOSTime((((hour * 60UL + minute) * 60UL + sec) * 1000UL + millsec) * CFG_SYSTICK_FREQ / 1000UL);
+	sched_yield();
+	return E_OK;
+}
+
+void CoSchedLock(void)
+{
+	pthread_mutex_lock(&_schedMutex);
+}
+
+void CoSchedUnlock(void)
+{
+	pthread_mutex_unlock(&_schedMutex);
+}
+
+OS_MutexID CoCreateMutex(void)
+{
+	pthread_mutexattr_t attr;
+
+	if (_mutexCount == COOS_STUB_MAX_MUTEXES)
+		return E_CREATE_FAIL;
+
+	// CoOS mutexes may be entered again by the owning task
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&_mutexes[_mutexCount], &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	return _mutexCount++;
+}
+
+StatusType CoEnterMutexSection(OS_MutexID mutexID)
+{
+	if (mutexID >= _mutexCount)
+		return E_INVALID_ID;
+
+	pthread_mutex_lock(&_mutexes[mutexID]);
+	return E_OK;
+}
+
+StatusType CoLeaveMutexSection(OS_MutexID mutexID)
+{
+	if (mutexID >= _mutexCount)
+		return E_INVALID_ID;
+
+	pthread_mutex_unlock(&_mutexes[mutexID]);
+	return E_OK;
+}
+
+OS_FlagID CoCreateFlag(U8 bAutoReset, U8 bInitialState)
+{
+	if (_flagCount == COOS_STUB_MAX_FLAGS)
+		return E_CREATE_FAIL;
+
+	COOS_STUB_FLAG_T *flag = &_flags[_flagCount];
+	pthread_mutex_init(&flag->mutex, NULL);
+	pthread_cond_init(&flag->cond, NULL);
+	flag->autoReset = bAutoReset;
+	flag->set = bInitialState;
+
+	return _flagCount++;
+}
+
+StatusType CoSetFlag(OS_FlagID id)
+{
+	if (id >= _flagCount)
+		return E_INVALID_ID;
+
+	pthread_mutex_lock(&_flags[id].mutex);
+	_flags[id].set = Co_TRUE;
+	pthread_cond_broadcast(&_flags[id].cond);
+	pthread_mutex_unlock(&_flags[id].mutex);
+
+	return E_OK;
+}
+
+StatusType isr_SetFlag(OS_FlagID id)
+{
+	return CoSetFlag(id);
+}
+
+StatusType CoClearFlag(OS_FlagID id)
+{
+	if (id >= _flagCount)
+		return E_INVALID_ID;
+
+	pthread_mutex_lock(&_flags[id].mutex);
+	_flags[id].set = Co_FALSE;
+	pthread_mutex_unlock(&_flags[id].mutex);
+
+	return E_OK;
+}
+
+/*
+ * @brief		Wait for a flag, a timeout (in CoOS ticks, 0 waits forever) is waited for in real time and then
+ * 				moves the OS time as well
+ */
+StatusType CoWaitForSingleFlag(OS_FlagID id, U32 timeout)
+{
+	struct timespec deadline;
+	StatusType result = E_OK;
+
+	if (id >= _flagCount)
+		return E_INVALID_ID;
+
+	COOS_STUB_FLAG_T *flag = &_flags[id];
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / CFG_SYSTICK_FREQ;
+	deadline.tv_nsec += (timeout % CFG_SYSTICK_FREQ) * (1000000000L / CFG_SYSTICK_FREQ);
+	if (deadline.tv_nsec >= 1000000000L)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&flag->mutex);
+	while (!flag->set && result == E_OK)
+	{
+		if (timeout == 0)
+			pthread_cond_wait(&flag->cond, &flag->mutex);
+		else if (pthread_cond_timedwait(&flag->cond, &flag->mutex, &deadline) != 0 && !flag->set)
+			result = E_TIMEOUT;
+	}
+
+	if (result == E_OK && flag->autoReset)
+		flag->set = Co_FALSE;
+	pthread_mutex_unlock(&flag->mutex);
+
+	if (result == E_TIMEOUT)
+		Host_AdvanceOSTime(timeout);
+
+	return result;
+}
+
+/*
+ * @brief		Timers never expire on the host
+ */
+OS_TCID CoCreateTmr(U8 tmrType, U32 tmrCnt, U32 tmrReload, vFUNCPtr func)
+{
+	if (_timerCount == COOS_STUB_MAX_TIMERS)
+		return E_CREATE_FAIL;
+
+	return _timerCount++;
+}
+
+StatusType CoStartTmr(OS_TCID tmrID)
+{
+	return tmrID < _timerCount ? E_OK : E_INVALID_ID;
+}
+
+void CoExitTask(void)
+{
+	pthread_exit(NULL);
+}
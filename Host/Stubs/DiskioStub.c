@@ -0,0 +1,112 @@
+/* Name: Disk I/O host stub
+ * Description: The microSD card of the storage task as a RAM disk, for host programs that run the storage task
+ * with FatFs. The program formats it with f_mkfs(). Writes can be held up like on a card that stops responding.
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "HostStubs.h"
+#include "fat_sd/diskio.h"
+
+/* Defines */
+
+// 8 MB, formatted as FAT16
+#define DISKIO_STUB_SECTOR_SIZE			512
+#define DISKIO_STUB_SECTOR_COUNT		16384
+
+/* Variables */
+
+static uint8_t _disk[DISKIO_STUB_SECTOR_COUNT * DISKIO_STUB_SECTOR_SIZE];
+
+static pthread_mutex_t _hangMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _hangCond = PTHREAD_COND_INITIALIZER;
+static BOOL _hang; // writes wait until cleared
+static uint32_t _writes; // sectors written
+
+/* Implementation */
+
+void Host_SetDiskHang(BOOL hang)
+{
+	pthread_mutex_lock(&_hangMutex);
+	_hang = hang;
+	pthread_cond_broadcast(&_hangCond);
+	pthread_mutex_unlock(&_hangMutex);
+}
+
+uint32_t Host_GetDiskWrites()
+{
+	return __atomic_load_n(&_writes, __ATOMIC_RELAXED);
+}
+
+DSTATUS disk_initialize(BYTE drv)
+{
+	return drv == 0 ? 0 : STA_NOINIT;
+}
+
+DSTATUS disk_status(BYTE drv)
+{
+	return drv == 0 ? 0 : STA_NOINIT;
+}
+
+DRESULT disk_read(BYTE drv, BYTE *buff, DWORD sector, BYTE count)
+{
+	if (drv != 0 || sector + count > DISKIO_STUB_SECTOR_COUNT)
+		return RES_PARERR;
+
+	memcpy(buff, _disk + sector * DISKIO_STUB_SECTOR_SIZE, count * DISKIO_STUB_SECTOR_SIZE);
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE drv, const BYTE *buff, DWORD sector, BYTE count)
+{
+	if (drv != 0 || sector + count > DISKIO_STUB_SECTOR_COUNT)
+		return RES_PARERR;
+
+	// A hanging card holds up the storage task
+	pthread_mutex_lock(&_hangMutex);
+	while (_hang)
+		pthread_cond_wait(&_hangCond, &_hangMutex);
+	pthread_mutex_unlock(&_hangMutex);
+
+	memcpy(_disk + sector * DISKIO_STUB_SECTOR_SIZE, buff, count * DISKIO_STUB_SECTOR_SIZE);
+	__atomic_add_fetch(&_writes, count, __ATOMIC_RELAXED);
+
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE drv, BYTE ctrl, void *buff)
+{
+	if (drv != 0)
+		return RES_PARERR;
+
+	switch (ctrl)
+	{
+	case CTRL_SYNC:
+		return RES_OK;
+
+	case GET_SECTOR_COUNT:
+		*(DWORD *)buff = DISKIO_STUB_SECTOR_COUNT;
+		return RES_OK;
+
+	case GET_SECTOR_SIZE:
+		*(WORD *)buff = DISKIO_STUB_SECTOR_SIZE;
+		return RES_OK;
+
+	case GET_BLOCK_SIZE:
+		*(DWORD *)buff = 1;
+		return RES_OK;
+
+	default:
+		return RES_PARERR;
+	}
+}
+
+/*
+ * @brief		Card detect and timeouts of the SPI driver, there is nothing to time on the host
+ */
+void disk_timerproc(void)
+{
+}
@@ -0,0 +1,37 @@
+/* Name: GM862 host stub
+ * Description: GPS cache of the modem driver for host programs that don't simulate the modem
+ */
+
+/* Includes */
+
+#include "HostStubs.h"
+
+/* Variables */
+
+static GM862_GPS_DATA _gpsData;
+static uint32_t _gpsFixTime;
+static BOOL _gpsValid;
+
+/* Implementation */
+
+void Host_SetGpsFix(const GM862_GPS_DATA *gpsData, uint32_t fixTime)
+{
+	CoSchedLock();
+	_gpsData = *gpsData;
+	_gpsFixTime = fixTime;
+	_gpsValid = TRUE;
+	CoSchedUnlock();
+}
+
+BOOL GM862_GpsGetCachedPosition(GM862_GPS_DATA *gpsData, uint32_t *fixTime)
+{
+	BOOL valid;
+
+	CoSchedLock();
+	valid = _gpsValid;
+	*gpsData = _gpsData;
+	*fixTime = _gpsFixTime;
+	CoSchedUnlock();
+
+	return valid;
+}
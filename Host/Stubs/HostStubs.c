@@ -0,0 +1,150 @@
+/* Name: Host stubs
+ * Description: Peripherals, clocks and debug output of the firmware, for host builds
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "HostStubs.h"
+#include "Misc.h"
+
+/* Variables */
+
+// Peripherals redirected by the LPC17xx.h stub
+LPC_TIM_TypeDef Host_Timer0;
+LPC_RTC_TypeDef Host_Rtc;
+LPC_CANAF_RAM_TypeDef Host_CanAfRam;
+LPC_CANAF_TypeDef Host_CanAf;
+LPC_CANCR_TypeDef Host_CanCr;
+LPC_CAN_TypeDef Host_Can1;
+LPC_CAN_TypeDef Host_Can2;
+
+volatile uint32_t Host_DwtCtrl;
+volatile uint32_t Host_Demcr;
+
+// DWT cycles are host nanoseconds (see Misc.h)
+uint32_t SystemCoreClock = 1000000000UL;
+
+// An interrupt handler runs with the mutex of its interrupt locked, a disabled interrupt is locked by the task
+static pthread_mutex_t _irqMutexes[CANActivity_IRQn + 1] = { [0 ... CANActivity_IRQn] = PTHREAD_MUTEX_INITIALIZER };
+static __thread uint8_t _irqDisabled[CANActivity_IRQn + 1]; // interrupts locked by the calling thread
+
+static DEBUG_MESSAGE_TYPE _debugLevel = DM_FATAL_ERROR; // lowest message type printed
+static uint32_t _debugCounts[DM_FATAL_ERROR + 1];
+
+/* Implementation */
+
+uint64_t Host_GetNanoseconds()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/*
+ * @brief		Cycle counter read by DWT_CYCCNT, sampled on every use
+ * @return		Counter of the calling thread, writes to it are ignored
+ */
+volatile uint32_t *Host_CycleCounter()
+{
+	static __thread uint32_t cycles;
+
+	cycles = (uint32_t)Host_GetNanoseconds();
+	return &cycles;
+}
+
+uint32_t Host_MicrosecondTimer()
+{
+	return (uint32_t)(Host_GetNanoseconds() / 1000);
+}
+
+/*
+ * @brief		Interrupts are enabled by default, enabling again is ignored like on the NVIC
+ */
+void Host_NvicEnableIRQ(IRQn_Type IRQn)
+{
+	if (_irqDisabled[IRQn])
+	{
+		_irqDisabled[IRQn] = 0;
+		pthread_mutex_unlock(&_irqMutexes[IRQn]);
+	}
+}
+
+/*
+ * @brief		Wait for a running handler of the interrupt to return and hold off new ones until enabled
+ */
+void Host_NvicDisableIRQ(IRQn_Type IRQn)
+{
+	if (!_irqDisabled[IRQn])
+	{
+		pthread_mutex_lock(&_irqMutexes[IRQn]);
+		_irqDisabled[IRQn] = 1;
+	}
+}
+
+/*
+ * @brief		Run an interrupt handler in the calling thread, the thread plays the interrupt hardware
+ * @param[in]	IRQn Interrupt, held off while disabled by another thread
+ * @param[in]	handler Interrupt handler
+ * @return		None
+ */
+void Host_InvokeIsr(IRQn_Type IRQn, void (*handler)(void))
+{
+	pthread_mutex_lock(&_irqMutexes[IRQn]);
+	handler();
+	pthread_mutex_unlock(&_irqMutexes[IRQn]);
+}
+
+void Host_SetDebugLevel(DEBUG_MESSAGE_TYPE level)
+{
+	_debugLevel = level;
+}
+
+uint32_t Host_GetDebugCount(DEBUG_MESSAGE_TYPE type)
+{
+	return __atomic_load_n(&_debugCounts[type], __ATOMIC_RELAXED);
+}
+
+void Debug_Init()
+{
+}
+
+void Debug_Send(DEBUG_MESSAGE_TYPE type, const char *str)
+{
+	static const char *prefixes[] = { "INFO", "ERROR", "FATAL" };
+
+	__atomic_add_fetch(&_debugCounts[type], 1, __ATOMIC_RELAXED);
+
+	if (type >= _debugLevel)
+		fprintf(stderr, "[%s] %s\n", prefixes[type], str);
+}
+
+/*
+ * @brief		Peripheral clock of the peripheral library, all peripherals run at the core clock on the host
+ */
+uint32_t CLKPWR_GetPCLK(uint32_t ClkType)
+{
+	return SystemCoreClock;
+}
+
+void CLKPWR_SetPCLKDiv(uint32_t ClkType, uint32_t DivVal)
+{
+}
+
+void CLKPWR_ConfigPPWR(uint32_t PPType, FunctionalState NewState)
+{
+}
+
+/*
+ * @brief		Parameter check of the peripheral library (compiled with DEBUG)
+ */
+void check_failed(uint8_t *file, uint32_t line)
+{
+	fprintf(stderr, "Peripheral library parameter check failed: %s:%u\n", (const char *)file, (unsigned)line);
+	abort();
+}
@@ -0,0 +1,24 @@
+/* Name: Host stubs
+ * Description: Peripherals, clocks and debug output of the firmware, for host builds
+ */
+
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+/* Includes */
+
+#include <stdint.h>
+
+#include "Debug.h"
+#include "GM862.h"
+
+/* Prototypes */
+
+uint64_t Host_GetNanoseconds();
+void Host_SetDebugLevel(DEBUG_MESSAGE_TYPE level);
+uint32_t Host_GetDebugCount(DEBUG_MESSAGE_TYPE type);
+void Host_SetGpsFix(const GM862_GPS_DATA *gpsData, uint32_t fixTime);
+void Host_SetDiskHang(BOOL hang);
+uint32_t Host_GetDiskWrites();
+
+#endif
@@ -0,0 +1,51 @@
+/* Name: LPC17xx host stub
+ * Description: Device header for host builds. Takes the register layouts from the real header and redirects
+ * the peripherals used by the firmware sources to memory owned by the host program.
+ */
+
+#ifndef HOST_LPC17XX_H
+#define HOST_LPC17XX_H
+
+/* Includes */
+
+#include "../../cmsis_boot/LPC17xx.h"
+
+/* Defines */
+
+#undef LPC_TIM0
+#undef LPC_RTC
+#undef LPC_CANAF_RAM
+#undef LPC_CANAF
+#undef LPC_CANCR
+#undef LPC_CAN1
+#undef LPC_CAN2
+
+#define LPC_TIM0				(&Host_Timer0)
+#define LPC_RTC					(&Host_Rtc)
+#define LPC_CANAF_RAM			(&Host_CanAfRam)
+#define LPC_CANAF				(&Host_CanAf)
+#define LPC_CANCR				(&Host_CanCr)
+#define LPC_CAN1				(&Host_Can1)
+#define LPC_CAN2				(&Host_Can2)
+
+// Interrupts are host functions, see Host_InvokeIsr()
+#define NVIC_EnableIRQ(IRQn)	Host_NvicEnableIRQ(IRQn)
+#define NVIC_DisableIRQ(IRQn)	Host_NvicDisableIRQ(IRQn)
+
+/* Variables */
+
+extern LPC_TIM_TypeDef Host_Timer0;
+extern LPC_RTC_TypeDef Host_Rtc;
+extern LPC_CANAF_RAM_TypeDef Host_CanAfRam;
+extern LPC_CANAF_TypeDef Host_CanAf;
+extern LPC_CANCR_TypeDef Host_CanCr;
+extern LPC_CAN_TypeDef Host_Can1;
+extern LPC_CAN_TypeDef Host_Can2;
+
+/* Prototypes */
+
+void Host_NvicEnableIRQ(IRQn_Type IRQn);
+void Host_NvicDisableIRQ(IRQn_Type IRQn);
+void Host_InvokeIsr(IRQn_Type IRQn, void (*handler)(void));
+
+#endif
@@ -0,0 +1,14 @@
+/* Name: Storage task host stub
+ * Description: CAN capture of the storage task for host programs, there is no card to write to
+ */
+
+/* Includes */
+
+#include "StorageTask.h"
+
+/* Implementation */
+
+BOOL StorageTask_WriteCanFile(uint8_t *dat, uint32_t len)
+{
+	return FALSE;
+}
@@ -0,0 +1,5 @@
+/* Name: LPC17xx host stub
+ * Description: Lower case name used by some of the peripheral library headers
+ */
+
+#include "LPC17xx.h"
@@ -0,0 +1,120 @@
+/* Name: Synthetic sensor bus traffic
+ * Description: CAN frames in the mix of the sensor bus, with plausible values, for host tests and benchmarks
+ */
+
+/* Includes */
+
+#include <string.h>
+
+#include "SyntheticTraffic.h"
+
+/* Variables */
+
+// BMS voltage, charge and discharge current, state of charge and highest cell temperature
+static const uint8_t _bmsSubIndices[] = { 1, 3, 4, 5, 9 };
+
+// MPPT 1..4, message A and B each
+static const uint16_t _mpptIds[] = { 0x185, 0x285, 0x186, 0x286, 0x187, 0x287, 0x188, 0x288 };
+
+/* Implementation */
+
+/*
+ * @brief		Slow swing between 0 and amplitude and back, like values that follow the sun or the throttle
+ * @param[in]	round Round of the mix
+ * @param[in]	period Rounds of a full swing
+ * @param[in]	amplitude Largest value
+ * @return		Value
+ */
+static int32_t SyntheticTraffic_Swing(uint32_t round, uint32_t period, int32_t amplitude)
+{
+	uint32_t phase = round % period;
+
+	if (phase >= period / 2)
+		phase = period - phase;
+
+	return (int32_t)((int64_t)amplitude * phase * 2 / period);
+}
+
+/*
+ * @brief		Sensor noise, different for every frame
+ * @param[in]	n Frame number
+ * @param[in]	amplitude Largest deviation
+ * @return		Deviation between -amplitude and amplitude
+ */
+static int32_t SyntheticTraffic_Noise(uint32_t n, int32_t amplitude)
+{
+	uint32_t hash = n * 2654435761UL;
+
+	return (int32_t)((hash >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+/*
+ * @brief		Make the n-th frame of the synthetic traffic, values stay within the alarm thresholds and
+ * 				change like on the boat when a round of the mix takes 8 ms (the rate of a synthetic capture):
+ * 				solar current and voltage follow the sun over minutes with noise within their deadbands, the
+ * 				discharge current follows the throttle over seconds, charge and temperatures drift over minutes
+ * @param[in]	n Frame number
+ * @param[out]	msg Frame
+ * @return		None
+ */
+void SyntheticTraffic_MakeFrame(uint32_t n, CAN_MSG_Type *msg)
+{
+	uint8_t kind = n % SYNTHETIC_FRAMES_PER_ROUND;
+	uint32_t round = n / SYNTHETIC_FRAMES_PER_ROUND;
+	int16_t bmsValues[5];
+	uint8_t temperatures[8];
+	uint8_t i;
+
+	memset(msg, 0, sizeof(CAN_MSG_Type));
+	msg->len = 8;
+	if (kind < 5)
+	{
+		bmsValues[0] = 500 + SyntheticTraffic_Swing(round, 8192, 4);
+		bmsValues[1] = 150 + SyntheticTraffic_Swing(round, 16384, 30);
+		bmsValues[2] = 300 + SyntheticTraffic_Swing(round, 2048, 40) + SyntheticTraffic_Noise(n, 1);
+		bmsValues[3] = 80 - round / 8192 % 20;
+		bmsValues[4] = 30 + SyntheticTraffic_Swing(round, 65536, 6);
+
+		msg->format = STD_ID_FORMAT;
+		msg->id = SYNTHETIC_ID_BMS;
+		msg->dataA[3] = _bmsSubIndices[kind];
+		memcpy(msg->dataB, &bmsValues[kind], sizeof(int16_t));
+	}
+	else if (kind < 13)
+	{
+		uint8_t mppt = (kind - 5) / 2;
+		float current = 4.0f + 0.5f * mppt + (SyntheticTraffic_Swing(round + mppt * 4096, 32768, 3000) +
+				SyntheticTraffic_Noise(n, 20)) * 0.001f;
+		float voltage = 40.0f + 0.5f * mppt + (SyntheticTraffic_Swing(round + mppt * 2048, 16384, 200) +
+				SyntheticTraffic_Noise(n + 1, 3)) * 0.01f;
+
+		msg->format = STD_ID_FORMAT;
+		msg->id = _mpptIds[kind - 5];
+
+		// Message A holds input current and voltage, message B output voltage and input power
+		if ((kind - 5) % 2 == 0)
+		{
+			memcpy(msg->dataA, &current, sizeof(float));
+			memcpy(msg->dataB, &voltage, sizeof(float));
+		}
+		else
+		{
+			float output = 50.0f + SyntheticTraffic_Swing(round, 65536, 50) * 0.01f;
+			float power = voltage * current;
+
+			memcpy(msg->dataA, &output, sizeof(float));
+			memcpy(msg->dataB, &power, sizeof(float));
+		}
+	}
+	else
+	{
+		// Priority 6, source address 0x21
+		msg->format = EXT_ID_FORMAT;
+		msg->id = (0x18UL << 24) | ((uint32_t)SYNTHETIC_PGN_TEMPERATURE << 8) | 0x21;
+		for (i = 0; i < sizeof(temperatures); i++)
+			temperatures[i] = 25 + i / 2 + SyntheticTraffic_Swing(round + i * 8192, 65536, 4);
+
+		memcpy(msg->dataA, temperatures, sizeof(msg->dataA));
+		memcpy(msg->dataB, temperatures + sizeof(msg->dataA), sizeof(msg->dataB));
+	}
+}
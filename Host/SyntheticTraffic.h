@@ -0,0 +1,27 @@
+/* Name: Synthetic sensor bus traffic
+ * Description: CAN frames in the mix of the sensor bus, with plausible values, for host tests and benchmarks
+ */
+
+#ifndef SYNTHETIC_TRAFFIC_H
+#define SYNTHETIC_TRAFFIC_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <lpc17xx_can.h>
+
+/* Defines */
+
+// Identifiers decoded by SensorDataManager.c
+#define SYNTHETIC_ID_BMS						0x302
+#define SYNTHETIC_ID_MPPT_FIRST					0x185
+#define SYNTHETIC_PGN_TEMPERATURE				0x18FD
+
+// Frames per round of the mix: 5 BMS, 8 MPPT and 3 temperature frames
+#define SYNTHETIC_FRAMES_PER_ROUND				16
+
+/* Prototypes */
+
+void SyntheticTraffic_MakeFrame(uint32_t n, CAN_MSG_Type *msg);
+
+#endif
@@ -0,0 +1,475 @@
+/* Name: Telemetry task test
+ * Description: Packs synthetic sensor bus traffic like the telemetry task between socket sessions, with the storage
+ * task running in a thread on a RAM disk (see DiskioStub.c). Sending is linked to the test (--wrap, see Makefile),
+ * which decodes every packet with the packet decoder or fails it while the link is down. A second decoder gets every
+ * packet as it is packed, like over a link that never fails, every table shore side decodes must have its values.
+ * Checks batching and its statistics, the flush of a batch with tables of a tripped alarm rule, that a batch that
+ * fails to send comes out of the outbox intact without upsetting the live tables, and the upload of the sensor
+ * history recorded during an outage.
+ */
+
+/* Includes */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Packing, batching and the outbox handshake are private to the tasks
+#include "TelemetryTask.c"
+#include "StorageTask.c"
+
+#include "HostStubs.h"
+#include "PacketDecoder.h"
+#include "SyntheticTraffic.h"
+
+/* Defines */
+
+#define CHECK(condition)						Check((condition), #condition, __LINE__)
+
+// Wait for the storage task to get something done, in real time (milliseconds)
+#define TEST_WAIT_MS							2000
+#define WAIT_UNTIL(condition) \
+	do { uint32_t wait; for (wait = 0; wait < TEST_WAIT_MS && !(condition); wait++) usleep(1000); } while (0)
+
+// Frames on the bus every telemetry interval
+#define TEST_FRAMES_PER_INTERVAL				(4 * SYNTHETIC_FRAMES_PER_ROUND)
+
+// Time a packet takes to send (CoOS ticks)
+#define TEST_SEND_TICKS							20
+
+// Intervals a batch may take to fill up, and batches the schema may take
+#define TEST_BATCH_INTERVALS					(4 * TELEMETRY_BATCH_SIZE)
+#define TEST_SCHEMA_BATCHES						10
+
+// Highest cell temperature that trips the BMS temperature alarm rule (SI_BMS_CELL_TEMP_HIGH in SensorDataManager.c)
+#define TEST_SUB_INDEX_TEMPERATURE				9
+#define TEST_HOT_TEMPERATURE					60
+
+// Snapshots recorded during the outage, each with the BMS, MPPT and temperature table in full
+#define TEST_SNAPSHOTS							5
+#define TEST_SNAPSHOT_TABLES					3
+
+// Offsets in the packet headers: record count of batch packets, schema version and timestamp of single packets
+#define TEST_BATCH_COUNT_OFFSET					8
+#define TEST_BATCH_VERSION_OFFSET				3
+#define TEST_PACKET_VERSION_OFFSET				2
+#define TEST_PACKET_TIME_OFFSET					7
+
+// Sensor tables decoded by the reference decoder
+#define TEST_REFERENCE_TABLES					1024
+
+/* Structs */
+
+typedef struct {
+
+	uint32_t time;
+	uint8_t id;
+	uint8_t fieldCount;
+	float values[PACKET_DECODER_MAX_FIELDS];
+
+} TEST_TABLE_T;
+
+/* Variables */
+
+static FATFS _testFatFs;
+
+static PACKET_DECODER_T _decoder;
+static PACKET_DECODER_T _reference; // every packet as it is packed
+static TEST_TABLE_T _referenceTables[TEST_REFERENCE_TABLES];
+static uint32_t _referenceCount;
+static uint32_t _tablesMatched;
+static uint32_t _tablesMismatched;
+static uint32_t _frame;
+
+// Link, and what went through it
+static volatile BOOL _linkDown;
+static uint32_t _sentCount;
+static uint32_t _failedCount;
+static uint8_t _lastPacket[TELEMETRY_BATCH_BUFFER_SIZE];
+static uint16_t _lastLength;
+static PACKET_RESULT _lastResult;
+static uint32_t _events[PACKET_EVENT_ALARM + 1];
+static uint32_t _lastEventTime;
+
+static uint32_t _checks;
+static uint32_t _failures;
+
+/* Implementation */
+
+static void Check(BOOL condition, const char *text, int line)
+{
+	_checks++;
+	if (!condition)
+	{
+		_failures++;
+		printf("TelemetryTaskTest.c:%d: check failed: %s\n", line, text);
+	}
+}
+
+static void *StorageTask(void *arg)
+{
+	StorageTask_Run(NULL);
+	return NULL;
+}
+
+static void HandleReferenceEvent(void *context, const PACKET_EVENT_T *event)
+{
+	TEST_TABLE_T *table = &_referenceTables[_referenceCount];
+
+	if (event->type != PACKET_EVENT_TABLE || _referenceCount == TEST_REFERENCE_TABLES)
+		return;
+
+	table->time = event->time;
+	table->id = event->table->id;
+	table->fieldCount = event->table->fieldCount;
+	memcpy(table->values, event->table->values, sizeof(table->values));
+	_referenceCount++;
+}
+
+/*
+ * @brief		Check a table decoded shore side against the latest one of the same time on the reference decoder
+ */
+static void CheckTable(const PACKET_EVENT_T *event)
+{
+	int32_t i;
+
+	for (i = (int32_t)_referenceCount - 1; i >= 0; i--)
+	{
+		const TEST_TABLE_T *table = &_referenceTables[i];
+
+		if (table->time != event->time || table->id != event->table->id)
+			continue;
+
+		if (memcmp(table->values, event->table->values, table->fieldCount * sizeof(float)) == 0)
+			_tablesMatched++;
+		else
+			_tablesMismatched++;
+		return;
+	}
+
+	_tablesMismatched++;
+}
+
+static void HandleEvent(void *context, const PACKET_EVENT_T *event)
+{
+	_events[event->type]++;
+	_lastEventTime = event->time;
+
+	if (event->type == PACKET_EVENT_TABLE)
+		CheckTable(event);
+}
+
+/*
+ * @brief		Socket of the modem driver, packets are decoded on arrival. Fails while the link is down.
+ */
+BOOL __wrap_GM862_SendThroughSocket(uint8_t *packet, uint16_t packetLength)
+{
+	uint16_t length;
+
+	uint8_t version = packet[packet[0] == PACKET_SYNC_BATCH ? TEST_BATCH_VERSION_OFFSET : TEST_PACKET_VERSION_OFFSET];
+
+	Host_AdvanceOSTime(TEST_SEND_TICKS);
+
+	memcpy(_lastPacket, packet, packetLength);
+	_lastLength = packetLength;
+
+	// Reference gets packets in the order they are packed, those from the outbox it already had
+	if (!(version & PACKET_FLAG_OUTBOX))
+		PacketDecoder_DecodePacket(&_reference, packet, packetLength, &length);
+
+	if (_linkDown)
+	{
+		_failedCount++;
+		return FALSE;
+	}
+
+	_sentCount++;
+	_lastResult = PacketDecoder_DecodePacket(&_decoder, packet, packetLength, &length);
+	if (_lastResult == PACKET_OK && length != packetLength)
+		_lastResult = PACKET_FRAMING_ERROR;
+
+	return TRUE;
+}
+
+/*
+ * @brief		Bus traffic of one telemetry interval, then the interval passes
+ */
+static void PassInterval()
+{
+	CAN_MSG_Type msg;
+	uint32_t second, i;
+
+	for (i = 0; i < TEST_FRAMES_PER_INTERVAL; i++, _frame++)
+	{
+		SyntheticTraffic_MakeFrame(_frame, &msg);
+		SensorDataManager_PutCanData(&msg, CAN2_CTRL, _frame);
+	}
+
+	Host_AdvanceOSTime(TELEMETRY_INTERVAL);
+
+	// Clock ticks a second, the test doesn't run past the hour (the peripheral library takes seconds up to 58)
+	second = RTC_GetTime(LPC_RTC, RTC_TIMETYPE_SECOND) + 1;
+	if (second == RTC_SECOND_MAX)
+	{
+		second = 0;
+		RTC_SetTime(LPC_RTC, RTC_TIMETYPE_MINUTE, RTC_GetTime(LPC_RTC, RTC_TIMETYPE_MINUTE) + 1);
+	}
+	RTC_SetTime(LPC_RTC, RTC_TIMETYPE_SECOND, second);
+}
+
+static void PutTemperature(int8_t temperature)
+{
+	CAN_MSG_Type msg;
+
+	memset(&msg, 0, sizeof(CAN_MSG_Type));
+	msg.format = STD_ID_FORMAT;
+	msg.id = SYNTHETIC_ID_BMS;
+	msg.len = 8;
+	msg.dataA[3] = TEST_SUB_INDEX_TEMPERATURE;
+	msg.dataB[0] = temperature;
+	SensorDataManager_PutCanData(&msg, CAN2_CTRL, _frame);
+}
+
+/*
+ * @brief		Pack sensor data every interval until a batch goes out, intervals without tables ready (byte budget)
+ * 				add no record
+ * @return		TRUE if the batch was sent, FALSE if sending failed
+ */
+static BOOL SendBatch()
+{
+	uint32_t attempts = _sentCount + _failedCount;
+	BOOL result = TRUE;
+	uint8_t i;
+
+	for (i = 0; i < TEST_BATCH_INTERVALS && _sentCount + _failedCount == attempts; i++)
+	{
+		PassInterval();
+		result = TelemetryTask_SendSensorData();
+	}
+
+	CHECK(_sentCount + _failedCount == attempts + 1);
+	CHECK(_lastPacket[0] == PACKET_SYNC_BATCH);
+
+	return result;
+}
+
+static void TestBatching()
+{
+	TELEMETRY_BATCH_STATS_T stats;
+	uint32_t records;
+
+	// The schema goes out with the first batches, tables can't be decoded before
+	SensorDataManager_RequestSchema();
+	while (!PacketDecoder_SchemaComplete(&_decoder) && _sentCount < TEST_SCHEMA_BATCHES)
+		CHECK(SendBatch());
+	CHECK(PacketDecoder_SchemaComplete(&_decoder));
+
+	// A batch is sent once it holds a record of TELEMETRY_BATCH_SIZE intervals
+	records = _decoder.stats.records;
+	CHECK(SendBatch());
+	CHECK(_lastPacket[TEST_BATCH_COUNT_OFFSET] == TELEMETRY_BATCH_SIZE);
+	CHECK(_lastResult == PACKET_OK);
+	CHECK(_decoder.stats.records == records + TELEMETRY_BATCH_SIZE);
+
+	// The newest record only waits for the send, the oldest one for every interval after it
+	TelemetryTask_GetBatchStats(&stats);
+	CHECK(stats.batches == _sentCount);
+	CHECK(stats.records == _sentCount * TELEMETRY_BATCH_SIZE);
+	CHECK(stats.sendTime == _sentCount * TEST_SEND_TICKS * 1000 / CFG_SYSTICK_FREQ);
+	CHECK(stats.lastLatency == TEST_SEND_TICKS * 1000 / CFG_SYSTICK_FREQ);
+	CHECK(stats.maxLatency >= ((TELEMETRY_BATCH_SIZE - 1) * TELEMETRY_INTERVAL + TEST_SEND_TICKS) * 1000 /
+			CFG_SYSTICK_FREQ);
+	CHECK(stats.totalLatency >= stats.records * stats.lastLatency);
+}
+
+static void TestUrgentFlush()
+{
+	TELEMETRY_BATCH_STATS_T stats;
+	uint32_t sent = _sentCount;
+	uint32_t alarms = _events[PACKET_EVENT_ALARM];
+
+	// Alarm rule trips, the state change goes out in a packet of its own
+	PassInterval();
+	PutTemperature(TEST_HOT_TEMPERATURE);
+	CHECK(TelemetryTask_SendAlarms());
+	CHECK(_sentCount == sent + 1);
+	CHECK(_lastPacket[0] == PACKET_SYNC);
+	CHECK(_events[PACKET_EVENT_ALARM] > alarms);
+
+	// The record with the BMS table doesn't wait for the batch to fill up
+	CHECK(TelemetryTask_SendSensorData());
+	CHECK(_sentCount == sent + 2);
+	CHECK(_lastPacket[0] == PACKET_SYNC_BATCH);
+	CHECK(_lastPacket[TEST_BATCH_COUNT_OFFSET] == 1);
+	CHECK(_lastResult == PACKET_OK);
+
+	TelemetryTask_GetBatchStats(&stats);
+	CHECK(stats.lastLatency == TEST_SEND_TICKS * 1000 / CFG_SYSTICK_FREQ);
+
+	// Alarm clears, batches fill up again
+	PassInterval();
+	CHECK(TelemetryTask_SendAlarms());
+	CHECK(_sentCount == sent + 3);
+	CHECK(TelemetryTask_SendSensorData());
+	CHECK(_sentCount == sent + 3);
+
+	CHECK(SendBatch());
+	CHECK(_lastPacket[TEST_BATCH_COUNT_OFFSET] == TELEMETRY_BATCH_SIZE);
+}
+
+static void TestOutbox()
+{
+	static uint8_t failed[TELEMETRY_BATCH_BUFFER_SIZE];
+	uint32_t sent = _sentCount;
+	uint32_t matched, mismatched, deltas;
+	uint16_t failedLength;
+	BOOL outboxSent;
+
+	// Batch fails to send and is stored, the records are gone from the sensor data manager
+	_linkDown = TRUE;
+	CHECK(!SendBatch());
+	CHECK(_failedCount == 1);
+	memcpy(failed, _lastPacket, _lastLength);
+	failedLength = _lastLength;
+
+	// Packets packed meanwhile take the live tables further
+	_linkDown = FALSE;
+	CHECK(SendBatch());
+	CHECK(SendBatch());
+	_linkDown = TRUE;
+
+	// Alarms aren't stored, they stay pending
+	PutTemperature(TEST_HOT_TEMPERATURE);
+	CHECK(!TelemetryTask_SendAlarms());
+	CHECK(_failedCount == 2);
+
+	CHECK(!TelemetryTask_SendOutbox(&outboxSent));
+	CHECK(!outboxSent);
+	CHECK(_failedCount == 3);
+
+	// Link is back: the pending alarm first, then the outbox drains packet by packet
+	_linkDown = FALSE;
+	CHECK(TelemetryTask_SendAlarms());
+	CHECK(_sentCount == sent + 3);
+
+	// Sent as stored, marked for shore side. Its tables come out as packed, those it can't be decoded without are
+	// skipped.
+	mismatched = _tablesMismatched;
+	CHECK(TelemetryTask_SendOutbox(&outboxSent));
+	CHECK(outboxSent);
+	CHECK(_sentCount == sent + 4);
+	CHECK(_lastLength == failedLength);
+	CHECK(_lastPacket[TEST_BATCH_VERSION_OFFSET] == (failed[TEST_BATCH_VERSION_OFFSET] | PACKET_FLAG_OUTBOX));
+	CHECK(memcmp(_lastPacket + TEST_BATCH_VERSION_OFFSET + 1, failed + TEST_BATCH_VERSION_OFFSET + 1,
+			failedLength - TEST_BATCH_VERSION_OFFSET - 1 - sizeof(uint16_t)) == 0);
+	CHECK(_lastResult == PACKET_OK);
+	CHECK(_decoder.stats.outboxPackets == 1);
+	CHECK(_tablesMismatched == mismatched);
+
+	CHECK(TelemetryTask_SendOutbox(&outboxSent));
+	CHECK(!outboxSent);
+	CHECK(_sentCount == sent + 4);
+
+	// Live tables still build on those before the outbox packet, without a keyframe
+	matched = _tablesMatched;
+	deltas = _decoder.stats.deltasSkipped;
+	PassInterval();
+	CHECK(TelemetryTask_SendAlarms());
+	CHECK(SendBatch());
+	CHECK(SendBatch());
+	CHECK(_tablesMatched > matched);
+	CHECK(_tablesMismatched == mismatched);
+	CHECK(_decoder.stats.deltasSkipped == deltas);
+}
+
+static void TestHistory()
+{
+	const SENSOR_HISTORY_RECORD_T *record;
+	uint32_t times[TEST_SNAPSHOTS];
+	uint32_t tables = _events[PACKET_EVENT_TABLE];
+	uint32_t sent, time;
+	uint8_t i;
+
+	// Link goes down, a snapshot is taken every interval
+	_linkDown = TRUE;
+	SensorHistory_Start();
+	for (i = 0; i < TEST_SNAPSHOTS; i++)
+	{
+		PassInterval();
+		SensorHistory_Sample();
+		CHECK((record = SensorHistory_Peek()) != NULL);
+	}
+
+	// Upload fails, the snapshot stays
+	record = SensorHistory_Peek();
+	time = record->time;
+	CHECK(!TelemetryTask_SendHistory(record));
+	CHECK(SensorHistory_Peek() == record);
+
+	// Link is back: oldest first, every snapshot with the time it was taken
+	_linkDown = FALSE;
+	sent = _sentCount;
+	for (i = 0; (record = SensorHistory_Peek()) != NULL && i < TEST_SNAPSHOTS; i++)
+	{
+		times[i] = record->time;
+		CHECK(TelemetryTask_SendHistory(record));
+		SensorHistory_Pop();
+
+		memcpy(&time, _lastPacket + TEST_PACKET_TIME_OFFSET, sizeof(uint32_t));
+		CHECK(_lastPacket[0] == PACKET_SYNC);
+		CHECK(_lastResult == PACKET_OK);
+		CHECK(time == times[i]);
+		CHECK(_lastEventTime == times[i]);
+		CHECK(i == 0 || times[i] > times[i - 1]);
+	}
+
+	CHECK(i == TEST_SNAPSHOTS);
+	CHECK(_sentCount == sent + TEST_SNAPSHOTS);
+	CHECK(_events[PACKET_EVENT_TABLE] >= tables + TEST_SNAPSHOTS * TEST_SNAPSHOT_TABLES);
+	CHECK(SensorHistory_Peek() == NULL);
+	CHECK(SensorHistory_Stop());
+	CHECK(!SensorHistory_Stop());
+}
+
+int main()
+{
+	RTC_TIME_Type time = { 0, 0, 12, 1, 1, 152, 6, 2026 };
+	pthread_t thread;
+
+	RTC_SetFullTime(LPC_RTC, &time);
+	PacketDecoder_Init(&_decoder, HandleEvent, NULL);
+	PacketDecoder_Init(&_reference, HandleReferenceEvent, NULL);
+
+	// Blank card
+	f_mount(0, &_testFatFs);
+	CHECK(f_mkfs(0, 1, 0) == FR_OK);
+
+	CHECK(SensorDataManager_Init());
+	pthread_create(&thread, NULL, StorageTask, NULL);
+	WAIT_UNTIL(_outboxReady);
+	CHECK(_outboxReady);
+
+	TestBatching();
+	TestUrgentFlush();
+	TestOutbox();
+	TestHistory();
+
+	// Every table shore side decoded has the values it was packed with
+	CHECK(_tablesMatched > 0);
+	CHECK(_tablesMismatched == 0);
+	CHECK(_referenceCount < TEST_REFERENCE_TABLES);
+
+	// Statistics report goes through
+	TelemetryTask_ReportStats();
+	CHECK(Host_GetDebugCount(DM_FATAL_ERROR) == 0);
+
+	if (_failures != 0)
+	{
+		printf("FAILED: %u of %u checks\n", _failures, _checks);
+		return 1;
+	}
+
+	printf("PASSED: %u checks\n", _checks);
+	return 0;
+}
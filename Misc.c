@@ -52,3 +52,26 @@ time_t ConvertRtcToUnixTime(RTC_TIME_Type *rtcTime)
 
 	return mktime(&tmTime);
 }
+
+void EnableCycleCounter()
+{
+	// Enable trace block, then start the DWT cycle counter
+	DEMCR |= DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+void EnableMicrosecondTimer()
+{
+	// Timer already running (shared by multiple tasks)
+	if (LPC_TIM0->TCR & 1)
+		return;
+
+	// Power up TIMER0 and let it count from PCLK divided down to 1 MHz
+	CLKPWR_ConfigPPWR(CLKPWR_PCONP_PCTIM0, ENABLE);
+	LPC_TIM0->TCR = 2; // reset
+	LPC_TIM0->CTCR = 0; // timer mode
+	LPC_TIM0->PR = CLKPWR_GetPCLK(CLKPWR_PCLKSEL_TIMER0) / 1000000UL - 1;
+	LPC_TIM0->MCR = 0; // no match actions, free-running
+	LPC_TIM0->TCR = 1; // enable
+}
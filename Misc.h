@@ -7,16 +7,61 @@
 #include <stdio.h>
 #include <time.h>
 
+#include <lpc17xx_clkpwr.h>
 #include <lpc17xx_rtc.h>
 
 /* Defines */
 
 #define CRC16_POLYNOMIAL		0x8408
 
+#ifndef HOST_BUILD
+
+// Cortex-M3 DWT cycle counter (runs at core clock once enabled)
+#define DWT_CTRL				(*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT				(*(volatile uint32_t *)0xE0001004)
+#define DEMCR					(*(volatile uint32_t *)0xE000EDFC)
+
+// Data memory barrier that also keeps the compiler from moving memory accesses across it
+// (__DMB() of this CMSIS version lacks the memory clobber)
+#define DATA_MEMORY_BARRIER()	__ASM volatile ("dmb" ::: "memory")
+
+// Free-running microsecond counter (TIMER0 at 1 MHz, wraps every 71.6 minutes)
+#define MICROSECOND_TIMER		(LPC_TIM0->TC)
+
+#else
+
+// Host build (see Host/Makefile): the cycle counter counts nanoseconds of the host clock and SystemCoreClock is
+// 1 GHz, the microsecond timer follows the same clock
+#define DWT_CTRL				(Host_DwtCtrl)
+#define DWT_CYCCNT				(*Host_CycleCounter())
+#define DEMCR					(Host_Demcr)
+
+#define DATA_MEMORY_BARRIER()	__sync_synchronize()
+
+#define MICROSECOND_TIMER		(Host_MicrosecondTimer())
+
+#endif
+
+#define DWT_CTRL_CYCCNTENA		(1UL << 0)
+#define DEMCR_TRCENA			(1UL << 24)
+
+// Convert a DWT cycle count into microseconds
+#define CYCLES_TO_MICROSECONDS(c)	((c) / (SystemCoreClock / 1000000UL))
+
 /* Prototypes */
 
 unsigned short CalculateCrc16(char *data_p, unsigned short length);
 
 time_t ConvertRtcToUnixTime(RTC_TIME_Type *rtcTime);
 
+void EnableCycleCounter();
+void EnableMicrosecondTimer();
+
+#ifdef HOST_BUILD
+extern volatile uint32_t Host_DwtCtrl;
+extern volatile uint32_t Host_Demcr;
+volatile uint32_t *Host_CycleCounter();
+uint32_t Host_MicrosecondTimer();
+#endif
+
 #endif
@@ -1,7 +1,10 @@
 
 /* Includes */
 
+#include <stddef.h>
+
 #include "SensorDataManager.h"
+#include "CanTask.h"
 
 /* Defines */
 
@@ -23,17 +26,150 @@
 #define TABLE_MPPT_FULL_MASK				0b0000000011111111
 #define TABLE_TEMPERATURE_FULL_MASK			0b0000000001111111
 
+// GPS fixes older than this (CoOS ticks) are not sent
+#define TABLE_TRACKING_MAX_AGE				(5 * CFG_SYSTICK_FREQ)
+
+// Byte budget of the link (bytes per second), halved on every failed send and raised in steps on success
+#define TABLE_BUDGET_RATE_MAX				160
+#define TABLE_BUDGET_RATE_MIN				20
+#define TABLE_BUDGET_RATE_STEP				8
+
+// Bytes that may be sent at once after a quiet period
+#define TABLE_BUDGET_BURST					512
+
+// Bytes of a packet besides its tables (sync, size, schema version, id, timestamp and checksum)
+#define TABLE_PACKET_OVERHEAD				13
+
+// Number of entries in the send schedule
+#define SCHEDULE_COUNT						(sizeof(_schedule) / sizeof(_schedule[0]))
+
+// Schedule entry: send <entry> at most every <minInterval> seconds within the byte budget, and regardless
+// of the budget once it wasn't sent for <maxStaleness> seconds (0 is unbounded)
+#define SCHEDULE(entry, minInterval, maxStaleness) \
+	{ (entry), (minInterval) * CFG_SYSTICK_FREQ, (maxStaleness) * CFG_SYSTICK_FREQ }
+
+// Sensor tables are sent as the fields that changed since the last acknowledged table (delta tables)
+#define TABLE_DELTA_ENABLED					1
+
+// Tables with aggregates are sent as min, max and mean of every field since they were sent last (aggregate tables,
+// 1 = enabled). Aggregate tables are always sent in full: the MPPT table grows from 36 to 102 bytes and BMS
+// tables are no longer delta encoded, so only enable them when the extremes between packets matter more than bytes.
+#define TABLE_AGGREGATE_ENABLED				0
+
+// Every this many calls of SensorDataManager_GetTables() sensor tables are sent in full (keyframe)
+#define TABLE_DELTA_KEYFRAME_INTERVAL		20
+
+// Table ID of a delta table, followed by the timestamp, a 16 bit field bitmap and the fields in the bitmap
+#define TABLE_ID_DELTA(id)					((id) | 0x80)
+
+// Size of the largest sensor table
+#define TABLE_MAX_SIZE						sizeof(TableMppt_t)
+
+// Number of entries in a field list
+#define TABLE_FIELD_COUNT(fields)			(sizeof(fields) / sizeof(fields[0]))
+
+// Field of <type> in <unit>, changes of at most <deadband> (in table units) are not sent in delta tables
+#define TABLE_FIELD(type, field, fieldType, unit, deadband) \
+	{ offsetof(type, field), (fieldType), (deadband), 1.0f, 0.0f, #field, (unit) }
+
+// Field of <type> holding (value - <bias>) / <scale>, converted when decoded
+#define TABLE_SCALED_FIELD(type, field, fieldType, scale, bias, unit, deadband) \
+	{ offsetof(type, field), (fieldType), (deadband), (scale), (bias), #field, (unit) }
+
+// Sensor table fields are described to the shore side by schema tables, one field per packet, once every
+// SensorDataManager_RequestSchema()
+#define TABLE_SCHEMA_ENABLED				1
+
+// Alarm rules are checked as frames are decoded, state changes are sent right away in an alarm packet
+#define ALARM_ENABLED						1
+
+// Number of entries in the alarm rule list, at most 16
+#define ALARM_COUNT							(sizeof(_alarmRules) / sizeof(_alarmRules[0]))
+
+// Rates of change are measured over at least this many microseconds (MICROSECOND_TIMER)
+#define ALARM_RATE_WINDOW					5000000
+
+// Alarm rule: trip when <field> of <table> (in the unit of the field) or its rate of change (unit per second)
+// crosses <threshold>, clear once it is back by <hysteresis>
+#define ALARM(table, type, field, condition, threshold, hysteresis) \
+	{ (table), offsetof(type, field), (condition), (threshold), (hysteresis) }
+
+// Number of entries in the CAN filter list
+#define CAN_FILTER_COUNT					(sizeof(_canFilter) / sizeof(_canFilter[0]))
+
+// Number of sensor tables decoded into
+#define DECODER_TABLE_COUNT					(sizeof(_decoderTables) / sizeof(_decoderTables[0]))
+
+// Number of entries in the decoder list
+#define DECODER_COUNT						(sizeof(_decoders) / sizeof(_decoders[0]))
+
+// Decoder entry matching every frame of a message, regardless of its SUB_INDEX
+#define SI_ANY								0xFF
+
+// Key of a message received by controller <ctrl>, extended identifiers are matched on their PGN (bits 8..23)
+#define DECODER_KEY(ctrl, format, id)		(((uint32_t)(ctrl) << 30) | ((uint32_t)(format) << 29) | (id))
+
+// Decoder entry: copy the <dataType> value at <offset> of the data bytes (dataA followed by dataB) of message <id>
+// with sub-index <subIndex> to <field> of <table>, then set <readyBit> in its ready mask
+#define DECODER(ctrl, format, id, subIndex, offset, dataType, table, type, field, readyBit) \
+	{ DECODER_KEY(ctrl, format, id), (subIndex), (offset), (dataType), (table), offsetof(type, field), _BIT(readyBit) }
+
 /* Enumerators */
 
 typedef enum {
 
 	TABLE_ID_BMS							= 0x01,
 	TABLE_ID_TRACKING						= 0x02,
-	TABLE_ID_MPPT 							= 0x03,
-	TABLE_ID_TEMPERATURE					= 0x04
+	TABLE_ID_MPPT 							= 0x03,	// float layout, no longer sent
+	TABLE_ID_TEMPERATURE					= 0x04,
+	TABLE_ID_CAN_STATISTICS					= 0x05,
+	TABLE_ID_BMS_AGGREGATE					= 0x06,
+	TABLE_ID_MPPT_AGGREGATE					= 0x07,	// float layout, no longer sent
+	TABLE_ID_MPPT_SCALED					= 0x08,
+	TABLE_ID_MPPT_SCALED_AGGREGATE			= 0x09,
+	TABLE_ID_SCHEMA							= 0x0A,
+	TABLE_ID_ALARM							= 0x0B
 
 } TABLE_ID;
 
+typedef enum {
+
+	DECODER_TABLE_BMS						= 0,
+	DECODER_TABLE_MPPT						= 1,
+	DECODER_TABLE_TEMPERATURE				= 2
+
+} DECODER_TABLE;
+
+typedef enum {
+
+	FIELD_UINT8								= 0,
+	FIELD_INT8								= 1,
+	FIELD_UINT16							= 2,
+	FIELD_INT16								= 3,
+	FIELD_FLOAT								= 4
+
+} FIELD_TYPE;
+
+typedef enum {
+
+	SCHEDULE_TRACKING						= 0,
+	SCHEDULE_BMS							= 1,
+	SCHEDULE_MPPT							= 2,
+	SCHEDULE_TEMPERATURE					= 3,
+	SCHEDULE_CAN_STATISTICS					= 4,
+	SCHEDULE_SCHEMA							= 5
+
+} SCHEDULE_ENTRY;
+
+typedef enum {
+
+	ALARM_ABOVE								= 0,	// value above threshold
+	ALARM_BELOW								= 1,	// value below threshold
+	ALARM_RISE								= 2,	// value rising faster than threshold
+	ALARM_FALL								= 3		// value falling faster than threshold
+
+} ALARM_CONDITION;
+
 typedef enum {
 
 	BMS_VOLTAGE								= 0,
@@ -80,8 +216,10 @@ typedef enum {
 
 /* Structs */
 
+// Sensor tables start with the reception time of the latest frame decoded into them (MICROSECOND_TIMER)
 typedef struct {
 
+	uint32_t timestamp __attribute__ ((__packed__));
 	uint16_t voltage __attribute__ ((__packed__));
 	int16_t currentIn __attribute__ ((__packed__));
 	int16_t currentOut __attribute__ ((__packed__));
@@ -90,29 +228,32 @@ typedef struct {
 
 } TableBms_t;
 
+// MPPT values in units of their scale, see _mpptFields
 typedef struct {
 
-	float currentIn1 __attribute__ ((__packed__));
-	float currentIn2 __attribute__ ((__packed__));
-	float currentIn3 __attribute__ ((__packed__));
-	float currentIn4 __attribute__ ((__packed__));
-	float voltageIn1 __attribute__ ((__packed__));
-	float voltageIn2 __attribute__ ((__packed__));
-	float voltageIn3 __attribute__ ((__packed__));
-	float voltageIn4 __attribute__ ((__packed__));
-	float voltageOut1 __attribute__ ((__packed__));
-	float voltageOut2 __attribute__ ((__packed__));
-	float voltageOut3 __attribute__ ((__packed__));
-	float voltageOut4 __attribute__ ((__packed__));
-	float powerIn1 __attribute__ ((__packed));
-	float powerIn2 __attribute__ ((__packed));
-	float powerIn3 __attribute__ ((__packed));
-	float powerIn4 __attribute__ ((__packed));
+	uint32_t timestamp __attribute__ ((__packed__));
+	int16_t currentIn1 __attribute__ ((__packed__));
+	int16_t currentIn2 __attribute__ ((__packed__));
+	int16_t currentIn3 __attribute__ ((__packed__));
+	int16_t currentIn4 __attribute__ ((__packed__));
+	int16_t voltageIn1 __attribute__ ((__packed__));
+	int16_t voltageIn2 __attribute__ ((__packed__));
+	int16_t voltageIn3 __attribute__ ((__packed__));
+	int16_t voltageIn4 __attribute__ ((__packed__));
+	int16_t voltageOut1 __attribute__ ((__packed__));
+	int16_t voltageOut2 __attribute__ ((__packed__));
+	int16_t voltageOut3 __attribute__ ((__packed__));
+	int16_t voltageOut4 __attribute__ ((__packed__));
+	int16_t powerIn1 __attribute__ ((__packed__));
+	int16_t powerIn2 __attribute__ ((__packed__));
+	int16_t powerIn3 __attribute__ ((__packed__));
+	int16_t powerIn4 __attribute__ ((__packed__));
 
 } TableMppt_t;
 
 typedef struct {
 
+	uint32_t timestamp __attribute__ ((__packed__));
 	uint8_t sensor1 __attribute__ ((__packed__));
 	uint8_t sensor2 __attribute__ ((__packed__));
 	uint8_t sensor3 __attribute__ ((__packed__));
@@ -123,205 +264,1569 @@ typedef struct {
 
 } TableTemperature_t;
 
+typedef struct {
+
+	uint16_t ringOverflows __attribute__ ((__packed__));
+	uint16_t dataOverruns __attribute__ ((__packed__));
+	uint8_t errorPassive __attribute__ ((__packed__));
+	uint8_t busOff __attribute__ ((__packed__));
+	uint8_t peakRingOccupancy __attribute__ ((__packed__));
+	uint8_t load __attribute__ ((__packed__));	// bus load since previous table (%)
+
+} TableCanStatistics_t;
+
+// State change of an alarm rule
+typedef struct {
+
+	uint8_t rule __attribute__ ((__packed__));			// index in _alarmRules
+	uint8_t table __attribute__ ((__packed__));			// TABLE_ID of the checked field
+	uint8_t field __attribute__ ((__packed__));			// index of the checked field, as in schema tables
+	uint8_t condition __attribute__ ((__packed__));		// ALARM_CONDITION
+	uint8_t active __attribute__ ((__packed__));		// 1 if tripped, 0 if cleared
+	float value __attribute__ ((__packed__));			// value or rate of change at the state change
+	uint32_t delay __attribute__ ((__packed__));		// microseconds from state change to packing
+
+} TableAlarm_t;
+
+typedef struct {
+
+	uint32_t key;		// controller (bit 30), identifier format (bit 29) and standard identifier or PGN
+	uint8_t subIndex;	// SUB_INDEX (data byte 3) or SI_ANY
+	uint8_t offset;		// first data byte
+	uint8_t type;		// FIELD_TYPE of data bytes
+	uint8_t table;		// DECODER_TABLE
+	uint8_t field;		// byte offset of destination field in table
+	uint16_t readyBit;	// bit to set in ready mask of table
+
+} DECODER_T;
+
+typedef struct {
+
+	uint8_t offset;		// byte offset in table
+	uint8_t type;		// FIELD_TYPE
+	float deadband;
+	float scale;		// value of one unit
+	float bias;			// value at zero
+	const char *name;
+	const char *unit;	// of value, empty if unknown
+
+} TABLE_FIELD_T;
+
+// Running aggregate of a table field. Without samples min and max hold the value at the start of the window.
+typedef struct {
+
+	float min;
+	float max;
+	float sum;
+	uint16_t count;
+
+} FIELD_AGGREGATE_T;
+
+typedef struct {
+
+	uint8_t *table;
+	uint8_t size;
+	uint8_t id;					// TABLE_ID
+	uint16_t fullMask;			// ready bits of a complete table
+	const char *collected;		// debug message
+	const TABLE_FIELD_T *fields;	// fields after the timestamp, in table order
+	uint8_t fieldCount;
+	uint8_t *reference;			// table as last acknowledged by SensorDataManager_AcknowledgeTables()
+	uint8_t *pending;			// table as sent in the packet waiting for acknowledgement
+	uint8_t aggregateId;		// TABLE_ID of aggregate table
+	FIELD_AGGREGATE_T *aggregates;			// per field, NULL if the table isn't aggregated
+	FIELD_AGGREGATE_T *pendingAggregates;	// aggregates sent in the packet waiting for acknowledgement
+
+} DECODER_TABLE_T;
+
+// Sequence lock of a sensor table. Every table has a single writer (the CAN task), readers
+// retry until they copied the table between two equal, even sequence numbers.
+typedef struct {
+
+	volatile uint32_t sequence;		// odd while the table is written
+	volatile uint16_t dataReady;	// fields decoded since start-up
+
+} TABLE_LOCK_T;
+
+// Transmission state of a sensor table, used by the telemetry task
+typedef struct {
+
+	uint32_t sentSequence;			// sequence of the table acknowledged last
+	uint32_t pendingSequence;		// sequence of the table waiting for acknowledgement
+	BOOL pending;					// table is in the packet waiting for acknowledgement
+	BOOL keyframeDue;				// send the full table, shore side has no (recent) copy
+	uint16_t aggregateFrames;		// frames decoded into the table in the current aggregate window (CAN task)
+	uint16_t pendingAggregateFrames;	// frames of the aggregate window waiting for acknowledgement
+
+} TABLE_SEND_T;
+
+typedef struct {
+
+	uint8_t entry;				// SCHEDULE_ENTRY
+	uint16_t minInterval;		// CoOS ticks
+	uint16_t maxStaleness;		// CoOS ticks, 0 is unbounded
+
+} TABLE_SCHEDULE_T;
+
+typedef struct {
+
+	uint8_t table;				// DECODER_TABLE
+	uint8_t field;				// byte offset of checked field in table
+	uint8_t condition;			// ALARM_CONDITION
+	float threshold;
+	float hysteresis;
+
+} ALARM_RULE_T;
+
+// State of an alarm rule. Changes are made by the CAN task and taken by the telemetry task, both with the
+// scheduler locked.
+typedef struct {
+
+	BOOL active;				// rule is tripped
+	BOOL pending;				// state change waiting to be packed
+	BOOL sending;				// state change in the alarm packet waiting for acknowledgement
+	float value;				// value or rate of change at the state change
+	uint32_t changeTime;		// MICROSECOND_TIMER at the state change
+	uint32_t sendingChangeTime;	// changeTime of the state change waiting for acknowledgement
+	BOOL rateValid;				// rateValue and rateTime hold the start of the rate window (CAN task)
+	float rateValue;
+	uint32_t rateTime;			// reception time of rateValue
+
+} ALARM_STATE_T;
+
 /* Variables */
 
-static OS_MutexID _dataMutexId;
+// CAN identifiers decoded by SensorDataManager_PutCanData(), used to set up the acceptance filter.
+// The CAN statistics table starts with one 16 bit frame counter per entry, in this order.
+static const CAN_FILTER_ENTRY_T _canFilter[] = {
+
+	// Drivetrain bus (CAN1): add the motor controller identifiers once they are decoded. The acceptance filter can't
+	// be bypassed per controller and CAN1 identifiers must stay below the CAN2 identifiers of a section, so there is
+	// no catch-all range here.
+	// Sensor bus (CAN2)
+	CAN_FILTER_STD_ID(CAN2_CTRL, MESSAGE_PGN_BMS),
+	CAN_FILTER_STD_ID(CAN2_CTRL, MESSAGE_PGN_BMS_TEMP),
+	// MPPT frames are kept in FullCAN message objects, outside the ring buffers
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT1A),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT1B),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT2A),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT2B),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT3A),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT3B),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT4A),
+	CAN_FILTER_FULLCAN_ID(CAN2_CTRL, MESSAGE_PGN_MPPT4B),
+	CAN_FILTER_PGN_ID(CAN2_CTRL, MESSAGE_PGN_TEMPERATURE)
+
+};
+
+// Decoded fields, sorted by key (i.e. controller, format and identifier) for binary search. Entries of the same message
+// are adjacent. Adding a sensor value is a single entry.
+static const DECODER_T _decoders[] = {
+
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT1A, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, currentIn1, MPPT1A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT1A, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageIn1, MPPT1A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT2A, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, currentIn2, MPPT2A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT2A, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageIn2, MPPT2A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT3A, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, currentIn3, MPPT3A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT3A, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageIn3, MPPT3A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT4A, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, currentIn4, MPPT4A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT4A, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageIn4, MPPT4A),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT1B, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageOut1, MPPT1B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT1B, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, powerIn1, MPPT1B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT2B, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageOut2, MPPT2B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT2B, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, powerIn2, MPPT2B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT3B, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageOut3, MPPT3B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT3B, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, powerIn3, MPPT3B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT4B, SI_ANY, 0, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, voltageOut4, MPPT4B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_MPPT4B, SI_ANY, 4, FIELD_FLOAT, DECODER_TABLE_MPPT, TableMppt_t, powerIn4, MPPT4B),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS, SI_BMS_VOLTAGE, 4, FIELD_UINT16, DECODER_TABLE_BMS, TableBms_t, voltage, BMS_VOLTAGE),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS, SI_BMS_CURRENT_CHARGE, 4, FIELD_INT16, DECODER_TABLE_BMS, TableBms_t, currentIn, BMS_CURRENT_IN),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS, SI_BMS_CURRENT_DISCHARGE, 4, FIELD_INT16, DECODER_TABLE_BMS, TableBms_t, currentOut, BMS_CURRENT_OUT),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS, SI_BMS_STATE_OF_CHARGE, 4, FIELD_UINT8, DECODER_TABLE_BMS, TableBms_t, stateOfCharge, BMS_STATE_OF_CHARGE),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS, SI_BMS_CELL_TEMP_HIGH, 4, FIELD_INT8, DECODER_TABLE_BMS, TableBms_t, temperature, BMS_TEMPERATURE),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS_TEMP, SI_BMS_VOLTAGE, 4, FIELD_UINT16, DECODER_TABLE_BMS, TableBms_t, voltage, BMS_VOLTAGE),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS_TEMP, SI_BMS_CURRENT_CHARGE, 4, FIELD_INT16, DECODER_TABLE_BMS, TableBms_t, currentIn, BMS_CURRENT_IN),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS_TEMP, SI_BMS_CURRENT_DISCHARGE, 4, FIELD_INT16, DECODER_TABLE_BMS, TableBms_t, currentOut, BMS_CURRENT_OUT),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS_TEMP, SI_BMS_STATE_OF_CHARGE, 4, FIELD_UINT8, DECODER_TABLE_BMS, TableBms_t, stateOfCharge, BMS_STATE_OF_CHARGE),
+	DECODER(CAN2_CTRL, STD_ID_FORMAT, MESSAGE_PGN_BMS_TEMP, SI_BMS_CELL_TEMP_HIGH, 4, FIELD_INT8, DECODER_TABLE_BMS, TableBms_t, temperature, BMS_TEMPERATURE),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 0, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor1, TEMPERATURE_SENSOR1),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 1, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor2, TEMPERATURE_SENSOR2),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 2, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor3, TEMPERATURE_SENSOR3),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 3, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor4, TEMPERATURE_SENSOR4),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 4, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor5, TEMPERATURE_SENSOR5),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 5, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, sensor6, TEMPERATURE_SENSOR6),
+	DECODER(CAN2_CTRL, EXT_ID_FORMAT, MESSAGE_PGN_TEMPERATURE, SI_ANY, 6, FIELD_UINT8, DECODER_TABLE_TEMPERATURE, TableTemperature_t, reference, TEMPERATURE_REFERENCE)
+
+};
+
+// Schema of the sensor tables, at most 16 fields per table. MPPT currents, voltages and powers are sent as
+// 16 bit integers, in mA, 10 mV and 100 mW. BMS voltage and currents are sent in the units of the BMS.
+// Change SENSOR_SCHEMA_VERSION when changing a table layout.
+static const TABLE_FIELD_T _bmsFields[] = {
+
+	TABLE_FIELD(TableBms_t, voltage, FIELD_UINT16, "", 1),
+	TABLE_FIELD(TableBms_t, currentIn, FIELD_INT16, "", 1),
+	TABLE_FIELD(TableBms_t, currentOut, FIELD_INT16, "", 1),
+	TABLE_FIELD(TableBms_t, stateOfCharge, FIELD_UINT8, "%", 0),
+	TABLE_FIELD(TableBms_t, temperature, FIELD_INT8, "C", 0)
 
-static TableBms_t _tableBms;
-static TableMppt_t _tableMppt;
-static TableTemperature_t _tableTemperature;
+};
 
-static uint16_t _bmsDataReady;
-static uint16_t _mpptDataReady;
-static uint16_t _temperatureDataReady;
+static const TABLE_FIELD_T _mpptFields[] = {
+
+	TABLE_SCALED_FIELD(TableMppt_t, currentIn1, FIELD_INT16, 0.001f, 0, "A", 50),
+	TABLE_SCALED_FIELD(TableMppt_t, currentIn2, FIELD_INT16, 0.001f, 0, "A", 50),
+	TABLE_SCALED_FIELD(TableMppt_t, currentIn3, FIELD_INT16, 0.001f, 0, "A", 50),
+	TABLE_SCALED_FIELD(TableMppt_t, currentIn4, FIELD_INT16, 0.001f, 0, "A", 50),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageIn1, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageIn2, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageIn3, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageIn4, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageOut1, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageOut2, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageOut3, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, voltageOut4, FIELD_INT16, 0.01f, 0, "V", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, powerIn1, FIELD_INT16, 0.1f, 0, "W", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, powerIn2, FIELD_INT16, 0.1f, 0, "W", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, powerIn3, FIELD_INT16, 0.1f, 0, "W", 10),
+	TABLE_SCALED_FIELD(TableMppt_t, powerIn4, FIELD_INT16, 0.1f, 0, "W", 10)
+
+};
+
+static const TABLE_FIELD_T _temperatureFields[] = {
+
+	TABLE_FIELD(TableTemperature_t, sensor1, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, sensor2, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, sensor3, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, sensor4, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, sensor5, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, sensor6, FIELD_UINT8, "C", 0),
+	TABLE_FIELD(TableTemperature_t, reference, FIELD_UINT8, "C", 0)
+
+};
+
+// Width of a field, indexed by FIELD_TYPE
+static const uint8_t _fieldWidths[] = { 1, 1, 2, 2, 4 };
+
+static TableBms_t _tableBms, _referenceBms, _pendingBms;
+static TableMppt_t _tableMppt, _referenceMppt, _pendingMppt;
+static TableTemperature_t _tableTemperature, _referenceTemperature, _pendingTemperature;
+
+static FIELD_AGGREGATE_T _bmsAggregates[TABLE_FIELD_COUNT(_bmsFields)];
+static FIELD_AGGREGATE_T _pendingBmsAggregates[TABLE_FIELD_COUNT(_bmsFields)];
+static FIELD_AGGREGATE_T _mpptAggregates[TABLE_FIELD_COUNT(_mpptFields)];
+static FIELD_AGGREGATE_T _pendingMpptAggregates[TABLE_FIELD_COUNT(_mpptFields)];
+
+// Destination of decoded fields, indexed by DECODER_TABLE, in order of transmission
+static const DECODER_TABLE_T _decoderTables[] = {
+
+	{ (uint8_t *)&_tableBms, sizeof(TableBms_t), TABLE_ID_BMS, TABLE_BMS_FULL_MASK, "BMS data collected.",
+			_bmsFields, TABLE_FIELD_COUNT(_bmsFields), (uint8_t *)&_referenceBms, (uint8_t *)&_pendingBms,
+			TABLE_ID_BMS_AGGREGATE, _bmsAggregates, _pendingBmsAggregates },
+	{ (uint8_t *)&_tableMppt, sizeof(TableMppt_t), TABLE_ID_MPPT_SCALED, TABLE_MPPT_FULL_MASK, "MPPT data collected.",
+			_mpptFields, TABLE_FIELD_COUNT(_mpptFields), (uint8_t *)&_referenceMppt, (uint8_t *)&_pendingMppt,
+			TABLE_ID_MPPT_SCALED_AGGREGATE, _mpptAggregates, _pendingMpptAggregates },
+	{ (uint8_t *)&_tableTemperature, sizeof(TableTemperature_t), TABLE_ID_TEMPERATURE, TABLE_TEMPERATURE_FULL_MASK,
+			"Temperature data collected.", _temperatureFields, TABLE_FIELD_COUNT(_temperatureFields),
+			(uint8_t *)&_referenceTemperature, (uint8_t *)&_pendingTemperature, 0, NULL, NULL }
+
+};
+
+static TABLE_LOCK_T _tableLocks[DECODER_TABLE_COUNT];
+static TABLE_SEND_T _tableSend[DECODER_TABLE_COUNT];
+static uint8_t _decoderFields[DECODER_COUNT]; // index in fields of the destination of every decoder
+static uint8_t _keyframeCountdown;
+
+// Send schedule, in order of priority. Temperatures back off first when the link degrades.
+static const TABLE_SCHEDULE_T _schedule[] = {
+
+	SCHEDULE(SCHEDULE_BMS, 2, 5),
+	SCHEDULE(SCHEDULE_TRACKING, 0, 5),
+	SCHEDULE(SCHEDULE_MPPT, 0, 10),
+	SCHEDULE(SCHEDULE_CAN_STATISTICS, 15, 120),
+	SCHEDULE(SCHEDULE_TEMPERATURE, 5, 60),
+	SCHEDULE(SCHEDULE_SCHEMA, 0, 0)
+
+};
+
+static uint32_t _scheduleSentTime[SCHEDULE_COUNT]; // OS time of the packet the entry was sent with last
+static uint32_t _schedulePending; // entries in the packet waiting for acknowledgement (bit per schedule index)
+static uint32_t _schedulePackTime; // OS time the packet waiting for acknowledgement was packed
+
+static int32_t _budget; // bytes that may be sent, times CFG_SYSTICK_FREQ
+static uint32_t _budgetRate; // bytes per second
+static uint32_t _budgetTime; // OS time of previous budget update
+
+static uint8_t _schemaTable; // DECODER_TABLE of next schema table
+static uint8_t _schemaField; // field of next schema table
+static BOOL _schemaDue; // schema tables are sent until every field is described
+
+// Alarm rules, in the units of the fields. The BMS temperature is its highest cell temperature.
+static const ALARM_RULE_T _alarmRules[] = {
+
+	ALARM(DECODER_TABLE_BMS, TableBms_t, temperature, ALARM_ABOVE, 55, 3),
+	ALARM(DECODER_TABLE_BMS, TableBms_t, temperature, ALARM_RISE, 0.5f, 0.3f),
+	ALARM(DECODER_TABLE_BMS, TableBms_t, stateOfCharge, ALARM_BELOW, 10, 2)
+
+};
+
+static ALARM_STATE_T _alarmStates[ALARM_COUNT];
+static uint8_t _alarmFields[ALARM_COUNT]; // index in fields of the field every alarm rule checks
+static uint16_t _decoderAlarms[DECODER_COUNT]; // alarm rules on the destination of every decoder (bit per rule)
+static OS_FlagID _alarmFlagId = E_CREATE_FAIL; // set by CAN task when an alarm rule changes state
+static ALARM_LATENCY_STATS_T _alarmLatencyStats;
+
+static uint32_t _gpsSentTime; // fix time of GPS fix acknowledged last
+static uint32_t _gpsPendingTime; // fix time of GPS fix waiting for acknowledgement
+
+static uint16_t _canFrameCount[CAN_FILTER_COUNT];
+static int8_t _decoderFilters[DECODER_COUNT]; // filter list entry of the message of every decoder, counts its frames
+static uint32_t _canStatisticsTime; // MICROSECOND_TIMER at previous CAN statistics table
+static uint32_t _canBits[CAN_CONTROLLER_COUNT]; // bits received at previous CAN statistics table
+
+static const uint32_t _canBitrates[CAN_CONTROLLER_COUNT] = { CAN1_BITRATE, CAN2_BITRATE };
+
+/* Prototypes */
+
+static int8_t SensorDataManager_GetFilterIndex(CAN_MSG_Type *msg, uint8_t controller);
+static int16_t SensorDataManager_FindDecoder(uint32_t key);
+static void SensorDataManager_BeginWrite(uint8_t table);
+static void SensorDataManager_EndWrite(uint8_t table);
+static uint32_t SensorDataManager_ReadTable(uint8_t table, uint8_t *dest, uint16_t *dataReady);
+static uint8_t SensorDataManager_EncodeDelta(uint8_t table, const uint8_t *snapshot, uint8_t *dest);
+static float SensorDataManager_GetFieldValue(const uint8_t *src, uint8_t type);
+static void SensorDataManager_SetFieldValue(uint8_t *dest, uint8_t type, float value);
+static uint8_t SensorDataManager_GetAggregateSize(uint8_t table);
+static void SensorDataManager_LockWriter(uint8_t table);
+static void SensorDataManager_TakeAggregates(uint8_t table, uint8_t *dest);
+static void SensorDataManager_RestoreAggregates(uint8_t table);
+static uint8_t SensorDataManager_PutTable(uint8_t entry, uint8_t *dest, uint16_t size);
+static uint8_t SensorDataManager_PutTracking(uint8_t *dest, uint16_t size);
+static uint8_t SensorDataManager_PutSensorTable(uint8_t table, uint8_t *dest, uint16_t size);
+static uint8_t SensorDataManager_PutCanStatistics(uint8_t *dest, uint16_t size);
+static uint8_t SensorDataManager_PutSchema(uint8_t *dest, uint16_t size);
+static void SensorDataManager_MoveToFront(uint8_t *tableBuffer, uint16_t bufferUsed, uint8_t size);
+static void SensorDataManager_Reverse(uint8_t *data, uint16_t size);
+static uint16_t SensorDataManager_CheckAlarms(uint16_t rules, float value, uint32_t timestamp);
 
 /* Implementation */
 
 BOOL SensorDataManager_Init()
 {
-	// Create mutex
-	_dataMutexId = CoCreateMutex();
-	if (_dataMutexId == E_CREATE_FAIL)
+	uint8_t i;
+
+	// Binary search requires the decoder list to be sorted
+	for (i = 1; i < DECODER_COUNT; i++)
 	{
+		if (_decoders[i].key < _decoders[i - 1].key)
+		{
+			Debug_Send(DM_FATAL_ERROR, "Decoder list is not sorted.");
+			return FALSE;
+		}
+	}
+
+	// Find the field every decoder writes to, for aggregation
+	for (i = 0; i < DECODER_COUNT; i++)
+	{
+		const DECODER_TABLE_T *table = &_decoderTables[_decoders[i].table];
+		uint8_t field;
+
+		for (field = 0; field < table->fieldCount && table->fields[field].offset != _decoders[i].field; field++);
+		if (field == table->fieldCount)
+		{
+			Debug_Send(DM_FATAL_ERROR, "Decoder writes to unknown field.");
+			return FALSE;
+		}
+
+		_decoderFields[i] = field;
+	}
+
+	// Find the filter list entry of every decoder, frames are counted without searching the filter list
+	for (i = 0; i < DECODER_COUNT; i++)
+	{
+		CAN_MSG_Type msg;
+
+		msg.format = (_decoders[i].key >> 29) & 1;
+		msg.id = _decoders[i].key & 0x1FFFFFFF;
+		if (msg.format == EXT_ID_FORMAT)
+			msg.id <<= 8;
+
+		_decoderFilters[i] = SensorDataManager_GetFilterIndex(&msg, _decoders[i].key >> 30);
+	}
+
+	// Find the field every alarm rule checks, and the decoders writing to it
+	if (ALARM_COUNT > 16)
+	{
+		Debug_Send(DM_FATAL_ERROR, "Too many alarm rules.");
 		return FALSE;
 	}
 
-	_bmsDataReady = 0;
-	_mpptDataReady = 0;
+	for (i = 0; i < ALARM_COUNT; i++)
+	{
+		const ALARM_RULE_T *rule = &_alarmRules[i];
+		const DECODER_TABLE_T *table = &_decoderTables[rule->table];
+		uint8_t field, decoder;
+
+		for (field = 0; field < table->fieldCount && table->fields[field].offset != rule->field; field++);
+		if (field == table->fieldCount)
+		{
+			Debug_Send(DM_FATAL_ERROR, "Alarm rule checks unknown field.");
+			return FALSE;
+		}
+
+		_alarmFields[i] = field;
+
+		for (decoder = 0; decoder < DECODER_COUNT; decoder++)
+		{
+			if (_decoders[decoder].table == rule->table && _decoders[decoder].field == rule->field)
+				_decoderAlarms[decoder] |= _BIT(i);
+		}
+	}
+
+	// Create alarm flag (auto-reset, initial state 0)
+	_alarmFlagId = CoCreateFlag(1, 0);
+	if (_alarmFlagId == E_CREATE_FAIL)
+	{
+		Debug_Send(DM_FATAL_ERROR, "Alarm flag creation failed.");
+		return FALSE;
+	}
+
+	// Delta tables have a 16 bit field bitmap, snapshots are taken on the stack
+	for (i = 0; i < DECODER_TABLE_COUNT; i++)
+	{
+		if (_decoderTables[i].fieldCount > 16 || _decoderTables[i].size > TABLE_MAX_SIZE)
+		{
+			Debug_Send(DM_FATAL_ERROR, "Sensor table too large.");
+			return FALSE;
+		}
+
+		// Shore side has no copy of any table yet
+		_tableSend[i].keyframeDue = TRUE;
+	}
+
+	// Start with a full budget
+	_budgetRate = TABLE_BUDGET_RATE_MAX;
+	_budget = TABLE_BUDGET_BURST * CFG_SYSTICK_FREQ;
+	_budgetTime = (uint32_t)CoGetOSTime();
 
 	return TRUE;
 }
 
-void SensorDataManager_PutCanData(CAN_MSG_Type *msg)
+void SensorDataManager_PutCanData(CAN_MSG_Type *msg, uint8_t controller, uint32_t timestamp)
 {
-	if (CoEnterMutexSection(_dataMutexId) != E_OK)
-		return;
+	uint8_t table = DECODER_TABLE_COUNT; // table being written
+	uint16_t alarms = 0; // alarm rules that changed state
 
-	if(msg->format == STD_ID_FORMAT)
+	// Extended identifiers are decoded by PGN, any priority and source address
+	uint32_t key = msg->format == EXT_ID_FORMAT ?
+			DECODER_KEY(controller, EXT_ID_FORMAT, (msg->id & 0x00FFFFFF) >> 8) :
+			DECODER_KEY(controller, STD_ID_FORMAT, msg->id);
+
+	// Decode every field of this message
+	int16_t i = SensorDataManager_FindDecoder(key);
+	if (i >= 0)
 	{
-		switch (msg->id)
+		// Count received frames per filter entry
+		if (_decoderFilters[i] >= 0)
+			_canFrameCount[_decoderFilters[i]]++;
+
+		for (; i < DECODER_COUNT && _decoders[i].key == key; i++)
 		{
-			case MESSAGE_PGN_BMS://CAN data with COB-ID 0x302
-			case MESSAGE_PGN_BMS_TEMP://CAN data with COB-ID 0x402
-				switch(msg->dataA[3]) //SUB_INDEX
-				{
-					case SI_BMS_VOLTAGE:
-						_tableBms.voltage = ((uint16_t)msg->dataB[1] << 8) | msg->dataB[0]; // battery voltage
-						_bmsDataReady |= _BIT(BMS_VOLTAGE);
-						break;
-					case SI_BMS_CURRENT_CHARGE:
-						_tableBms.currentIn = ((int16_t)msg->dataB[1] << 8) | msg->dataB[0]; // charge current
-						_bmsDataReady |= _BIT(BMS_CURRENT_IN);
-						break;
-					case SI_BMS_CURRENT_DISCHARGE:
-						_tableBms.currentOut = ((int16_t)msg->dataB[1] << 8) | msg->dataB[0]; // discharge current
-						_bmsDataReady |= _BIT(BMS_CURRENT_OUT);
-						break;
-					case SI_BMS_STATE_OF_CHARGE:
-						_tableBms.stateOfCharge = msg->dataB[0]; // SOC (%)
-						_bmsDataReady |= _BIT(BMS_STATE_OF_CHARGE);
-						break;
-					case SI_BMS_CELL_TEMP_HIGH:
-						_tableBms.temperature = msg->dataB[0]; // highest cell temperature
-						_bmsDataReady |= _BIT(BMS_TEMPERATURE);
-						break;
-				}
+			const DECODER_T *decoder = &_decoders[i];
 
-				break;
+			if (decoder->subIndex != SI_ANY && decoder->subIndex != msg->dataA[3])
+				continue;
 
-			case MESSAGE_PGN_MPPT1A:
-				_tableMppt.currentIn1 = *( (float*)(msg->dataA));
-				_tableMppt.voltageIn1 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT1A);
-				break;
-			case MESSAGE_PGN_MPPT1B:
-				_tableMppt.voltageOut1 = *( (float*)(msg->dataA));
-				_tableMppt.powerIn1 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT1B);
-				break;
-			case MESSAGE_PGN_MPPT2A:
-				_tableMppt.currentIn2 = *( (float*)(msg->dataA));
-				_tableMppt.voltageIn2 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT2A);
-				break;
-			case MESSAGE_PGN_MPPT2B:
-				_tableMppt.voltageOut2 = *( (float*)(msg->dataA));
-				_tableMppt.powerIn2 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT2B);
-				break;
-			case MESSAGE_PGN_MPPT3A:
-				_tableMppt.currentIn3 = *( (float*)(msg->dataA));
-				_tableMppt.voltageIn3 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT3A);
-				break;
-			case MESSAGE_PGN_MPPT3B:
-				_tableMppt.voltageOut3 = *( (float*)(msg->dataA));
-				_tableMppt.powerIn3 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT3B);
-				break;
-			case MESSAGE_PGN_MPPT4A:
-				_tableMppt.currentIn4 = *( (float*)(msg->dataA));
-				_tableMppt.voltageIn4 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT4A);
-				break;
-			case MESSAGE_PGN_MPPT4B:
-				_tableMppt.voltageOut4 = *( (float*)(msg->dataA));
-				_tableMppt.powerIn4 = *( (float*)(msg->dataB));
-				_mpptDataReady |= _BIT(MPPT4B);
-				break;
+			// All fields of a message are published at once
+			if (decoder->table != table)
+			{
+				if (table != DECODER_TABLE_COUNT)
+					SensorDataManager_EndWrite(table);
+
+				table = decoder->table;
+				SensorDataManager_BeginWrite(table);
+				_tableSend[table].aggregateFrames++;
+			}
+
+			const DECODER_TABLE_T *decoderTable = &_decoderTables[table];
+			const TABLE_FIELD_T *field = &decoderTable->fields[_decoderFields[i]];
+			const uint8_t *src = decoder->offset < 4 ? &msg->dataA[decoder->offset] : &msg->dataB[decoder->offset - 4];
+			uint8_t *dest = decoderTable->table + decoder->field;
+
+			// Scaled fields are converted once here, the table is sent as is
+			if (decoder->type == field->type)
+				memcpy(dest, src, _fieldWidths[decoder->type]);
+			else
+				SensorDataManager_SetFieldValue(dest, field->type,
+						(SensorDataManager_GetFieldValue(src, decoder->type) - field->bias) / field->scale);
+
+			memcpy(decoderTable->table, &timestamp, sizeof(uint32_t));
+			_tableLocks[table].dataReady |= decoder->readyBit;
+
+			// Update running aggregate of the field, published by the same sequence lock
+			if (TABLE_AGGREGATE_ENABLED && decoderTable->aggregates != NULL)
+			{
+				FIELD_AGGREGATE_T *aggregate = &decoderTable->aggregates[_decoderFields[i]];
+				float value = SensorDataManager_GetFieldValue(dest, field->type);
+
+				if (aggregate->count == 0 || value < aggregate->min)
+					aggregate->min = value;
+				if (aggregate->count == 0 || value > aggregate->max)
+					aggregate->max = value;
+				aggregate->sum += value;
+				aggregate->count++;
+			}
+
+			// Check alarm rules on the field as soon as it is decoded
+			if (ALARM_ENABLED && _decoderAlarms[i] != 0)
+				alarms |= SensorDataManager_CheckAlarms(_decoderAlarms[i],
+						SensorDataManager_GetFieldValue(dest, field->type) * field->scale + field->bias, timestamp);
+		}
+
+		if (table != DECODER_TABLE_COUNT)
+			SensorDataManager_EndWrite(table);
+	}
+
+	// Signal state changes once the table is published, readers would retry during the blocking debug output
+	if (alarms != 0)
+	{
+		uint8_t rule;
+
+		CoSetFlag(_alarmFlagId);
+
+		for (rule = 0; rule < ALARM_COUNT; rule++)
+		{
+			if (alarms & _BIT(rule))
+				Debug_Send(_alarmStates[rule].active ? DM_ERROR : DM_INFO,
+						_alarmStates[rule].active ? "Alarm raised." : "Alarm cleared.");
 		}
 	}
-	else if(msg->format == EXT_ID_FORMAT)
+}
+
+uint16_t SensorDataManager_GetTables(uint8_t *tableBuffer, uint16_t bufferSize)
+{
+	uint32_t now = (uint32_t)CoGetOSTime();
+	uint16_t bufferUsed = 0;
+	uint8_t pass, i;
+
+	// Periodically send every sensor table in full, so lost or misinterpreted packets don't persist
+	if (TABLE_DELTA_ENABLED && _keyframeCountdown-- == 0)
+	{
+		for (i = 0; i < DECODER_TABLE_COUNT; i++)
+			_tableSend[i].keyframeDue = TRUE;
+
+		_keyframeCountdown = TABLE_DELTA_KEYFRAME_INTERVAL - 1;
+	}
+
+	// Refill byte budget at the current rate, up to a burst
+	if (now - _budgetTime >= TABLE_BUDGET_BURST * CFG_SYSTICK_FREQ / TABLE_BUDGET_RATE_MIN)
+		_budget = TABLE_BUDGET_BURST * CFG_SYSTICK_FREQ;
+	else
+		_budget += (now - _budgetTime) * _budgetRate;
+	if (_budget > TABLE_BUDGET_BURST * CFG_SYSTICK_FREQ)
+		_budget = TABLE_BUDGET_BURST * CFG_SYSTICK_FREQ;
+	_budgetTime = now;
+
+	// Tables past their maximum staleness first, regardless of the budget. Then due tables within the budget.
+	for (pass = 0; pass < 2; pass++)
 	{
-		switch ((msg->id & 0x00FFFFFF) >> 8)
+		for (i = 0; i < SCHEDULE_COUNT; i++)
 		{
-			case MESSAGE_PGN_TEMPERATURE:
+			const TABLE_SCHEDULE_T *schedule = &_schedule[i];
+			uint32_t age = now - _scheduleSentTime[i];
+			uint16_t size = bufferSize - bufferUsed;
+
+			if (_schedulePending & _BIT(i))
+				continue;
 
-				_tableTemperature.sensor1 = msg->dataA[0];
-				_tableTemperature.sensor2 = msg->dataA[1];
-				_tableTemperature.sensor3 = msg->dataA[2];
-				_tableTemperature.sensor4 = msg->dataA[3];
-				_tableTemperature.sensor5 = msg->dataB[0];
-				_tableTemperature.sensor6 = msg->dataB[1];
-				_tableTemperature.reference = msg->dataB[2];
+			if (pass == 0 ? (schedule->maxStaleness == 0 || age < schedule->maxStaleness) : age < schedule->minInterval)
+				continue;
 
-				_temperatureDataReady |= _BIT(TEMPERATURE_SENSOR1) | _BIT(TEMPERATURE_SENSOR2) | _BIT(TEMPERATURE_SENSOR3) |
-					_BIT(TEMPERATURE_SENSOR4) | _BIT(TEMPERATURE_SENSOR5) | _BIT(TEMPERATURE_REFERENCE);
+			// Don't send packets for the schema alone
+			if (schedule->entry == SCHEDULE_SCHEMA && bufferUsed == 0)
+				continue;
 
+			BOOL budgetLimited = FALSE;
+			if (pass == 1)
+			{
+				int32_t budget = _budget / CFG_SYSTICK_FREQ - TABLE_PACKET_OVERHEAD - bufferUsed;
+				if (budget <= 0)
+					break;
+
+				if (size > budget)
+				{
+					size = budget;
+					budgetLimited = TRUE;
+				}
+			}
+
+			uint8_t used = SensorDataManager_PutTable(schedule->entry, tableBuffer + bufferUsed, size);
+			if (used != 0)
+			{
+				// Schema table goes in front, shore side can't find it behind tables it can't decode yet
+				if (schedule->entry == SCHEDULE_SCHEMA)
+					SensorDataManager_MoveToFront(tableBuffer, bufferUsed, used);
+
+				bufferUsed += used;
+				_schedulePending |= _BIT(i);
+			}
+			else if (budgetLimited)
+			{
+				// Save the budget for this table instead of spending it on less important ones
 				break;
+			}
 		}
 	}
 
+	if (bufferUsed != 0)
+	{
+		_budget -= (TABLE_PACKET_OVERHEAD + bufferUsed) * CFG_SYSTICK_FREQ;
+		_schedulePackTime = now;
+	}
 
-	CoLeaveMutexSection(_dataMutexId);
+	return bufferUsed;
 }
 
-uint16_t SensorDataManager_GetTables(uint8_t *tableBuffer, uint16_t bufferSize)
+uint8_t SensorDataManager_GetSnapshot(uint8_t *tableBuffer, uint8_t bufferSize)
 {
+	GM862_GPS_DATA gpsData;
+	uint32_t fixTime;
+	uint8_t bufferUsed = 0;
+	uint8_t i;
+
+	// Full tables only, a snapshot doesn't depend on other packets or change what is sent live
+	if (GM862_GpsGetCachedPosition(&gpsData, &fixTime) && (uint32_t)CoGetOSTime() - fixTime <= TABLE_TRACKING_MAX_AGE &&
+			bufferSize - bufferUsed >= sizeof(uint8_t) + sizeof(GM862_GPS_DATA))
+	{
+		tableBuffer[bufferUsed++] = TABLE_ID_TRACKING;
+		memcpy(tableBuffer + bufferUsed, &gpsData, sizeof(GM862_GPS_DATA));
+		bufferUsed += sizeof(GM862_GPS_DATA);
+	}
+
+	for (i = 0; i < DECODER_TABLE_COUNT; i++)
+	{
+		const DECODER_TABLE_T *table = &_decoderTables[i];
+		uint16_t dataReady;
+
+		if (bufferSize - bufferUsed < sizeof(uint8_t) + table->size)
+			continue;
+
+		SensorDataManager_ReadTable(i, tableBuffer + bufferUsed + sizeof(uint8_t), &dataReady);
+		if (!(dataReady & table->fullMask))
+			continue;
+
+		tableBuffer[bufferUsed] = table->id;
+		bufferUsed += sizeof(uint8_t) + table->size;
+	}
+
+	return bufferUsed;
+}
+
+BOOL SensorDataManager_TablesUrgent()
+{
+	uint8_t i;
+
+	// Tables of the last SensorDataManager_GetTables() call are pending until acknowledged. Alarm state changes go
+	// out in packets of their own, tables of a tripped rule follow them without waiting for the batch.
+	for (i = 0; i < ALARM_COUNT; i++)
+	{
+		if (_alarmStates[i].active && _tableSend[_alarmRules[i].table].pending)
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+void SensorDataManager_RequestKeyframe()
+{
+	uint8_t i;
+
+	for (i = 0; i < DECODER_TABLE_COUNT; i++)
+		_tableSend[i].keyframeDue = TRUE;
+}
+
+void SensorDataManager_RequestSchema()
+{
+	// Start with the first field, packets of an earlier connection may be lost
+	_schemaTable = 0;
+	_schemaField = 0;
+	_schemaDue = TABLE_SCHEMA_ENABLED;
+}
+
+BOOL SensorDataManager_WaitForAlarm(uint32_t timeout)
+{
+	// Flag is created by SensorDataManager_Init() in the CAN task
+	if (_alarmFlagId == E_CREATE_FAIL)
+	{
+		CoTickDelay(timeout);
+		return FALSE;
+	}
+
+	return CoWaitForSingleFlag(_alarmFlagId, timeout) == E_OK;
+}
+
+uint16_t SensorDataManager_GetAlarms(uint8_t *tableBuffer, uint16_t bufferSize)
+{
+	TableAlarm_t tableAlarm;
+	uint32_t now = MICROSECOND_TIMER;
 	uint16_t bufferUsed = 0;
+	uint8_t i;
 
-	CoEnterMutexSection(_dataMutexId);
+	CoSchedLock();
 
-	GM862_GPS_DATA gpsData;
-	if (GM862_GpsGetPosition(&gpsData))
+	for (i = 0; i < ALARM_COUNT; i++)
 	{
-		if (bufferSize - bufferUsed >= sizeof(uint8_t) + sizeof(GM862_GPS_DATA))
+		const ALARM_RULE_T *rule = &_alarmRules[i];
+		ALARM_STATE_T *state = &_alarmStates[i];
+
+		if (!state->pending || bufferSize - bufferUsed < sizeof(uint8_t) + sizeof(TableAlarm_t))
+			continue;
+
+		tableAlarm.rule = i;
+		tableAlarm.table = _decoderTables[rule->table].id;
+		tableAlarm.field = _alarmFields[i];
+		tableAlarm.condition = rule->condition;
+		tableAlarm.active = state->active ? 1 : 0;
+		tableAlarm.value = state->value;
+		tableAlarm.delay = now - state->changeTime;
+
+		tableBuffer[bufferUsed++] = TABLE_ID_ALARM;
+		memcpy(tableBuffer + bufferUsed, &tableAlarm, sizeof(TableAlarm_t));
+		bufferUsed += sizeof(TableAlarm_t);
+
+		state->pending = FALSE;
+		state->sending = TRUE;
+		state->sendingChangeTime = state->changeTime;
+	}
+
+	CoSchedUnlock();
+
+	return bufferUsed;
+}
+
+void SensorDataManager_AcknowledgeAlarms(BOOL sent)
+{
+	uint32_t now = MICROSECOND_TIMER;
+	uint8_t i;
+
+	CoSchedLock();
+
+	for (i = 0; i < ALARM_COUNT; i++)
+	{
+		ALARM_STATE_T *state = &_alarmStates[i];
+
+		if (!state->sending)
+			continue;
+
+		state->sending = FALSE;
+
+		// Lost state changes are sent again, with the state at that time
+		if (!sent)
 		{
-			Debug_Send(DM_INFO, "GPS data collected.");
+			state->pending = TRUE;
+			continue;
+		}
+
+		// Update state change to send latency
+		uint32_t latency = now - state->sendingChangeTime;
+		_alarmLatencyStats.last = latency;
+		if (latency > _alarmLatencyStats.max)
+			_alarmLatencyStats.max = latency;
+		_alarmLatencyStats.total += latency;
+		_alarmLatencyStats.count++;
+	}
+
+	CoSchedUnlock();
+}
+
+void SensorDataManager_GetAlarmLatencyStats(ALARM_LATENCY_STATS_T *stats)
+{
+	// Statistics are written with the scheduler locked, prevent a torn copy
+	CoSchedLock();
+	*stats = _alarmLatencyStats;
+	CoSchedUnlock();
+}
 
-			tableBuffer[bufferUsed++] = TABLE_ID_TRACKING;
+void SensorDataManager_AcknowledgeTables(BOOL sent)
+{
+	uint8_t i;
+
+	for (i = 0; i < DECODER_TABLE_COUNT; i++)
+	{
+		const DECODER_TABLE_T *table = &_decoderTables[i];
+		TABLE_SEND_T *send = &_tableSend[i];
+
+		if (!send->pending)
+			continue;
+
+		send->pending = FALSE;
+
+		// Lost tables are sent again against the previous reference, lost aggregates with the next window
+		if (!sent)
+		{
+			if (TABLE_AGGREGATE_ENABLED && table->aggregates != NULL)
+				SensorDataManager_RestoreAggregates(i);
 
-			memcpy(tableBuffer + bufferUsed, &gpsData, sizeof(GM862_GPS_DATA));
-			bufferUsed += sizeof(GM862_GPS_DATA);
+			continue;
 		}
+
+		// Shore side copy of the table is now equal to the pending table
+		memcpy(table->reference, table->pending, table->size);
+		send->sentSequence = send->pendingSequence;
+		send->keyframeDue = FALSE;
 	}
 
-	if (_bmsDataReady & TABLE_BMS_FULL_MASK)
+	if (sent)
+		_gpsSentTime = _gpsPendingTime;
+
+	for (i = 0; i < SCHEDULE_COUNT; i++)
 	{
-		if (bufferSize - bufferUsed >= sizeof(uint8_t) + sizeof(TableBms_t))
+		if (!(_schedulePending & _BIT(i)))
+			continue;
+
+		// Failed attempts count too, so a failing link doesn't get stale tables on every packet
+		_scheduleSentTime[i] = _schedulePackTime;
+
+		// Continue with the next field, or describe the same field again. Done after the last field.
+		if (sent && _schedule[i].entry == SCHEDULE_SCHEMA && ++_schemaField == _decoderTables[_schemaTable].fieldCount)
 		{
-			Debug_Send(DM_INFO, "BMS data collected.");
+			_schemaField = 0;
+			if (++_schemaTable == DECODER_TABLE_COUNT)
+			{
+				_schemaTable = 0;
+				_schemaDue = FALSE;
+			}
+		}
+	}
+
+	_schedulePending = 0;
+
+	// Halve the budget when the link fails, recover slowly when it works
+	if (sent)
+		_budgetRate = _budgetRate + TABLE_BUDGET_RATE_STEP < TABLE_BUDGET_RATE_MAX ?
+				_budgetRate + TABLE_BUDGET_RATE_STEP : TABLE_BUDGET_RATE_MAX;
+	else
+		_budgetRate = _budgetRate / 2 > TABLE_BUDGET_RATE_MIN ? _budgetRate / 2 : TABLE_BUDGET_RATE_MIN;
+}
+
+const CAN_FILTER_ENTRY_T *SensorDataManager_GetCanFilter(uint8_t *count)
+{
+	*count = sizeof(_canFilter) / sizeof(_canFilter[0]);
+
+	return _canFilter;
+}
+
+/*
+ * @brief		Find the filter list entry a CAN message belongs to
+ * @return		Index in _canFilter, or -1 if the message is not decoded
+ */
+int8_t SensorDataManager_GetFilterIndex(CAN_MSG_Type *msg, uint8_t controller)
+{
+	uint8_t i;
 
-			tableBuffer[bufferUsed++] = TABLE_ID_BMS;
+	for (i = 0; i < CAN_FILTER_COUNT; i++)
+	{
+		if (_canFilter[i].controller != controller)
+			continue;
+
+		switch (_canFilter[i].type)
+		{
+			case CAN_FILTER_STD:
+			case CAN_FILTER_FULLCAN:
+				if (msg->format == STD_ID_FORMAT && msg->id >= _canFilter[i].lowerId && msg->id <= _canFilter[i].upperId)
+					return i;
+				break;
 
-			memcpy(tableBuffer + bufferUsed, &_tableBms, sizeof(TableBms_t));
-			bufferUsed += sizeof(TableBms_t);
+			case CAN_FILTER_EXT:
+				if (msg->format == EXT_ID_FORMAT && msg->id >= _canFilter[i].lowerId && msg->id <= _canFilter[i].upperId)
+					return i;
+				break;
 
-			_bmsDataReady = 0;
+			case CAN_FILTER_PGN:
+				if (msg->format == EXT_ID_FORMAT && ((msg->id & 0x00FFFFFF) >> 8) == _canFilter[i].lowerId)
+					return i;
+				break;
 		}
 	}
 
-	if (_mpptDataReady & TABLE_MPPT_FULL_MASK)
+	return -1;
+}
+
+/*
+ * @brief		Binary search the decoder list for the first entry of a message
+ * @param[in]	key Message key, see DECODER_KEY()
+ * @return		Index in _decoders, or -1 if the message is not decoded
+ */
+int16_t SensorDataManager_FindDecoder(uint32_t key)
+{
+	int16_t lower = 0, upper = DECODER_COUNT;
+
+	// Find lowest index with a key not less than the given key
+	while (lower < upper)
+	{
+		int16_t middle = (lower + upper) / 2;
+
+		if (_decoders[middle].key < key)
+			lower = middle + 1;
+		else
+			upper = middle;
+	}
+
+	if (lower < DECODER_COUNT && _decoders[lower].key == key)
+		return lower;
+
+	return -1;
+}
+
+/*
+ * @brief		Mark start of an update of a sensor table, readers retry until SensorDataManager_EndWrite()
+ * @param[in]	table DECODER_TABLE
+ * @return		None
+ */
+void SensorDataManager_BeginWrite(uint8_t table)
+{
+	_tableLocks[table].sequence++;
+
+	// Make sure the sequence is odd before the table is changed
+	DATA_MEMORY_BARRIER();
+}
+
+/*
+ * @brief		Mark end of an update of a sensor table
+ * @param[in]	table DECODER_TABLE
+ * @return		None
+ */
+void SensorDataManager_EndWrite(uint8_t table)
+{
+	// Make sure the table is changed before the sequence is even again
+	DATA_MEMORY_BARRIER();
+
+	_tableLocks[table].sequence++;
+}
+
+/*
+ * @brief		Copy a consistent snapshot of a sensor table, without blocking its writer
+ * @param[in]	table DECODER_TABLE
+ * @param[out]	dest Buffer of at least the size of the table
+ * @param[out]	dataReady Fields decoded since start-up
+ * @return		Sequence number of the snapshot, changes with every update of the table
+ */
+uint32_t SensorDataManager_ReadTable(uint8_t table, uint8_t *dest, uint16_t *dataReady)
+{
+	TABLE_LOCK_T *lock = &_tableLocks[table];
+	uint32_t sequence;
+
+	for (;;)
 	{
-		if (bufferSize - bufferUsed >= sizeof(uint8_t) + sizeof(TableMppt_t))
+		sequence = lock->sequence;
+
+		// Writer was preempted halfway, give it a tick to finish
+		if (sequence & 1)
 		{
-			Debug_Send(DM_INFO, "MPPT data collected.");
+			CoTickDelay(1);
+			continue;
+		}
+
+		DATA_MEMORY_BARRIER();
+
+		memcpy(dest, _decoderTables[table].table, _decoderTables[table].size);
+		*dataReady = lock->dataReady;
 
-			tableBuffer[bufferUsed++] = TABLE_ID_MPPT;
+		DATA_MEMORY_BARRIER();
 
-			memcpy(tableBuffer + bufferUsed, &_tableMppt, sizeof(TableMppt_t));
-			bufferUsed += sizeof(TableMppt_t);
+		// Table wasn't changed while copying
+		if (lock->sequence == sequence)
+			return sequence;
+	}
+}
+
+/*
+ * @brief		Encode the fields of a sensor table that moved more than their deadband since the table
+ * 				was acknowledged last, the resulting table is kept as pending table
+ * @param[in]	table DECODER_TABLE
+ * @param[in]	snapshot Current table, see SensorDataManager_ReadTable()
+ * @param[out]	dest Timestamp, field bitmap (bit n is fields[n]) and the fields in the bitmap
+ * @return		Number of bytes written, 0 if no field moved
+ */
+uint8_t SensorDataManager_EncodeDelta(uint8_t table, const uint8_t *snapshot, uint8_t *dest)
+{
+	const DECODER_TABLE_T *decoderTable = &_decoderTables[table];
+	uint8_t size = sizeof(uint32_t) + sizeof(uint16_t);
+	uint16_t bitmap = 0;
+	uint8_t i;
+
+	// Shore side applies the included fields to its copy of the acknowledged table
+	memcpy(decoderTable->pending, decoderTable->reference, decoderTable->size);
+	memcpy(decoderTable->pending, snapshot, sizeof(uint32_t));
+
+	for (i = 0; i < decoderTable->fieldCount; i++)
+	{
+		const TABLE_FIELD_T *field = &decoderTable->fields[i];
+		uint8_t width = _fieldWidths[field->type];
+
+		// Compared against the acknowledged value, so slow drifts are sent as well
+		float change = SensorDataManager_GetFieldValue(snapshot + field->offset, field->type) -
+				SensorDataManager_GetFieldValue(decoderTable->reference + field->offset, field->type);
+		if (change <= field->deadband && change >= -field->deadband)
+			continue;
+
+		bitmap |= _BIT(i);
+
+		memcpy(dest + size, snapshot + field->offset, width);
+		memcpy(decoderTable->pending + field->offset, snapshot + field->offset, width);
+		size += width;
+	}
+
+	if (bitmap == 0)
+		return 0;
+
+	memcpy(dest, snapshot, sizeof(uint32_t));
+	memcpy(dest + sizeof(uint32_t), &bitmap, sizeof(uint16_t));
+
+	return size;
+}
 
-			_bmsDataReady = 0;
+/*
+ * @brief		Read a (possibly unaligned) table field
+ * @param[in]	src First byte of field
+ * @param[in]	type FIELD_TYPE
+ * @return		Value of field
+ */
+float SensorDataManager_GetFieldValue(const uint8_t *src, uint8_t type)
+{
+	switch (type)
+	{
+		case FIELD_UINT8:
+			return *src;
+
+		case FIELD_INT8:
+			return (int8_t)*src;
+
+		case FIELD_UINT16:
+		{
+			uint16_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+
+		case FIELD_INT16:
+		{
+			int16_t value;
+			memcpy(&value, src, sizeof(value));
+			return value;
 		}
+
+		default:
+		{
+			float value;
+			memcpy(&value, src, sizeof(value));
+			return value;
+		}
+	}
+}
+
+/*
+ * @brief		Write a (possibly unaligned) table field, integers are rounded to nearest and saturated
+ * @param[out]	dest First byte of field
+ * @param[in]	type FIELD_TYPE
+ * @param[in]	value Value of field
+ * @return		None
+ */
+void SensorDataManager_SetFieldValue(uint8_t *dest, uint8_t type, float value)
+{
+	static const float minimum[] = { 0, INT8_MIN, 0, INT16_MIN };
+	static const float maximum[] = { UINT8_MAX, INT8_MAX, UINT16_MAX, INT16_MAX };
+	int32_t rounded = 0;
+
+	// Out of range (or not a number) sensor values end up at the nearest limit
+	if (type != FIELD_FLOAT)
+	{
+		if (!(value > minimum[type]))
+			value = minimum[type];
+		else if (value > maximum[type])
+			value = maximum[type];
+
+		rounded = value >= 0 ? (int32_t)(value + 0.5f) : (int32_t)(value - 0.5f);
 	}
 
-	if (_temperatureDataReady & TABLE_TEMPERATURE_FULL_MASK)
+	switch (type)
 	{
-		if (bufferSize - bufferUsed >= sizeof(uint8_t) + sizeof(TableTemperature_t))
+		case FIELD_UINT8:
+		case FIELD_INT8:
+			*dest = (uint8_t)rounded;
+			break;
+
+		case FIELD_UINT16:
+		case FIELD_INT16:
 		{
-			Debug_Send(DM_INFO, "Temperature data collected.");
+			uint16_t field = (uint16_t)rounded;
+			memcpy(dest, &field, sizeof(field));
+			break;
+		}
+
+		default:
+			memcpy(dest, &value, sizeof(value));
+			break;
+	}
+}
+
+/*
+ * @brief		Get size of the aggregate table of a sensor table
+ * @param[in]	table DECODER_TABLE
+ * @return		Size of timestamp, frame count and min, max and mean of every field
+ */
+uint8_t SensorDataManager_GetAggregateSize(uint8_t table)
+{
+	uint8_t size = sizeof(uint32_t) + sizeof(uint16_t);
+	uint8_t i;
+
+	for (i = 0; i < _decoderTables[table].fieldCount; i++)
+		size += 3 * _fieldWidths[_decoderTables[table].fields[i].type];
+
+	return size;
+}
+
+/*
+ * @brief		Keep the writer of a sensor table from running, for readers that change the table state too.
+ * 				Returns with the scheduler locked, call CoSchedUnlock() when done
+ * @param[in]	table DECODER_TABLE
+ * @return		None
+ */
+void SensorDataManager_LockWriter(uint8_t table)
+{
+	for (;;)
+	{
+		CoSchedLock();
+
+		// Writer isn't halfway a message
+		if (!(_tableLocks[table].sequence & 1))
+			return;
+
+		CoSchedUnlock();
+		CoTickDelay(1);
+	}
+}
+
+/*
+ * @brief		Write the aggregate table of a sensor table and start a new window, the finished
+ * 				window is kept until SensorDataManager_AcknowledgeTables()
+ * @param[in]	table DECODER_TABLE
+ * @param[out]	dest Buffer of at least SensorDataManager_GetAggregateSize() bytes
+ * @return		None
+ */
+void SensorDataManager_TakeAggregates(uint8_t table, uint8_t *dest)
+{
+	const DECODER_TABLE_T *decoderTable = &_decoderTables[table];
+	TABLE_SEND_T *send = &_tableSend[table];
+	uint8_t size = sizeof(uint32_t) + sizeof(uint16_t);
+	uint8_t i;
+
+	SensorDataManager_LockWriter(table);
+
+	memcpy(decoderTable->pendingAggregates, decoderTable->aggregates, decoderTable->fieldCount * sizeof(FIELD_AGGREGATE_T));
+	send->pendingAggregateFrames = send->aggregateFrames;
+	memcpy(dest, decoderTable->table, sizeof(uint32_t));
+
+	// New window starts at the current values
+	for (i = 0; i < decoderTable->fieldCount; i++)
+	{
+		FIELD_AGGREGATE_T *aggregate = &decoderTable->aggregates[i];
+		const TABLE_FIELD_T *field = &decoderTable->fields[i];
+
+		aggregate->min = aggregate->max = SensorDataManager_GetFieldValue(decoderTable->table + field->offset, field->type);
+		aggregate->sum = 0;
+		aggregate->count = 0;
+	}
+	send->aggregateFrames = 0;
+
+	CoSchedUnlock();
+
+	memcpy(dest + sizeof(uint32_t), &send->pendingAggregateFrames, sizeof(uint16_t));
+
+	for (i = 0; i < decoderTable->fieldCount; i++)
+	{
+		const FIELD_AGGREGATE_T *aggregate = &decoderTable->pendingAggregates[i];
+		uint8_t type = decoderTable->fields[i].type;
+		uint8_t width = _fieldWidths[type];
+
+		SensorDataManager_SetFieldValue(dest + size, type, aggregate->min);
+		SensorDataManager_SetFieldValue(dest + size + width, type, aggregate->max);
+		SensorDataManager_SetFieldValue(dest + size + 2 * width, type,
+				aggregate->count != 0 ? aggregate->sum / aggregate->count : aggregate->min);
+		size += 3 * width;
+	}
+}
+
+/*
+ * @brief		Merge the window taken by SensorDataManager_TakeAggregates() back into the current window
+ * @param[in]	table DECODER_TABLE
+ * @return		None
+ */
+void SensorDataManager_RestoreAggregates(uint8_t table)
+{
+	const DECODER_TABLE_T *decoderTable = &_decoderTables[table];
+	TABLE_SEND_T *send = &_tableSend[table];
+	uint8_t i;
+
+	SensorDataManager_LockWriter(table);
+
+	for (i = 0; i < decoderTable->fieldCount; i++)
+	{
+		FIELD_AGGREGATE_T *aggregate = &decoderTable->aggregates[i];
+		const FIELD_AGGREGATE_T *pending = &decoderTable->pendingAggregates[i];
+
+		if (pending->count == 0)
+			continue;
+
+		if (aggregate->count == 0 || pending->min < aggregate->min)
+			aggregate->min = pending->min;
+		if (aggregate->count == 0 || pending->max > aggregate->max)
+			aggregate->max = pending->max;
+		aggregate->sum += pending->sum;
+		aggregate->count += pending->count;
+	}
+	send->aggregateFrames += send->pendingAggregateFrames;
+
+	CoSchedUnlock();
+}
+
+/*
+ * @brief		Write the table of a send schedule entry
+ * @param[in]	entry SCHEDULE_ENTRY
+ * @param[out]	dest Buffer
+ * @param[in]	size Size of buffer
+ * @return		Number of bytes written, 0 if there is nothing to send or the table doesn't fit
+ */
+uint8_t SensorDataManager_PutTable(uint8_t entry, uint8_t *dest, uint16_t size)
+{
+	switch (entry)
+	{
+		case SCHEDULE_TRACKING:
+			return SensorDataManager_PutTracking(dest, size);
+
+		case SCHEDULE_BMS:
+			return SensorDataManager_PutSensorTable(DECODER_TABLE_BMS, dest, size);
+
+		case SCHEDULE_MPPT:
+			return SensorDataManager_PutSensorTable(DECODER_TABLE_MPPT, dest, size);
+
+		case SCHEDULE_TEMPERATURE:
+			return SensorDataManager_PutSensorTable(DECODER_TABLE_TEMPERATURE, dest, size);
+
+		case SCHEDULE_CAN_STATISTICS:
+			return SensorDataManager_PutCanStatistics(dest, size);
+
+		case SCHEDULE_SCHEMA:
+			return SensorDataManager_PutSchema(dest, size);
+
+		default:
+			return 0;
+	}
+}
+
+/*
+ * @brief		Write the tracking table, every GPS fix is sent once while it is recent
+ * @param[out]	dest Buffer
+ * @param[in]	size Size of buffer
+ * @return		Number of bytes written, 0 if there is no new fix or the table doesn't fit
+ */
+uint8_t SensorDataManager_PutTracking(uint8_t *dest, uint16_t size)
+{
+	GM862_GPS_DATA gpsData;
+	uint32_t fixTime;
+
+	if (size < sizeof(uint8_t) + sizeof(GM862_GPS_DATA))
+		return 0;
+
+	// GPS position is cached by the modem owner
+	if (!GM862_GpsGetCachedPosition(&gpsData, &fixTime) || fixTime == _gpsSentTime ||
+			(uint32_t)CoGetOSTime() - fixTime > TABLE_TRACKING_MAX_AGE)
+		return 0;
+
+	Debug_Send(DM_INFO, "GPS data collected.");
+
+	dest[0] = TABLE_ID_TRACKING;
+	memcpy(dest + sizeof(uint8_t), &gpsData, sizeof(GM862_GPS_DATA));
+
+	_gpsPendingTime = fixTime;
+
+	return sizeof(uint8_t) + sizeof(GM862_GPS_DATA);
+}
+
+/*
+ * @brief		Write the aggregate, full or delta table of a sensor table
+ * @param[in]	table DECODER_TABLE
+ * @param[out]	dest Buffer
+ * @param[in]	size Size of buffer
+ * @return		Number of bytes written, 0 if the table didn't change or doesn't fit
+ */
+uint8_t SensorDataManager_PutSensorTable(uint8_t table, uint8_t *dest, uint16_t size)
+{
+	const DECODER_TABLE_T *decoderTable = &_decoderTables[table];
+	TABLE_SEND_T *send = &_tableSend[table];
+	uint8_t snapshot[TABLE_MAX_SIZE];
+	uint16_t dataReady;
+	uint8_t used;
+
+	// Aggregate tables cover every frame since the table was sent last
+	if (TABLE_AGGREGATE_ENABLED && decoderTable->aggregates != NULL)
+	{
+		if (size < sizeof(uint8_t) + SensorDataManager_GetAggregateSize(table))
+			return 0;
+
+		uint32_t sequence = SensorDataManager_ReadTable(table, snapshot, &dataReady);
+		if (!(dataReady & decoderTable->fullMask) || send->aggregateFrames == 0)
+			return 0;
+
+		Debug_Send(DM_INFO, decoderTable->collected);
+
+		dest[0] = decoderTable->aggregateId;
+		SensorDataManager_TakeAggregates(table, dest + sizeof(uint8_t));
+
+		memcpy(decoderTable->pending, snapshot, decoderTable->size);
+		send->pendingSequence = sequence;
+		send->pending = TRUE;
+
+		return sizeof(uint8_t) + SensorDataManager_GetAggregateSize(table);
+	}
 
-			tableBuffer[bufferUsed++] = TABLE_ID_TEMPERATURE;
+	// Smallest table is a delta table with a single field
+	if (size < sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t))
+		return 0;
 
-			memcpy(tableBuffer + bufferUsed, &_tableTemperature, sizeof(TableTemperature_t));
-			bufferUsed += sizeof(TableTemperature_t);
+	// Only send tables that changed since they were acknowledged, or are due for a keyframe
+	uint32_t sequence = SensorDataManager_ReadTable(table, snapshot, &dataReady);
+	if (!(dataReady & decoderTable->fullMask) || (sequence == send->sentSequence && !send->keyframeDue))
+		return 0;
 
-			_bmsDataReady = 0;
+	used = 0;
+	if (!send->keyframeDue && TABLE_DELTA_ENABLED)
+	{
+		// Encoded aside, its size is only known afterwards
+		uint8_t delta[TABLE_MAX_SIZE + sizeof(uint16_t)];
+		used = SensorDataManager_EncodeDelta(table, snapshot, delta);
+
+		// No field moved more than its deadband
+		if (used == 0)
+			return 0;
+
+		if (used < decoderTable->size)
+		{
+			if (size < sizeof(uint8_t) + used)
+				return 0;
+
+			dest[0] = TABLE_ID_DELTA(decoderTable->id);
+			memcpy(dest + sizeof(uint8_t), delta, used);
 		}
 	}
 
-	CoLeaveMutexSection(_dataMutexId);
+	// Full table when due, or when so many fields moved that the delta table isn't smaller
+	if (used == 0 || used >= decoderTable->size)
+	{
+		if (size < sizeof(uint8_t) + decoderTable->size)
+			return 0;
 
-	return bufferUsed;
+		dest[0] = decoderTable->id;
+		memcpy(dest + sizeof(uint8_t), snapshot, decoderTable->size);
+		memcpy(decoderTable->pending, snapshot, decoderTable->size);
+		used = decoderTable->size;
+	}
+
+	Debug_Send(DM_INFO, decoderTable->collected);
+
+	send->pendingSequence = sequence;
+	send->pending = TRUE;
+
+	return sizeof(uint8_t) + used;
+}
+
+/*
+ * @brief		Write the CAN statistics table, frame counters per filter entry followed by the bus
+ * 				statistics of CAN1 and CAN2
+ * @param[out]	dest Buffer
+ * @param[in]	size Size of buffer
+ * @return		Number of bytes written, 0 if the table doesn't fit
+ */
+uint8_t SensorDataManager_PutCanStatistics(uint8_t *dest, uint16_t size)
+{
+	TableCanStatistics_t tableCanStatistics;
+	CAN_BUS_STATS_T busStats;
+	uint32_t time = MICROSECOND_TIMER;
+	uint8_t used = 0;
+	uint8_t i;
+
+	if (size < sizeof(uint8_t) + sizeof(_canFrameCount) + CAN_CONTROLLER_COUNT * sizeof(TableCanStatistics_t))
+		return 0;
+
+	Debug_Send(DM_INFO, "CAN statistics collected.");
+
+	dest[used++] = TABLE_ID_CAN_STATISTICS;
+
+	// Frame counters are halfwords written by single stores, no lock needed
+	memcpy(dest + used, _canFrameCount, sizeof(_canFrameCount));
+	used += sizeof(_canFrameCount);
+
+	for (i = 0; i < CAN_CONTROLLER_COUNT; i++)
+	{
+		// Counters wrap around, shore side uses differences between packets
+		CanTask_GetBusStats(i, &busStats);
+		tableCanStatistics.ringOverflows = busStats.ringOverflows;
+		tableCanStatistics.dataOverruns = busStats.dataOverruns;
+		tableCanStatistics.errorPassive = busStats.errorPassive;
+		tableCanStatistics.busOff = busStats.busOff;
+		tableCanStatistics.peakRingOccupancy = busStats.peakRingOccupancy;
+
+		// Bus load is the share of the bit time used by received frames since the previous table
+		uint64_t load = time != _canStatisticsTime ?
+				(uint64_t)(busStats.bits - _canBits[i]) * 100 * 1000000 /
+				((uint64_t)(time - _canStatisticsTime) * _canBitrates[i]) : 0;
+		tableCanStatistics.load = load > 100 ? 100 : load;
+		_canBits[i] = busStats.bits;
+
+		memcpy(dest + used, &tableCanStatistics, sizeof(TableCanStatistics_t));
+		used += sizeof(TableCanStatistics_t);
+	}
+
+	_canStatisticsTime = time;
+
+	return used;
+}
+
+/*
+ * @brief		Write the schema table of the next sensor table field. Full, delta and aggregate tables are
+ * 				the table timestamp followed by (included) fields in field order, see SensorDataManager_EncodeDelta()
+ * 				and SensorDataManager_TakeAggregates().
+ * @param[out]	dest Buffer
+ * @param[in]	size Size of buffer
+ * @return		Number of bytes written, 0 if every field is described or the schema table doesn't fit
+ */
+uint8_t SensorDataManager_PutSchema(uint8_t *dest, uint16_t size)
+{
+	const DECODER_TABLE_T *table = &_decoderTables[_schemaTable];
+	const TABLE_FIELD_T *field = &table->fields[_schemaField];
+	uint8_t nameLength = strlen(field->name) + 1;
+	uint8_t unitLength = strlen(field->unit) + 1;
+	uint8_t used = 0;
+
+	if (!_schemaDue)
+		return 0;
+
+	// ID, table ID, aggregate table ID, field index, field count, type, scale, bias, name and unit
+	if (size < 6 * sizeof(uint8_t) + 2 * sizeof(float) + nameLength + unitLength)
+		return 0;
+
+	dest[used++] = TABLE_ID_SCHEMA;
+	dest[used++] = table->id;
+	dest[used++] = table->aggregateId;
+	dest[used++] = _schemaField;
+	dest[used++] = table->fieldCount;
+	dest[used++] = field->type;
+
+	memcpy(dest + used, &field->scale, sizeof(float));
+	used += sizeof(float);
+	memcpy(dest + used, &field->bias, sizeof(float));
+	used += sizeof(float);
+
+	memcpy(dest + used, field->name, nameLength);
+	used += nameLength;
+	memcpy(dest + used, field->unit, unitLength);
+	used += unitLength;
+
+	return used;
+}
+
+/*
+ * @brief		Move the table following the tables in a buffer in front of them, in place
+ * @param[in]	tableBuffer Buffer
+ * @param[in]	bufferUsed Size of the tables in front of the table
+ * @param[in]	size Size of the table
+ * @return		None
+ */
+void SensorDataManager_MoveToFront(uint8_t *tableBuffer, uint16_t bufferUsed, uint8_t size)
+{
+	// Rotate by reversing both parts, then the whole
+	SensorDataManager_Reverse(tableBuffer, bufferUsed);
+	SensorDataManager_Reverse(tableBuffer + bufferUsed, size);
+	SensorDataManager_Reverse(tableBuffer, bufferUsed + size);
+}
+
+// Reverse the order of the bytes in a buffer
+void SensorDataManager_Reverse(uint8_t *data, uint16_t size)
+{
+	uint16_t i;
+
+	for (i = 0; i < size / 2; i++)
+	{
+		uint8_t byte = data[i];
+		data[i] = data[size - 1 - i];
+		data[size - 1 - i] = byte;
+	}
+}
+
+/*
+ * @brief		Check alarm rules on a decoded field and record state changes for the telemetry task. Called within the
+ * 				sequence lock of the table, the caller signals the changes once the table is published
+ * @param[in]	rules Rules to check (bit per rule)
+ * @param[in]	value Decoded value, in the unit of the field
+ * @param[in]	timestamp Reception time of the frame (MICROSECOND_TIMER)
+ * @return		Rules that changed state (bit per rule)
+ */
+uint16_t SensorDataManager_CheckAlarms(uint16_t rules, float value, uint32_t timestamp)
+{
+	uint16_t changed = 0;
+	uint8_t i;
+
+	for (i = 0; i < ALARM_COUNT; i++)
+	{
+		const ALARM_RULE_T *rule = &_alarmRules[i];
+		ALARM_STATE_T *state = &_alarmStates[i];
+		float checked = value;
+
+		if (!(rules & _BIT(i)))
+			continue;
+
+		// Rates of change are measured over a window, steps of integer fields are too coarse for single frames
+		if (rule->condition == ALARM_RISE || rule->condition == ALARM_FALL)
+		{
+			if (!state->rateValid)
+			{
+				state->rateValue = value;
+				state->rateTime = timestamp;
+				state->rateValid = TRUE;
+				continue;
+			}
+
+			uint32_t elapsed = timestamp - state->rateTime;
+			if (elapsed < ALARM_RATE_WINDOW)
+				continue;
+
+			checked = (value - state->rateValue) * 1000000.0f / elapsed;
+			if (rule->condition == ALARM_FALL)
+				checked = -checked;
+
+			state->rateValue = value;
+			state->rateTime = timestamp;
+		}
+
+		BOOL active;
+		if (rule->condition == ALARM_BELOW)
+			active = state->active ? checked < rule->threshold + rule->hysteresis : checked < rule->threshold;
+		else
+			active = state->active ? checked > rule->threshold - rule->hysteresis : checked > rule->threshold;
+
+		if (active == state->active)
+			continue;
+
+		// State changes are rare, publish them to the telemetry task right away
+		CoSchedLock();
+		state->active = active;
+		state->value = checked;
+		state->changeTime = MICROSECOND_TIMER;
+		state->pending = TRUE;
+		CoSchedUnlock();
+
+		changed |= _BIT(i);
+	}
+
+	return changed;
 }
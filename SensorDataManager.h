@@ -12,13 +12,41 @@
 #include <lpc17xx_uart.h>
 #include <CoOs.h>
 
+#include "CanFilter.h"
 #include "Debug.h"
 #include "GM862.h"
 
+/* Defines */
+
+// Version of the sensor table layouts, sent with every packet
+#define SENSOR_SCHEMA_VERSION					1
+
+/* Structs */
+
+// Alarm state change to send latency (microseconds)
+typedef struct {
+
+	uint32_t count;
+	uint32_t last;
+	uint32_t max;
+	uint64_t total;
+
+} ALARM_LATENCY_STATS_T;
+
 /* Prototypes */
 
 BOOL SensorDataManager_Init();
-void SensorDataManager_PutCanData(CAN_MSG_Type *msg);
+void SensorDataManager_PutCanData(CAN_MSG_Type *msg, uint8_t controller, uint32_t timestamp);
 uint16_t SensorDataManager_GetTables(uint8_t *tableBuffer, uint16_t bufferSize);
+void SensorDataManager_AcknowledgeTables(BOOL sent);
+BOOL SensorDataManager_TablesUrgent();
+uint8_t SensorDataManager_GetSnapshot(uint8_t *tableBuffer, uint8_t bufferSize);
+void SensorDataManager_RequestKeyframe();
+void SensorDataManager_RequestSchema();
+BOOL SensorDataManager_WaitForAlarm(uint32_t timeout);
+uint16_t SensorDataManager_GetAlarms(uint8_t *tableBuffer, uint16_t bufferSize);
+void SensorDataManager_AcknowledgeAlarms(BOOL sent);
+void SensorDataManager_GetAlarmLatencyStats(ALARM_LATENCY_STATS_T *stats);
+const CAN_FILTER_ENTRY_T *SensorDataManager_GetCanFilter(uint8_t *count);
 
 #endif
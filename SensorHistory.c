@@ -0,0 +1,114 @@
+/* Name: Sensor history
+ * Description: Keeps timestamped snapshots of the sensor tables in AHB SRAM while the telemetry link is down
+ */
+
+/* Includes */
+
+#include "SensorHistory.h"
+
+/* Defines */
+
+// Snapshots are taken once every telemetry interval (CoOS ticks) while recording
+#define SENSOR_HISTORY_INTERVAL					(3 * CFG_SYSTICK_FREQ / 2)
+
+// Number of snapshots, fills one 16 KB AHB SRAM bank (the other holds the telemetry buffers). Must be a power of two.
+#define SENSOR_HISTORY_SIZE						128
+#define SENSOR_HISTORY_MASK						(SENSOR_HISTORY_SIZE - 1)
+
+#if (SENSOR_HISTORY_SIZE & SENSOR_HISTORY_MASK) != 0
+#error "SENSOR_HISTORY_SIZE must be a power of two"
+#endif
+
+/* Variables */
+
+// Single-producer (CAN task), single-consumer (telemetry task) ring of snapshots, head and tail are
+// free-running counters like the CAN ring buffers. The ring is kept in AHB SRAM, which is otherwise unused.
+static SENSOR_HISTORY_RECORD_T _records[SENSOR_HISTORY_SIZE] __attribute__ ((section(".ahb_ram")));
+static volatile uint32_t _head; // written by CAN task only
+static volatile uint32_t _tail; // written by telemetry task only
+
+static volatile BOOL _recording; // link is down or history is being uploaded
+static uint32_t _sampleTime; // OS time of previous snapshot
+static uint32_t _dropped; // snapshots not taken because the history was full
+
+/* Implementation */
+
+void SensorHistory_Start()
+{
+	if (_recording)
+		return;
+
+	// First snapshot right away
+	_sampleTime = (uint32_t)CoGetOSTime() - SENSOR_HISTORY_INTERVAL;
+	_dropped = 0;
+	_recording = TRUE;
+
+	Debug_Send(DM_INFO, "Sensor history recording started.");
+}
+
+BOOL SensorHistory_Stop()
+{
+	if (!_recording)
+		return FALSE;
+
+	_recording = FALSE;
+
+	Debug_Send(DM_INFO, "Sensor history recording stopped.");
+
+	return TRUE;
+}
+
+void SensorHistory_Sample()
+{
+	uint32_t now = (uint32_t)CoGetOSTime();
+	RTC_TIME_Type rtcTime;
+
+	if (!_recording || now - _sampleTime < SENSOR_HISTORY_INTERVAL)
+		return;
+
+	_sampleTime = now;
+
+	// History is full, keep the oldest snapshots so the upload has no holes up to here
+	uint32_t head = _head;
+	if (head - _tail == SENSOR_HISTORY_SIZE)
+	{
+		if (_dropped++ == 0)
+			Debug_Send(DM_ERROR, "Sensor history full, dropping snapshots.");
+
+		return;
+	}
+
+	SENSOR_HISTORY_RECORD_T *record = &_records[head & SENSOR_HISTORY_MASK];
+
+	RTC_GetFullTime(LPC_RTC, &rtcTime);
+	record->time = (uint32_t)ConvertRtcToUnixTime(&rtcTime);
+	record->size = SensorDataManager_GetSnapshot(record->tables, SENSOR_HISTORY_TABLES_SIZE);
+	if (record->size == 0)
+		return;
+
+	// Make sure the record is written before the telemetry task can see the new head
+	DATA_MEMORY_BARRIER();
+
+	_head = head + 1;
+}
+
+const SENSOR_HISTORY_RECORD_T *SensorHistory_Peek()
+{
+	uint32_t tail = _tail;
+
+	if (tail == _head)
+		return NULL;
+
+	// Make sure the record is read after the head index that published it
+	DATA_MEMORY_BARRIER();
+
+	return &_records[tail & SENSOR_HISTORY_MASK];
+}
+
+void SensorHistory_Pop()
+{
+	// Make sure the record is used before its slot is handed back to the CAN task
+	DATA_MEMORY_BARRIER();
+
+	_tail = _tail + 1;
+}
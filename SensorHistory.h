@@ -0,0 +1,40 @@
+/* Name: Sensor history
+ * Description: Keeps timestamped snapshots of the sensor tables in AHB SRAM while the telemetry link is down
+ */
+
+#ifndef SENSOR_HISTORY_H
+#define SENSOR_HISTORY_H
+
+/* Includes */
+
+#include <lpc_types.h>
+#include <lpc17xx_rtc.h>
+#include <CoOs.h>
+
+#include "Misc.h"
+#include "SensorDataManager.h"
+
+/* Defines */
+
+// Size of the tables of one snapshot, records are 128 bytes
+#define SENSOR_HISTORY_TABLES_SIZE				123
+
+/* Structs */
+
+typedef struct {
+
+	uint32_t time;		// unix time of snapshot
+	uint8_t size;		// bytes used in tables
+	uint8_t tables[SENSOR_HISTORY_TABLES_SIZE];	// full sensor tables, as in a telemetry packet
+
+} SENSOR_HISTORY_RECORD_T;
+
+/* Prototypes */
+
+void SensorHistory_Start();
+BOOL SensorHistory_Stop();
+void SensorHistory_Sample();
+const SENSOR_HISTORY_RECORD_T *SensorHistory_Peek();
+void SensorHistory_Pop();
+
+#endif
@@ -6,6 +6,8 @@
 
 /* Includes */
 
+#include <string.h>
+
 #include "StorageTask.h"
 
 #include "fat_sd/diskio.h"
@@ -15,6 +17,24 @@
 
 #define STORAGE_RING_BUFFER_SIZE		(512)
 
+// Size of the CAN capture ring buffer, must be a power of two
+#define STORAGE_CAN_RING_BUFFER_SIZE	(4096)
+#define STORAGE_CAN_RING_BUFFER_MASK	(STORAGE_CAN_RING_BUFFER_SIZE - 1)
+
+#if (STORAGE_CAN_RING_BUFFER_SIZE & STORAGE_CAN_RING_BUFFER_MASK) != 0
+#error "STORAGE_CAN_RING_BUFFER_SIZE must be a power of two"
+#endif
+
+// Written log and capture data is synced (file size and FAT on the card updated) at most this often (CoOS ticks),
+// a power cut loses what was written since. The outbox is synced on every change.
+#define STORAGE_SYNC_INTERVAL			(2 * CFG_SYSTICK_FREQ)
+
+// The outbox file starts with the offset of its oldest packet, followed by packets with a 16 bit size in front
+#define STORAGE_OUTBOX_HEADER_SIZE		sizeof(uint32_t)
+
+// Outbox is skipped at least this long after the storage task didn't respond in time (CoOS ticks)
+#define STORAGE_OUTBOX_RETRY_INTERVAL	(30 * CFG_SYSTICK_FREQ)
+
 /* Structs */
 
 typedef struct {
@@ -29,17 +49,42 @@ typedef struct {
 /* Variables */
 
 OS_MutexID _logMutexId = E_CREATE_FAIL;
-OS_MutexID _canMutexId = E_CREATE_FAIL;
 
 OS_FlagID _availableFlagId = E_CREATE_FAIL;
+OS_FlagID _outboxDoneFlagId = E_CREATE_FAIL; // set when an outbox put or pop is handled
 
 STORAGE_RING_BUFFER_T _logRingBuffer;
-STORAGE_RING_BUFFER_T _canRingBuffer;
+
+// Single-producer (CAN task), single-consumer (storage task) ring buffer of capture data. Head and tail are
+// free-running counters in zero-initialized RAM, so the CAN task can write before this task is initialized and
+// never has to wait for the card.
+uint8_t _canRingBuffer[STORAGE_CAN_RING_BUFFER_SIZE] __attribute__ ((section(".ahb_ram")));
+volatile uint32_t _canRingBufferHead; // written by CAN task only
+volatile uint32_t _canRingBufferTail; // written by storage task only
 
 FATFS _fatFs;
 
 FIL _logFile;
 FIL _canFile;
+FIL _outboxFile;
+
+uint32_t _syncTime; // OS time of previous sync
+DWORD _logSyncedSize; // file sizes at previous sync
+DWORD _canSyncedSize;
+
+// Outbox of packets that failed to send, appended and drained by the telemetry task through the storage task
+volatile BOOL _outboxReady; // outbox file is open
+volatile BOOL _outboxFailed; // storage task didn't respond in time, the outbox is skipped until it catches up
+uint32_t _outboxFailTime; // OS time the storage task didn't respond
+volatile uint32_t _outboxRequests; // puts and pops requested, written by the telemetry task only
+volatile uint32_t _outboxHandled; // requests handled, written by the storage task only
+const uint8_t * volatile _outboxPutPacket; // packet to append, NULL if none
+volatile uint16_t _outboxPutLength;
+volatile BOOL _outboxPutResult;
+uint8_t _outboxHead[STORAGE_OUTBOX_PACKET_SIZE] __attribute__ ((section(".ahb_ram"))); // oldest packet
+volatile uint16_t _outboxHeadLength; // size of the oldest packet, 0 if not loaded
+volatile BOOL _outboxHeadPopped; // oldest packet was sent, remove it from the outbox
+uint32_t _outboxTail; // file offset of the oldest packet
 
 /* Prototypes */
 
@@ -47,6 +92,14 @@ BOOL StorageTask_Init();
 BOOL StorageTask_PrepareFile(char *filename, FIL *file);
 void StorageTask_QueueData(STORAGE_RING_BUFFER_T *rb, uint8_t *dat, uint32_t len);
 void StorageTask_FlushToDisk(STORAGE_RING_BUFFER_T *rb, FIL *file);
+void StorageTask_FlushCanToDisk();
+uint32_t StorageTask_GetSyncTimeout();
+void StorageTask_SyncFiles();
+BOOL StorageTask_PrepareOutbox();
+BOOL StorageTask_ResetOutbox();
+void StorageTask_ServiceOutbox();
+BOOL StorageTask_OutboxRequest();
+BOOL StorageTask_OutboxResponding();
 
 /* Implementation */
 
@@ -64,8 +117,8 @@ void StorageTask_Run(void *pdata)
 
 	for (;;)
 	{
-		// Wait for data in ring buffers
-		CoWaitForSingleFlag(_availableFlagId, 0);
+		// Wait for data in ring buffers, or until written data is due to be synced
+		CoWaitForSingleFlag(_availableFlagId, StorageTask_GetSyncTimeout());
 
 		// Flush log data from ring buffer to disk
 		if (CoEnterMutexSection(_logMutexId) == E_OK)
@@ -74,14 +127,14 @@ void StorageTask_Run(void *pdata)
 			CoLeaveMutexSection(_logMutexId);
 		}
 
-		// Flush CAN data from ring buffer to disk
-		if (CoEnterMutexSection(_canMutexId) == E_OK)
-		{
-			StorageTask_FlushToDisk(&_canRingBuffer, &_canFile);
-			CoLeaveMutexSection(_canMutexId);
-		}
+		// Flush CAN data from ring buffer to disk, the CAN task keeps appending meanwhile
+		StorageTask_FlushCanToDisk();
+
+		// Syncing costs a FAT and directory update each, not every batch of the CAN task is worth one
+		StorageTask_SyncFiles();
 
-		f_sync(&_logFile);
+		// Append failed packets to the outbox, remove sent ones and load the next
+		StorageTask_ServiceOutbox();
 	}
 }
 
@@ -94,13 +147,131 @@ void StorageTask_WriteLogFile(char *str)
 	}
 }
 
-void StorageTask_WriteCanFile(uint8_t *dat, uint32_t len)
+BOOL StorageTask_WriteCanFile(uint8_t *dat, uint32_t len)
+{
+	uint32_t head = _canRingBufferHead;
+	uint32_t offset = head & STORAGE_CAN_RING_BUFFER_MASK;
+
+	// Ring buffer is full (i.e. data wasn't written to the card fast enough), drop the data instead of waiting
+	if (STORAGE_CAN_RING_BUFFER_SIZE - (head - _canRingBufferTail) < len)
+		return FALSE;
+
+	if (offset + len <= STORAGE_CAN_RING_BUFFER_SIZE)
+	{
+		memcpy(_canRingBuffer + offset, dat, len);
+	}
+	else
+	{
+		memcpy(_canRingBuffer + offset, dat, STORAGE_CAN_RING_BUFFER_SIZE - offset);
+		memcpy(_canRingBuffer, dat + STORAGE_CAN_RING_BUFFER_SIZE - offset, len - (STORAGE_CAN_RING_BUFFER_SIZE - offset));
+	}
+
+	// Make sure the data is written before the storage task can see the new head
+	DATA_MEMORY_BARRIER();
+
+	_canRingBufferHead = head + len;
+
+	// Inform storage task there's data to be written
+	CoSetFlag(_availableFlagId);
+
+	return TRUE;
+}
+
+BOOL StorageTask_OutboxPut(const uint8_t *packet, uint16_t length)
+{
+	if (!_outboxReady || !StorageTask_OutboxResponding() || length > STORAGE_OUTBOX_PACKET_SIZE)
+		return FALSE;
+
+	_outboxPutLength = length;
+	DATA_MEMORY_BARRIER();
+	_outboxPutPacket = packet;
+
+	// Caller reuses the packet buffer once this returns
+	if (!StorageTask_OutboxRequest())
+	{
+		// Withdraw the packet if the storage task didn't take it yet
+		CoSchedLock();
+		_outboxPutPacket = NULL;
+		CoSchedUnlock();
+
+		return FALSE;
+	}
+
+	return _outboxPutResult;
+}
+
+const uint8_t *StorageTask_OutboxPeek(uint16_t *length)
+{
+	uint16_t headLength = _outboxHeadLength;
+
+	if (headLength == 0 || _outboxHeadPopped || !StorageTask_OutboxResponding())
+		return NULL;
+
+	// Make sure the packet is read after the size that published it
+	DATA_MEMORY_BARRIER();
+
+	*length = headLength;
+	return _outboxHead;
+}
+
+void StorageTask_OutboxPop()
+{
+	_outboxHeadPopped = TRUE;
+
+	// Next packet is loaded once this returns, so the backlog drains without gaps
+	StorageTask_OutboxRequest();
+}
+
+/*
+ * @brief		Pass the put or pop set up by the caller to the storage task and wait until it is handled, a card
+ * 				that hangs may not hold up telemetry
+ * @return		TRUE if handled, FALSE if the storage task didn't respond in time (the outbox is skipped for a while)
+ */
+BOOL StorageTask_OutboxRequest()
 {
-	if (CoEnterMutexSection(_canMutexId) == E_OK)
+	uint32_t start = (uint32_t)CoGetOSTime();
+	uint32_t request, elapsed;
+
+	// Make sure the request is written before the storage task can see it counted
+	DATA_MEMORY_BARRIER();
+	request = ++_outboxRequests;
+	CoSetFlag(_availableFlagId);
+
+	// Responses to earlier requests that timed out may still set the flag, they are told apart by the count
+	while (_outboxHandled != request)
 	{
-		StorageTask_QueueData(&_canRingBuffer, dat, len);
-		CoLeaveMutexSection(_canMutexId);
+		elapsed = (uint32_t)CoGetOSTime() - start;
+		if (elapsed >= STORAGE_OUTBOX_TIMEOUT ||
+				CoWaitForSingleFlag(_outboxDoneFlagId, STORAGE_OUTBOX_TIMEOUT - elapsed) != E_OK)
+		{
+			_outboxFailTime = (uint32_t)CoGetOSTime();
+			_outboxFailed = TRUE;
+			Debug_Send(DM_ERROR, "Storage task not responding, outbox skipped.");
+
+			return FALSE;
+		}
 	}
+
+	return TRUE;
+}
+
+/*
+ * @brief		Check whether the outbox may be used, after a timeout once the storage task caught up with the
+ * 				requests and STORAGE_OUTBOX_RETRY_INTERVAL passed
+ * @return		TRUE if the storage task is responding, FALSE if the outbox is skipped
+ */
+BOOL StorageTask_OutboxResponding()
+{
+	if (!_outboxFailed)
+		return TRUE;
+
+	if ((uint32_t)CoGetOSTime() - _outboxFailTime < STORAGE_OUTBOX_RETRY_INTERVAL || _outboxHandled != _outboxRequests)
+		return FALSE;
+
+	_outboxFailed = FALSE;
+	Debug_Send(DM_INFO, "Storage task responding again, outbox used.");
+
+	return TRUE;
 }
 
 BOOL StorageTask_Init()
@@ -109,9 +280,6 @@ BOOL StorageTask_Init()
 	_logRingBuffer.wrBufferIsFull = FALSE;
 	_logRingBuffer.wrBufferHead = 0;
 	_logRingBuffer.wrBufferTail = 0;
-	_canRingBuffer.wrBufferIsFull = FALSE;
-	_canRingBuffer.wrBufferHead = 0;
-	_canRingBuffer.wrBufferTail = 0;
 
 	// Create mutexes to protect against race-conditions
 	_logMutexId = CoCreateMutex();
@@ -120,12 +288,6 @@ BOOL StorageTask_Init()
 		Debug_Send(DM_FATAL_ERROR, "Log mutex creation failed.");
 		return FALSE;
 	}
-	_canMutexId = CoCreateMutex();
-	if (_canMutexId == E_CREATE_FAIL)
-	{
-		Debug_Send(DM_FATAL_ERROR, "CAN mutex creation failed.");
-		return FALSE;
-	}
 
 	// Create availability flag (auto-reset, initial state 0)
 	_availableFlagId = CoCreateFlag(1, 0);
@@ -135,6 +297,13 @@ BOOL StorageTask_Init()
 		return FALSE;
 	}
 
+	_outboxDoneFlagId = CoCreateFlag(1, 0);
+	if (_outboxDoneFlagId == E_CREATE_FAIL)
+	{
+		Debug_Send(DM_FATAL_ERROR, "Outbox flag creation failed.");
+		return FALSE;
+	}
+
 	// Create timer for FAT disk I/O timing
 	OS_TCID timerId;
 	if ((timerId = CoCreateTmr(TMR_TYPE_PERIODIC, 1, 1, disk_timerproc)) == E_CREATE_FAIL)
@@ -155,9 +324,59 @@ BOOL StorageTask_Init()
 	if (!StorageTask_PrepareFile(CAN_FILE_NAME, &_canFile))
 		return FALSE;
 
+	// Files are synced as they are when opened
+	_logSyncedSize = _logFile.fsize;
+	_canSyncedSize = _canFile.fsize;
+	_syncTime = (uint32_t)CoGetOSTime();
+
+	// Telemetry works without an outbox, packets are dropped on failure then
+	Debug_Send(DM_INFO, "Preparing outbox file...");
+	_outboxReady = StorageTask_PrepareOutbox();
+
+	// Load packets left in the outbox
+	CoSetFlag(_availableFlagId);
+
 	return TRUE;
 }
 
+BOOL StorageTask_PrepareOutbox()
+{
+	UINT bytesRead;
+
+	if (f_open(&_outboxFile, OUTBOX_FILE_NAME, FA_OPEN_ALWAYS | FA_READ | FA_WRITE) != FR_OK)
+	{
+		Debug_Send(DM_ERROR, "Can not open outbox file.");
+		return FALSE;
+	}
+
+	// Start with an empty outbox if the file is new or its header doesn't make sense
+	if (f_read(&_outboxFile, &_outboxTail, sizeof(uint32_t), &bytesRead) != FR_OK || bytesRead != sizeof(uint32_t) ||
+			_outboxTail < STORAGE_OUTBOX_HEADER_SIZE || _outboxTail > _outboxFile.fsize)
+		return StorageTask_ResetOutbox();
+
+	Debug_Send(DM_INFO, _outboxTail < _outboxFile.fsize ? "Outbox holds packets." : "Outbox is empty.");
+
+	return TRUE;
+}
+
+BOOL StorageTask_ResetOutbox()
+{
+	UINT bytesWritten;
+
+	_outboxTail = STORAGE_OUTBOX_HEADER_SIZE;
+
+	if (f_lseek(&_outboxFile, 0) != FR_OK ||
+			f_write(&_outboxFile, &_outboxTail, sizeof(uint32_t), &bytesWritten) != FR_OK ||
+			f_truncate(&_outboxFile) != FR_OK || f_sync(&_outboxFile) != FR_OK)
+	{
+		Debug_Send(DM_ERROR, "Outbox reset failed.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
 BOOL StorageTask_PrepareFile(char *filename, FIL *file)
 {
 	// Open file
@@ -166,7 +385,7 @@ BOOL StorageTask_PrepareFile(char *filename, FIL *file)
 	{
 		// Not found, try to create the file
 		Debug_Send(DM_INFO, "File not found, creating new file.");
-		res = f_open(file, CAN_FILE_NAME, FA_CREATE_NEW | FA_WRITE);
+		res = f_open(file, filename, FA_CREATE_NEW | FA_WRITE);
 		if (res != FR_OK)
 		{
 			// Failed to open and create file, abort
@@ -242,3 +461,135 @@ void StorageTask_FlushToDisk(STORAGE_RING_BUFFER_T *rb, FIL *file)
 	rb->wrBufferTail = rb->wrBufferHead;
 	rb->wrBufferIsFull = FALSE;
 }
+
+void StorageTask_FlushCanToDisk()
+{
+	UINT bytesWritten;
+	uint32_t tail = _canRingBufferTail;
+	uint32_t head = _canRingBufferHead;
+	uint32_t offset = tail & STORAGE_CAN_RING_BUFFER_MASK;
+
+	if (head == tail)
+		return;
+
+	// Make sure the data is read after the head index that published it
+	DATA_MEMORY_BARRIER();
+
+	if (offset + (head - tail) <= STORAGE_CAN_RING_BUFFER_SIZE)
+	{
+		f_write(&_canFile, _canRingBuffer + offset, head - tail, &bytesWritten);
+	}
+	else
+	{
+		f_write(&_canFile, _canRingBuffer + offset, STORAGE_CAN_RING_BUFFER_SIZE - offset, &bytesWritten);
+		f_write(&_canFile, _canRingBuffer, (head - tail) - (STORAGE_CAN_RING_BUFFER_SIZE - offset), &bytesWritten);
+	}
+
+	// Make sure the data is written to the card before its space is handed back to the CAN task
+	DATA_MEMORY_BARRIER();
+
+	_canRingBufferTail = head;
+}
+
+/*
+ * @brief		Get the time to wait for data before the log and capture files are due to be synced
+ * @return		CoOS ticks, 0 if there is nothing to sync (wait for data only)
+ */
+uint32_t StorageTask_GetSyncTimeout()
+{
+	uint32_t elapsed = (uint32_t)CoGetOSTime() - _syncTime;
+
+	if (_logFile.fsize == _logSyncedSize && _canFile.fsize == _canSyncedSize)
+		return 0;
+
+	return elapsed < STORAGE_SYNC_INTERVAL ? STORAGE_SYNC_INTERVAL - elapsed : 1;
+}
+
+/*
+ * @brief		Sync the log and capture files when written data is due, so they survive the boat being switched off
+ * @return		None
+ */
+void StorageTask_SyncFiles()
+{
+	if ((uint32_t)CoGetOSTime() - _syncTime < STORAGE_SYNC_INTERVAL)
+		return;
+
+	if (_logFile.fsize != _logSyncedSize && f_sync(&_logFile) == FR_OK)
+		_logSyncedSize = _logFile.fsize;
+
+	if (_canFile.fsize != _canSyncedSize && f_sync(&_canFile) == FR_OK)
+		_canSyncedSize = _canFile.fsize;
+
+	_syncTime = (uint32_t)CoGetOSTime();
+}
+
+void StorageTask_ServiceOutbox()
+{
+	UINT bytesWritten, bytesRead;
+	uint16_t length;
+
+	// Requests counted here are visible below, later ones are handled on the next wakeup
+	uint32_t requests = _outboxRequests;
+	DATA_MEMORY_BARRIER();
+
+	// Append packet of the telemetry task, synced so it survives a reset
+	if (_outboxPutPacket != NULL)
+	{
+		length = _outboxPutLength;
+		_outboxPutResult = _outboxReady &&
+				f_lseek(&_outboxFile, _outboxFile.fsize) == FR_OK &&
+				f_write(&_outboxFile, &length, sizeof(uint16_t), &bytesWritten) == FR_OK &&
+				f_write(&_outboxFile, (const void *)_outboxPutPacket, length, &bytesWritten) == FR_OK &&
+				bytesWritten == length && f_sync(&_outboxFile) == FR_OK;
+
+		_outboxPutPacket = NULL;
+	}
+
+	// Remove the oldest packet once it is sent, an empty outbox is truncated
+	if (_outboxHeadPopped)
+	{
+		_outboxTail += sizeof(uint16_t) + _outboxHeadLength;
+		_outboxHeadLength = 0;
+		DATA_MEMORY_BARRIER();
+		_outboxHeadPopped = FALSE;
+
+		if (_outboxTail >= _outboxFile.fsize)
+		{
+			_outboxReady = StorageTask_ResetOutbox();
+		}
+		else if (f_lseek(&_outboxFile, 0) != FR_OK ||
+				f_write(&_outboxFile, &_outboxTail, sizeof(uint32_t), &bytesWritten) != FR_OK ||
+				f_sync(&_outboxFile) != FR_OK)
+		{
+			Debug_Send(DM_ERROR, "Outbox update failed.");
+			_outboxReady = FALSE;
+		}
+	}
+
+	// Load the oldest packet into RAM, so the telemetry task can send it right away
+	if (_outboxReady && _outboxHeadLength == 0 && _outboxTail < _outboxFile.fsize)
+	{
+		if (f_lseek(&_outboxFile, _outboxTail) != FR_OK ||
+				f_read(&_outboxFile, &length, sizeof(uint16_t), &bytesRead) != FR_OK || bytesRead != sizeof(uint16_t) ||
+				length == 0 || length > STORAGE_OUTBOX_PACKET_SIZE ||
+				f_read(&_outboxFile, _outboxHead, length, &bytesRead) != FR_OK || bytesRead != length)
+		{
+			// Drop a damaged outbox rather than sending garbage
+			Debug_Send(DM_ERROR, "Outbox is damaged, dropping its packets.");
+			_outboxReady = StorageTask_ResetOutbox();
+		}
+		else
+		{
+			// Make sure the packet is written before the telemetry task can see its size
+			DATA_MEMORY_BARRIER();
+			_outboxHeadLength = length;
+		}
+	}
+
+	// Wake the telemetry task, only when it waits as the flag would stay set otherwise
+	if (_outboxHandled != requests)
+	{
+		_outboxHandled = requests;
+		CoSetFlag(_outboxDoneFlagId);
+	}
+}
@@ -21,6 +21,7 @@
 #include <CoOs.h>
 
 #include "Debug.h"
+#include "Misc.h"
 
 /* Defines */
 
@@ -30,6 +31,14 @@
 
 #define LOG_FILE_NAME							"BOATLOG.TXT"
 #define CAN_FILE_NAME							"CANDATA.CAN"
+#define OUTBOX_FILE_NAME						"OUTBOX.BIN"
+
+// Largest packet the outbox takes
+#define STORAGE_OUTBOX_PACKET_SIZE				1024
+
+// Time the storage task gets to append or remove an outbox packet (CoOS ticks), the outbox is skipped for a while
+// when it takes longer
+#define STORAGE_OUTBOX_TIMEOUT					(2 * CFG_SYSTICK_FREQ)
 
 /* Variables */
 
@@ -43,6 +52,9 @@ OS_TID storageTaskId;
 void StorageTask_Run(void *pdata);
 
 void StorageTask_WriteLogFile(char *str);
-void StorageTask_WriteCanFile(uint8_t *dat, uint32_t len);
+BOOL StorageTask_WriteCanFile(uint8_t *dat, uint32_t len);
+BOOL StorageTask_OutboxPut(const uint8_t *packet, uint16_t length);
+const uint8_t *StorageTask_OutboxPeek(uint16_t *length);
+void StorageTask_OutboxPop();
 
 #endif
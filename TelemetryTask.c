@@ -3,13 +3,76 @@
 
 #include "TelemetryTask.h"
 
+/* Defines */
+
+// Sync/sof byte, size (8 bit), schema version (8 bit), id (32 bit) and timestamp (32 bit) in front of the tables
+#define TELEMETRY_PACKET_HEADER_SIZE			(3 * sizeof(uint8_t) + 2 * sizeof(uint32_t))
+
+// Size of a packet, and of the tables that fit in it (the size field is 8 bit)
+#define TELEMETRY_PACKET_SIZE					256
+#define TELEMETRY_TABLES_SIZE					(TELEMETRY_PACKET_SIZE - TELEMETRY_PACKET_HEADER_SIZE - sizeof(uint16_t))
+
+// Sensor data records per batch packet, sent in one socket session (1 = a packet per record)
+#define TELEMETRY_BATCH_SIZE					4
+
+// Sync/sof byte, size (16 bit), schema version (8 bit), id (32 bit) and record count (8 bit) in front of the records
+#define TELEMETRY_BATCH_HEADER_SIZE				(3 * sizeof(uint8_t) + sizeof(uint16_t) + sizeof(uint32_t))
+
+// Timestamp (32 bit) and tables size (8 bit) in front of the tables of a record
+#define TELEMETRY_RECORD_HEADER_SIZE			(sizeof(uint32_t) + sizeof(uint8_t))
+
+// Compress the tables (records) of every packet, see Compression.h (1 = enabled)
+#define TELEMETRY_COMPRESSION_ENABLED			1
+
+// Set in the schema version byte of packets with compressed tables (records), and of packets stored in the outbox.
+// Those reach shore side after packets packed later, which may not take their delta tables as a reference.
+#define TELEMETRY_FLAG_COMPRESSED				0x80
+#define TELEMETRY_FLAG_OUTBOX					0x40
+
+#define TELEMETRY_BATCH_BUFFER_SIZE \
+	(TELEMETRY_BATCH_HEADER_SIZE + TELEMETRY_BATCH_SIZE * (TELEMETRY_RECORD_HEADER_SIZE + TELEMETRY_TABLES_SIZE) + sizeof(uint16_t))
+
+// Time between sensor data packets (CoOS ticks), cut short by alarms
+#define TELEMETRY_INTERVAL						(3 * CFG_SYSTICK_FREQ / 2)
+
+// GPS position is refreshed at most this often (CoOS ticks), every refresh is an AT$GPSACP round trip (and an escape
+// to command mode on the online send path) that holds up the packets. Keep below TABLE_TRACKING_MAX_AGE.
+#define TELEMETRY_GPS_INTERVAL					(4 * CFG_SYSTICK_FREQ)
+
+// Time between statistics reports on the debug output (CoOS ticks)
+#define TELEMETRY_STATS_INTERVAL				(60 * CFG_SYSTICK_FREQ)
+
 /* Prototypes */
 
 static BOOL TelemetryTask_SendSensorData();
+static BOOL TelemetryTask_BatchSensorData();
+static BOOL TelemetryTask_SendBatch();
+static BOOL TelemetryTask_SendAlarms();
+static BOOL TelemetryTask_SendOutbox(BOOL *sent);
+static BOOL TelemetryTask_SendHistory(const SENSOR_HISTORY_RECORD_T *record);
+static BOOL TelemetryTask_SendPacket(uint16_t tablesSize, uint32_t time, BOOL store);
+static BOOL TelemetryTask_StorePacket(uint8_t *packet, uint16_t packetLength);
+static uint16_t TelemetryTask_CompressTables(uint8_t *tables, uint16_t tablesSize, uint8_t *version);
+static void TelemetryTask_ReportStats();
 
 /* Variables */
 
-static uint8_t _packetBuffer[256];
+static uint8_t _packetBuffer[TELEMETRY_PACKET_SIZE];
+
+// Records waiting to be sent in a batch packet, their tables are already acknowledged
+static uint8_t _batchBuffer[TELEMETRY_BATCH_BUFFER_SIZE] __attribute__ ((section(".ahb_ram")));
+static uint16_t _batchUsed; // bytes of records following the header
+static uint8_t _batchCount;
+static uint32_t _batchPackTimes[TELEMETRY_BATCH_SIZE]; // OS time every record was packed
+
+// Compressed tables or records, copied back when smaller
+static uint8_t _compressBuffer[TELEMETRY_BATCH_SIZE * (TELEMETRY_RECORD_HEADER_SIZE + TELEMETRY_TABLES_SIZE)]
+		__attribute__ ((section(".ahb_ram")));
+static TELEMETRY_BATCH_STATS_T _batchStats;
+
+static uint32_t _gpsUpdateTime; // OS time of previous GPS refresh
+static uint32_t _sensorDataTime; // OS time of previous sensor data packet
+static uint32_t _statsTime; // OS time of previous statistics report
 
 /* Implementation */
 
@@ -20,6 +83,11 @@ void TelemetryTask_Run(void *pdata)
 
 	Debug_Send(DM_INFO, "Telemetry task started.");
 
+	// Link is down until the first packet is sent
+	SensorHistory_Start();
+
+	GM862_SetSendPath(COMMAND_CENTER_SEND_PATH);
+
 	/*for (;;)
 	{
 		CoTimeDelay(0, 0, 1, 0);
@@ -84,6 +152,14 @@ TelitOpenSocket:
 		if (openSocketTries-- == 0)
 		{
 			Debug_Send(DM_ERROR, "Opening socket failed after several attempts, resetting modem.");
+
+			// Modem firmware may not support command mode connections
+			if (GM862_GetSendPath() == GM862_SEND_PATH_COMMAND)
+			{
+				Debug_Send(DM_ERROR, "Falling back to online mode connections.");
+				GM862_SetSendPath(GM862_SEND_PATH_ONLINE);
+			}
+
 			GM862_Shutdown();
 			goto TelitInitialize;
 		}
@@ -100,45 +176,462 @@ TelitOpenSocket:
 		CoTimeDelay(0, 0, 4, 0);
 	}
 
+	// Describe the sensor tables once per connection, shore side may have restarted meanwhile
+	SensorDataManager_RequestSchema();
+
 	for (;;)
 	{
-		if (!TelemetryTask_SendSensorData())
+		// Alarms go out before anything else
+		if (!TelemetryTask_SendAlarms())
+			goto TelitCloseSocket;
+
+		// Refresh GPS position on its own schedule whatever the send path, packing the tables only reads the cache
+		if ((uint32_t)CoGetOSTime() - _gpsUpdateTime >= TELEMETRY_GPS_INTERVAL)
 		{
-			Debug_Send(DM_ERROR, "Closing socket.");
-			GM862_CloseSocket();
-			goto TelitOpenSocket;
+			GM862_GpsUpdateCache();
+			_gpsUpdateTime = (uint32_t)CoGetOSTime();
 		}
 
-		CoTimeDelay(0, 0, 1, 500);
+		if ((uint32_t)CoGetOSTime() - _statsTime >= TELEMETRY_STATS_INTERVAL)
+		{
+			TelemetryTask_ReportStats();
+			_statsTime = (uint32_t)CoGetOSTime();
+		}
+
+		// Drain packets that failed to send earlier, one per pass so fresh data goes out in between
+		BOOL outboxSent;
+		if (!TelemetryTask_SendOutbox(&outboxSent))
+			goto TelitCloseSocket;
 
+		// Upload history recorded during an outage first, oldest first and as fast as the modem allows
+		const SENSOR_HISTORY_RECORD_T *record = SensorHistory_Peek();
+		if (record != NULL)
+		{
+			if (!TelemetryTask_SendHistory(record))
+				goto TelitCloseSocket;
+
+			SensorHistory_Pop();
+			continue;
+		}
 
+		// History is uploaded, shore side has missed delta tables while recording
+		if (SensorHistory_Stop())
+		{
+			SensorDataManager_RequestKeyframe();
+			continue;
+		}
+
+		uint32_t elapsed = (uint32_t)CoGetOSTime() - _sensorDataTime;
+		if (elapsed >= TELEMETRY_INTERVAL)
+		{
+			_sensorDataTime = (uint32_t)CoGetOSTime();
+			elapsed = 0;
+
+			if (!TelemetryTask_SendSensorData())
+				goto TelitCloseSocket;
+		}
+
+		// Wait for the next packet, an alarm preempts the wait. The outbox drains at link speed.
+		if (!outboxSent)
+			SensorDataManager_WaitForAlarm(TELEMETRY_INTERVAL - elapsed);
 	}
+
+TelitCloseSocket:
+
+	// Keep snapshots until the link is back
+	SensorHistory_Start();
+
+	Debug_Send(DM_ERROR, "Closing socket.");
+	GM862_CloseSocket();
+	goto TelitOpenSocket;
 }
 
 BOOL TelemetryTask_SendSensorData()
 {
-	// TESTING: Very error prone code, please test carefully
+	RTC_TIME_Type time;
 
-	uint8_t *bufferPos = &_packetBuffer;
+	if (TELEMETRY_BATCH_SIZE > 1)
+		return TelemetryTask_BatchSensorData();
 
-	// Insert sync/sof byte
-	*bufferPos++ = '$';
+	// Copy available data tables (reserve space for the header and checksum (16 bit))
+	uint16_t tablesSize = SensorDataManager_GetTables(_packetBuffer + TELEMETRY_PACKET_HEADER_SIZE,
+			TELEMETRY_TABLES_SIZE);
+	if (tablesSize == 0)
+	{
+		// No data tables are ready
+		Debug_Send(DM_INFO, "No sensor data to send.");
+		return TRUE;
+	}
+
+	RTC_GetFullTime(LPC_RTC, &time);
+	if (TelemetryTask_SendPacket(tablesSize, ConvertRtcToUnixTime(&time), TRUE))
+	{
+		Debug_Send(DM_INFO, "Sensor data successful sent.");
+
+		// Following delta tables are encoded against the tables in this packet
+		SensorDataManager_AcknowledgeTables(TRUE);
+		return TRUE;
+	}
+	else
+	{
+		Debug_Send(DM_ERROR, "Error sending sensor data.");
+
+		// Tables in the outbox reach shore side later and out of order, following delta tables can't build on them
+		SensorDataManager_AcknowledgeTables(FALSE);
+		return FALSE;
+	}
+}
+
+/*
+ * @brief		Add available sensor data tables to the batch as a record, and send the batch once it is full or
+ * 				the record holds urgent tables (see SensorDataManager_TablesUrgent())
+ * @return		TRUE if successful or if the batch isn't full yet, FALSE if sending failed
+ */
+BOOL TelemetryTask_BatchSensorData()
+{
+	RTC_TIME_Type time;
+	uint8_t *record = _batchBuffer + TELEMETRY_BATCH_HEADER_SIZE + _batchUsed;
+	BOOL urgent = FALSE;
 
-	// Copy available data tables (reserve space for size (8 bit), id (32 bit), timestamp (32 bit))
-	uint16_t tablesSize = SensorDataManager_GetTables(
-			bufferPos + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t), 128);
+	uint16_t tablesSize = SensorDataManager_GetTables(record + TELEMETRY_RECORD_HEADER_SIZE, TELEMETRY_TABLES_SIZE);
 	if (tablesSize == 0)
 	{
 		// No data tables are ready
 		Debug_Send(DM_INFO, "No sensor data to send.");
+	}
+	else
+	{
+		// Insert timestamp and size of the tables
+		RTC_GetFullTime(LPC_RTC, &time);
+		*((uint32_t *)record) = ConvertRtcToUnixTime(&time);
+		*((uint8_t *)(record + sizeof(uint32_t))) = tablesSize;
+
+		_batchUsed += TELEMETRY_RECORD_HEADER_SIZE + tablesSize;
+		_batchPackTimes[_batchCount++] = (uint32_t)CoGetOSTime();
+
+		// Tables of a tripped alarm rule may not wait for the batch to fill up
+		urgent = SensorDataManager_TablesUrgent();
+
+		// Following delta tables are encoded against the tables in this record
+		SensorDataManager_AcknowledgeTables(TRUE);
+	}
+
+	if (_batchCount < TELEMETRY_BATCH_SIZE && !urgent)
+		return TRUE;
+
+	return TelemetryTask_SendBatch();
+}
+
+/*
+ * @brief		Complete the batch packet around the records in the batch buffer and send it through the open socket
+ * @return		TRUE if successful, FALSE if sending failed
+ */
+BOOL TelemetryTask_SendBatch()
+{
+	uint8_t *bufferPos = _batchBuffer;
+	uint16_t recordsSize = _batchUsed;
+	uint8_t count = _batchCount;
+	uint8_t version = SENSOR_SCHEMA_VERSION;
+	uint8_t i;
+
+	// Batch is emptied either way
+	_batchUsed = 0;
+	_batchCount = 0;
+
+	// Records are compressed together, they are alike
+	if (TELEMETRY_COMPRESSION_ENABLED)
+		recordsSize = TelemetryTask_CompressTables(_batchBuffer + TELEMETRY_BATCH_HEADER_SIZE, recordsSize, &version);
+
+	// Insert sync/sof byte, differs from single record packets
+	*bufferPos++ = '#';
+
+	// Insert size
+	uint16_t totalSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint8_t) + recordsSize + sizeof(uint16_t);
+	*((uint16_t *)bufferPos) = totalSize;
+	bufferPos += sizeof(uint16_t);
+
+	// Insert schema version
+	*((uint8_t *)bufferPos) = version;
+	bufferPos += sizeof(uint8_t);
+
+	// Insert and update packet id
+	uint32_t packetId = RTC_ReadGPREG(LPC_RTC, 0); // read from RTC RAM
+	RTC_WriteGPREG(LPC_RTC, 0, packetId + 1); // write back
+	*((uint32_t *)bufferPos) = packetId;
+	bufferPos += sizeof(uint32_t);
+
+	// Insert record count
+	*((uint8_t *)bufferPos) = count;
+	bufferPos += sizeof(uint8_t);
+
+	// Skip records
+	bufferPos += recordsSize;
+
+	// Calculate checksum of packet excluding sync/sof byte
+	uint16_t checksum = CalculateCrc16((char *)_batchBuffer + 1, bufferPos - _batchBuffer - 1);
+
+	// Insert checksum at end
+	*((uint16_t *)bufferPos) = checksum;
+	bufferPos += sizeof(uint16_t);
+
+	uint32_t startTime = (uint32_t)CoGetOSTime();
+	if (!GM862_SendThroughSocket(_batchBuffer, bufferPos - _batchBuffer))
+	{
+		Debug_Send(DM_ERROR, "Error sending sensor data batch.");
+
+		// Records are acknowledged when batched, the outbox delivers them only after following delta tables
+		TelemetryTask_StorePacket(_batchBuffer, bufferPos - _batchBuffer);
+		SensorDataManager_RequestKeyframe();
+
+		// Nothing is pending anymore, this backs off the byte budget
+		SensorDataManager_AcknowledgeTables(FALSE);
+		return FALSE;
+	}
+
+	// Update throughput and record latency, in milliseconds
+	uint32_t now = (uint32_t)CoGetOSTime();
+	uint32_t sendTime = (now - startTime) * 1000 / CFG_SYSTICK_FREQ;
+
+	CoSchedLock();
+	_batchStats.batches++;
+	_batchStats.records += count;
+	_batchStats.bytes += bufferPos - _batchBuffer;
+	_batchStats.sendTime += sendTime;
+	for (i = 0; i < count; i++)
+	{
+		uint32_t latency = (now - _batchPackTimes[i]) * 1000 / CFG_SYSTICK_FREQ;
+		_batchStats.lastLatency = latency;
+		if (latency > _batchStats.maxLatency)
+			_batchStats.maxLatency = latency;
+		_batchStats.totalLatency += latency;
+	}
+	CoSchedUnlock();
+
+	char buffer[96];
+	sprintf(buffer, "Sensor data batch sent (%u records, %u bytes, %lu bytes/s).", count,
+			(unsigned int)(bufferPos - _batchBuffer),
+			(unsigned long)(sendTime ? (bufferPos - _batchBuffer) * 1000UL / sendTime : 0));
+	Debug_Send(DM_INFO, buffer);
+
+	return TRUE;
+}
+
+void TelemetryTask_GetBatchStats(TELEMETRY_BATCH_STATS_T *stats)
+{
+	// Statistics are written by the telemetry task only, prevent a torn copy
+	CoSchedLock();
+	*stats = _batchStats;
+	CoSchedUnlock();
+}
+
+/*
+ * @brief		Send the statistics on the debug output
+ * @return		None
+ */
+void TelemetryTask_ReportStats()
+{
+	TELEMETRY_BATCH_STATS_T batchStats;
+	CAN_LATENCY_STATS_T latencyStats;
+	CAN_ISR_STATS_T isrStats;
+	ALARM_LATENCY_STATS_T alarmStats;
+	GM862_MODE_STATS_T modeStats;
+	GM862_SEND_STATS_T sendStats;
+	COMPRESSION_STATS_T compressionStats;
+	uint8_t path;
+	char buffer[128];
+
+	// Records per batch show how often batches are cut short by alarms
+	TelemetryTask_GetBatchStats(&batchStats);
+	if (batchStats.batches != 0)
+	{
+		sprintf(buffer, "Batches: %lu, %lu.%02lu records/batch, %lu bytes/batch, record latency %lu ms mean, %lu ms max.",
+				(unsigned long)batchStats.batches, (unsigned long)(batchStats.records / batchStats.batches),
+				(unsigned long)(batchStats.records * 100 / batchStats.batches % 100),
+				(unsigned long)(batchStats.bytes / batchStats.batches),
+				(unsigned long)(batchStats.totalLatency / batchStats.records), (unsigned long)batchStats.maxLatency);
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Time frames wait in the ring buffers until the CAN task decodes them
+	CanTask_GetLatencyStats(&latencyStats);
+	if (latencyStats.count != 0)
+	{
+		sprintf(buffer, "CAN decode latency: %lu us mean, %lu us max (%lu frames).",
+				(unsigned long)CYCLES_TO_MICROSECONDS(latencyStats.total / latencyStats.count),
+				(unsigned long)CYCLES_TO_MICROSECONDS(latencyStats.max), (unsigned long)latencyStats.count);
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Interrupt load, frames per entry show how well the handler batches
+	CanTask_GetIsrStats(&isrStats);
+	if (isrStats.entries != 0)
+	{
+		sprintf(buffer, "CAN interrupts: %lu, %lu frames, %lu cycles mean, %lu cycles max.",
+				(unsigned long)isrStats.entries, (unsigned long)isrStats.frames,
+				(unsigned long)(isrStats.totalCycles / isrStats.entries), (unsigned long)isrStats.maxCycles);
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Time from an alarm state change to the end of sending it
+	SensorDataManager_GetAlarmLatencyStats(&alarmStats);
+	if (alarmStats.count != 0)
+	{
+		sprintf(buffer, "Alarm latency: %lu ms mean, %lu ms max (%lu state changes).",
+				(unsigned long)(alarmStats.total / alarmStats.count / 1000), (unsigned long)(alarmStats.max / 1000),
+				(unsigned long)alarmStats.count);
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Time the modem spent in every mode, switches are what the online send path costs
+	GM862_GetModeStats(&modeStats);
+	sprintf(buffer, "Modem modes: %lu s command, %lu s online, %lu s switching, %lu switches.",
+			(unsigned long)(modeStats.time[GM862_MODE_COMMAND] / CFG_SYSTICK_FREQ),
+			(unsigned long)(modeStats.time[GM862_MODE_ONLINE] / CFG_SYSTICK_FREQ),
+			(unsigned long)(modeStats.time[GM862_MODE_SWITCHING] / CFG_SYSTICK_FREQ), (unsigned long)modeStats.switches);
+	Debug_Send(DM_INFO, buffer);
+
+	// Send time per send path, the command path falls back to the online path if the modem lacks #SSENDEXT
+	for (path = 0; path < GM862_SEND_PATH_COUNT; path++)
+	{
+		GM862_GetSendStats(path, &sendStats);
+		if (sendStats.packets == 0)
+			continue;
+
+		sprintf(buffer, "%s send path: %lu packets, %lu ms mean, %lu ms max.",
+				path == GM862_SEND_PATH_COMMAND ? "Command" : "Online", (unsigned long)sendStats.packets,
+				(unsigned long)(sendStats.totalTime * 1000 / CFG_SYSTICK_FREQ / sendStats.packets),
+				(unsigned long)(sendStats.maxTime * 1000 / CFG_SYSTICK_FREQ));
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Bytes saved by compression and what it costs
+	Compression_GetStats(&compressionStats);
+	if (TELEMETRY_COMPRESSION_ENABLED && compressionStats.inputBytes != 0)
+	{
+		sprintf(buffer, "Compression: %lu packets, %lu of %lu bytes (%lu%%), %lu us.",
+				(unsigned long)compressionStats.count, (unsigned long)compressionStats.outputBytes,
+				(unsigned long)compressionStats.inputBytes,
+				(unsigned long)((uint64_t)compressionStats.outputBytes * 100 / compressionStats.inputBytes),
+				(unsigned long)CYCLES_TO_MICROSECONDS(compressionStats.cycles));
+		Debug_Send(DM_INFO, buffer);
+	}
+
+	// Capture records the storage task had no room for
+	if (CAN_CAPTURE_ENABLED)
+	{
+		sprintf(buffer, "CAN capture: %lu records dropped.", (unsigned long)CanTask_GetCaptureDropped());
+		Debug_Send(DM_INFO, buffer);
+	}
+}
+
+/*
+ * @brief		Send alarm rule state changes in a packet of their own, regardless of the byte budget
+ * @return		TRUE if successful or if there are no state changes, FALSE if sending failed
+ */
+BOOL TelemetryTask_SendAlarms()
+{
+	RTC_TIME_Type time;
+
+	uint16_t tablesSize = SensorDataManager_GetAlarms(_packetBuffer + TELEMETRY_PACKET_HEADER_SIZE,
+			TELEMETRY_TABLES_SIZE);
+	if (tablesSize == 0)
+		return TRUE;
+
+	RTC_GetFullTime(LPC_RTC, &time);
+	// Alarm state changes stay pending until sent, no need for the outbox
+	if (TelemetryTask_SendPacket(tablesSize, ConvertRtcToUnixTime(&time), FALSE))
+	{
+		Debug_Send(DM_INFO, "Alarms successful sent.");
+
+		SensorDataManager_AcknowledgeAlarms(TRUE);
+		return TRUE;
+	}
+	else
+	{
+		Debug_Send(DM_ERROR, "Error sending alarms.");
+
+		SensorDataManager_AcknowledgeAlarms(FALSE);
+		return FALSE;
+	}
+}
+
+/*
+ * @brief		Send the oldest packet of the outbox, and remove it from the outbox once sent
+ * @param[out]	sent TRUE if a packet was sent
+ * @return		TRUE if successful or if the outbox is empty, FALSE if sending failed
+ */
+BOOL TelemetryTask_SendOutbox(BOOL *sent)
+{
+	uint16_t length;
+	const uint8_t *packet = StorageTask_OutboxPeek(&length);
+
+	*sent = FALSE;
+	if (packet == NULL)
 		return TRUE;
+
+	// Sent as framed when they failed, with their original packet id
+	if (!GM862_SendThroughSocket((uint8_t *)packet, length))
+	{
+		Debug_Send(DM_ERROR, "Error sending packet from outbox.");
+		return FALSE;
 	}
 
+	// Shore side decodes the packet apart (TELEMETRY_FLAG_OUTBOX), fresh tables can keep building on their reference
+	StorageTask_OutboxPop();
+
+	*sent = TRUE;
+	return TRUE;
+}
+
+/*
+ * @brief		Send a snapshot from the sensor history, with the time it was taken
+ * @param[in]	record Snapshot, see SensorHistory_Peek()
+ * @return		TRUE if successful, FALSE if sending failed
+ */
+BOOL TelemetryTask_SendHistory(const SENSOR_HISTORY_RECORD_T *record)
+{
+	memcpy(_packetBuffer + TELEMETRY_PACKET_HEADER_SIZE, record->tables, record->size);
+
+	// History is kept in RAM until sent, no need for the outbox
+	if (!TelemetryTask_SendPacket(record->size, record->time, FALSE))
+	{
+		Debug_Send(DM_ERROR, "Error sending sensor history.");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * @brief		Complete the packet around the tables in the packet buffer and send it through the open socket
+ * @param[in]	tablesSize Size of the tables following the header
+ * @param[in]	time Unix time of the tables
+ * @param[in]	store Store the packet in the outbox if it fails to send, instead of dropping it
+ * @return		TRUE if successful, FALSE if sending failed
+ */
+BOOL TelemetryTask_SendPacket(uint16_t tablesSize, uint32_t time, BOOL store)
+{
+	// TESTING: Very error prone code, please test carefully
+
+	uint8_t *bufferPos = _packetBuffer;
+	uint8_t version = SENSOR_SCHEMA_VERSION;
+
+	// Compress tables in place, before the size is known
+	if (TELEMETRY_COMPRESSION_ENABLED)
+		tablesSize = TelemetryTask_CompressTables(_packetBuffer + TELEMETRY_PACKET_HEADER_SIZE, tablesSize, &version);
+
+	// Insert sync/sof byte
+	*bufferPos++ = '$';
+
 	// Insert size
-	uint8_t totalSize = sizeof(uint32_t) + sizeof(uint32_t) + tablesSize + sizeof(uint16_t);
+	uint8_t totalSize = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + tablesSize + sizeof(uint16_t);
 	*((uint8_t *)bufferPos) = totalSize;
 	bufferPos += sizeof(uint8_t);
 
+	// Insert schema version, shore side decodes the tables with the schema of this version
+	*((uint8_t *)bufferPos) = version;
+	bufferPos += sizeof(uint8_t);
+
 	// Insert and update packet id
 	uint32_t packetId = RTC_ReadGPREG(LPC_RTC, 0); // read from RTC RAM
 	RTC_WriteGPREG(LPC_RTC, 0, packetId + 1); // write back
@@ -146,16 +639,14 @@ BOOL TelemetryTask_SendSensorData()
 	bufferPos += sizeof(uint32_t);
 
 	// Insert timestamp
-	RTC_TIME_Type time;
-	RTC_GetFullTime(LPC_RTC, &time);
-	*((uint32_t *)bufferPos) = ConvertRtcToUnixTime(&time);
+	*((uint32_t *)bufferPos) = time;
 	bufferPos += sizeof(uint32_t);
 
 	// Skip data tables
 	bufferPos += tablesSize;
 
 	// Calculate checksum of packet excluding sync/sof byte
-	uint16_t checksum = CalculateCrc16(_packetBuffer + 1, bufferPos - _packetBuffer - 1);
+	uint16_t checksum = CalculateCrc16((char *)_packetBuffer + 1, bufferPos - _packetBuffer - 1);
 
 	// Insert checksum at end
 	*((uint16_t *)bufferPos) = checksum;
@@ -172,13 +663,54 @@ BOOL TelemetryTask_SendSensorData()
 
 	// Sending packet with Telit GM862 through open socket
 	if (GM862_SendThroughSocket(_packetBuffer, bufferPos - _packetBuffer))
-	{
-		Debug_Send(DM_INFO, "Sensor data successful sent.");
 		return TRUE;
-	}
-	else
+
+	if (store)
+		TelemetryTask_StorePacket(_packetBuffer, bufferPos - _packetBuffer);
+
+	return FALSE;
+}
+
+/*
+ * @brief		Store a framed packet that failed to send in the outbox, it is sent again after reconnecting
+ * @param[in]	packet Framed packet, marked with TELEMETRY_FLAG_OUTBOX
+ * @param[in]	packetLength Size of the packet
+ * @return		TRUE if stored, FALSE if the outbox is unavailable
+ */
+BOOL TelemetryTask_StorePacket(uint8_t *packet, uint16_t packetLength)
+{
+	// Mark the packet in its schema version byte, after the size field of a single (8 bit) or batch (16 bit) packet
+	packet[packet[0] == '#' ? 1 + sizeof(uint16_t) : 1 + sizeof(uint8_t)] |= TELEMETRY_FLAG_OUTBOX;
+
+	// Calculate checksum of packet excluding sync/sof byte again
+	uint16_t checksum = CalculateCrc16((char *)packet + 1, packetLength - 1 - sizeof(uint16_t));
+	*((uint16_t *)(packet + packetLength - sizeof(uint16_t))) = checksum;
+
+	if (!StorageTask_OutboxPut(packet, packetLength))
 	{
-		Debug_Send(DM_ERROR, "Error sending sensor data.");
+		Debug_Send(DM_ERROR, "Packet dropped, outbox unavailable.");
 		return FALSE;
 	}
+
+	Debug_Send(DM_INFO, "Packet stored in outbox.");
+	return TRUE;
+}
+
+/*
+ * @brief		Compress tables (or records) in place if that makes them smaller
+ * @param[in]	tables Tables in the packet buffer
+ * @param[in]	tablesSize Size of the tables
+ * @param[out]	version Schema version byte, TELEMETRY_FLAG_COMPRESSED is set if the tables are compressed
+ * @return		Size of the tables as they are sent
+ */
+uint16_t TelemetryTask_CompressTables(uint8_t *tables, uint16_t tablesSize, uint8_t *version)
+{
+	uint16_t compressedSize = Compression_Compress(tables, tablesSize, _compressBuffer, tablesSize - 1);
+	if (compressedSize == 0)
+		return tablesSize;
+
+	memcpy(tables, _compressBuffer, compressedSize);
+	*version |= TELEMETRY_FLAG_COMPRESSED;
+
+	return compressedSize;
 }
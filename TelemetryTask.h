@@ -16,6 +16,10 @@
 #include "Debug.h"
 #include "ThreadSafeQueue.h"
 #include "GM862.h"
+#include "CanTask.h"
+#include "StorageTask.h"
+#include "SensorHistory.h"
+#include "Compression.h"
 
 /* Defines */
 
@@ -29,6 +33,25 @@
 //Port 88 for A-boat and 90 for T-boat
 #define COMMAND_CENTER_PORT						88
 
+// Socket send path, GM862_SEND_PATH_COMMAND sends without mode switches but needs modem firmware with
+// command mode connections (#SSENDEXT). Falls back to GM862_SEND_PATH_ONLINE if the socket can't be opened.
+#define COMMAND_CENTER_SEND_PATH				GM862_SEND_PATH_COMMAND
+
+/* Structs */
+
+// Sensor data batch throughput and record latency
+typedef struct {
+
+	uint32_t batches;
+	uint32_t records;
+	uint32_t bytes;				// bytes of batch packets sent
+	uint32_t sendTime;			// milliseconds spent sending batch packets
+	uint32_t lastLatency;		// milliseconds from packing a record to the end of sending its batch
+	uint32_t maxLatency;
+	uint64_t totalLatency;
+
+} TELEMETRY_BATCH_STATS_T;
+
 /* Variables */
 
 // Telemetry task stack and unique identifier administration
@@ -42,4 +65,6 @@ QueueStruct_T _sensorDataQueue;
 // Telemetry task prototype
 void TelemetryTask_Run(void *pdata);
 
+void TelemetryTask_GetBatchStats(TELEMETRY_BATCH_STATS_T *stats);
+
 #endif
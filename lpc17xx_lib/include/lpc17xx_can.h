@@ -816,6 +816,7 @@ void CAN_DeInit(LPC_CAN_TypeDef *CANx);
 Status CAN_SendMsg(LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg);
 Status CAN_ReceiveMsg(LPC_CAN_TypeDef *CANx, CAN_MSG_Type *CAN_Msg);
 CAN_ERROR FCAN_ReadObj(LPC_CANAF_TypeDef* CANAFx, CAN_MSG_Type *CAN_Msg);
+CAN_ERROR FCAN_ReadObjByIndex(LPC_CANAF_TypeDef* CANAFx, uint8_t index, CAN_MSG_Type *CAN_Msg);
 
 /* CAN configure functions ---------------*/
 void CAN_ModeConfig(LPC_CAN_TypeDef* CANx, CAN_MODE_Type mode,
@@ -1588,6 +1588,64 @@ CAN_ERROR FCAN_ReadObj (LPC_CANAF_TypeDef* CANAFx, CAN_MSG_Type *CAN_Msg)
 	}
 	return CAN_FULL_OBJ_NOT_RCV;
 }
+/********************************************************************//**
+ * @brief		Receive FullCAN Object by its index in the FullCAN table, does
+ * 				not depend on FullCAN interrupts being enabled
+ * @param[in]	CANAFx: CAN Acceptance Filter register, should be: LPC_CANAF
+ * @param[in]	index: index of the object, equal to the position of its ID in
+ * 				the (sorted) FullCAN section of the AFLUT
+ * @param[in]	CAN_Msg point to the CAN_MSG_Type Struct, it will contain received
+ *  			message information such as: ID, DLC, RTR, ID Format
+ * @return 		CAN_ERROR, could be:
+ * 				- CAN_FULL_OBJ_NOT_RCV: FullCAN Object has not been updated since
+ * 				  last read, or is being updated by hardware
+ * 				- CAN_OK: Received FullCAN Object successful
+ *
+ *********************************************************************/
+CAN_ERROR FCAN_ReadObjByIndex (LPC_CANAF_TypeDef* CANAFx, uint8_t index, CAN_MSG_Type *CAN_Msg)
+{
+	uint32_t *pSrc, data;
+
+	CHECK_PARAM(PARAM_CANAFx(CANAFx));
+
+	pSrc = (uint32_t *) (CANAFx->ENDofTable + LPC_CANAF_RAM_BASE + index * 12);
+
+	/* Has been finished updating the content */
+	if ((*pSrc & 0x03000000L) != 0x03000000L)
+	{
+		return CAN_FULL_OBJ_NOT_RCV;
+	}
+
+	/*clear semaphore*/
+	*pSrc &= 0xFCFFFFFF;
+
+	/*Set to DatA*/
+	data = *(pSrc + 1);
+	*((uint8_t *) &CAN_Msg->dataA[0])= data & 0x000000FF;
+	*((uint8_t *) &CAN_Msg->dataA[1])= (data & 0x0000FF00)>>8;
+	*((uint8_t *) &CAN_Msg->dataA[2])= (data & 0x00FF0000)>>16;
+	*((uint8_t *) &CAN_Msg->dataA[3])= (data & 0xFF000000)>>24;
+
+	/*Set to DatB*/
+	data = *(pSrc + 2);
+	*((uint8_t *) &CAN_Msg->dataB[0])= data & 0x000000FF;
+	*((uint8_t *) &CAN_Msg->dataB[1])= (data & 0x0000FF00)>>8;
+	*((uint8_t *) &CAN_Msg->dataB[2])= (data & 0x00FF0000)>>16;
+	*((uint8_t *) &CAN_Msg->dataB[3])= (data & 0xFF000000)>>24;
+
+	CAN_Msg->id = *pSrc & 0x7FF;
+	CAN_Msg->len = (uint8_t) (*pSrc >> 16) & 0x0F;
+	CAN_Msg->format = 0; //FullCAN Object ID always is 11-bit value
+	CAN_Msg->type = (uint8_t)(*pSrc >> 30) &0x01;
+
+	/*Re-read semaphore, hardware may have updated the object while reading*/
+	if ((*pSrc & 0x03000000L) != 0)
+	{
+		return CAN_FULL_OBJ_NOT_RCV;
+	}
+
+	return CAN_OK;
+}
 /********************************************************************//**
  * @brief		Get CAN Control Status
  * @param[in]	CANx pointer to LPC_CAN_TypeDef, should be:
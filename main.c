@@ -67,8 +67,8 @@ int main()
 		while (1); // Enter panic state
 	}
 
-	// Initialize storage task
-	/*storageTaskId = CoCreateTask(
+	// Initialize storage task, writes the log, the CAN capture of the CAN task and the outbox of the telemetry task
+	storageTaskId = CoCreateTask(
 			StorageTask_Run, (void *)0,
 			STORAGE_TASK_PRIORITY,
 			&storageTaskStack[STORAGE_TASK_STACK_SIZE - 1],
@@ -77,7 +77,7 @@ int main()
 	{
 		Debug_Send(DM_FATAL_ERROR, "Initialization of storage task failed.");
 		while (1); // Enter panic state
-	}*/
+	}
 
 	// Initialize notification task
 	/*notificationTaskId = CoCreateTask(